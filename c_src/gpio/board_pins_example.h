@@ -0,0 +1,16 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+// Example board pin map for a specialised build of the GPIO service, see
+// c_src/gpio/readme.md. This one only allows the four user LEDs of the
+// BeagleBone Black, GPIO1_21 to GPIO1_24.
+//
+// GPIO_BOARD_PINS lists the flat pin numbers (32 * controller + pin) that the
+// board uses, each one wrapped in X().
+
+#define GPIO_BOARD_PINS(X) \
+  X(53) \
+  X(54) \
+  X(55) \
+  X(56)
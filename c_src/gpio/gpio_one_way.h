@@ -0,0 +1,44 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+// Client side of the one-way protocol that the GPIO service publishes when it
+// is given the one_way_protocol option. A client registers with the protocol
+// like with any other, and then sends writes to the token it was given with
+// gpio_one_way_write(), which returns as soon as the service has received the
+// write rather than once it has been performed.
+//
+// The service never replies to a write on this protocol, so a write must be
+// sent and never called. Writes that the service can't perform are counted
+// for the client instead, and read back as the one_way_errors of a stats
+// request on one of the service's other protocols.
+
+#ifndef _GPIO_ONE_WAY_H_
+#define _GPIO_ONE_WAY_H_
+
+#include <kos.h>
+#include <stdbool.h>
+
+#define GPIO_ONE_WAY_WRITE_REQUEST 15
+
+// A one-way write is encoded like a fast write, the flat pin in the low byte
+// of the param and the level in the bit above it
+#define GPIO_ONE_WAY_PIN_MASK 0xff
+#define GPIO_ONE_WAY_LEVEL_SHIFT 8
+
+// Sends a write of level to the flat pin (32 * controller + pin) through the
+// token of the one-way protocol. Writes are performed in the order they are
+// sent. Returns false without sending anything if the pin doesn't fit in the
+// encoding.
+static inline bool gpio_one_way_write(seL4_CPtr token, unsigned int pin, bool level) {
+  if (pin > GPIO_ONE_WAY_PIN_MASK)
+    return false;
+
+  seL4_SetMR(0, GPIO_ONE_WAY_WRITE_REQUEST);
+  seL4_SetMR(1, pin | ((seL4_Word) level << GPIO_ONE_WAY_LEVEL_SHIFT));
+  seL4_SetMR(2, 0);
+  seL4_Send(token, seL4_MessageInfo_new(0, 0, 0, 3));
+  return true;
+}
+
+#endif
@@ -0,0 +1,37 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+// Badges, token slots and threads of the GPIO service's listeners. The combined I/O
+// service serves the default listener's protocol itself and gives the PWM
+// service the first badge and token slot past the GPIO ones.
+
+#ifndef _GPIO_PROTOCOL_H_
+#define _GPIO_PROTOCOL_H_
+
+#include <kos.h>
+
+#define GPIO_NUM_CONTROLLERS 4
+
+// The default listener, the priority listener, one listener per controller
+// and the one-way listener
+#define GPIO_NUM_LISTENERS (3 + GPIO_NUM_CONTROLLERS)
+
+// The listeners, an interrupt thread per controller and the debounce timer
+// thread
+#define GPIO_NUM_THREADS (GPIO_NUM_LISTENERS + GPIO_NUM_CONTROLLERS + 1)
+
+#define GPIO_PROTOCOL_BADGE (KOS_CORE_APP_ID_LIMIT)
+#define GPIO_PRIORITY_PROTOCOL_BADGE (KOS_CORE_APP_ID_LIMIT + 1)
+#define GPIO_CONTROLLER_PROTOCOL_BADGE(controller) (KOS_CORE_APP_ID_LIMIT + 2 + (controller))
+// Writes sent to this badge are never replied to, see gpio_one_way.h
+#define GPIO_ONE_WAY_PROTOCOL_BADGE (KOS_CORE_APP_ID_LIMIT + 2 + GPIO_NUM_CONTROLLERS)
+
+// Each listener has its own pair of token slots
+#define GPIO_RECEIVE_TOKEN_SLOT(listener) (1 + 2 * (listener))
+#define GPIO_TRANSFER_TOKEN_SLOT(listener) (2 + 2 * (listener))
+
+#define GPIO_FIRST_FREE_BADGE (KOS_CORE_APP_ID_LIMIT + GPIO_NUM_LISTENERS)
+#define GPIO_FIRST_FREE_TOKEN_SLOT GPIO_RECEIVE_TOKEN_SLOT(GPIO_NUM_LISTENERS)
+
+#endif
@@ -0,0 +1,84 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+// Layout of the status page that the GPIO service keeps in the frame given to
+// it with the status_frame option. Clients that are given the same frame in
+// their manifest read the pins from it with plain loads instead of a request.
+//
+// Each controller has its own sequence number, which is odd while the service
+// updates the controller. A reader retries until it sees the same even
+// sequence before and after reading, see gpio_status_read(). Clients map the
+// page with gpio_status_map(), which only gives them read access to it.
+
+#ifndef _GPIO_STATUS_H_
+#define _GPIO_STATUS_H_
+
+#include <kos.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GPIO_STATUS_MAGIC 0x47505354
+#define GPIO_STATUS_CONTROLLERS 4
+
+// Same as the controller states of a dump
+#define GPIO_STATUS_UNAVAILABLE 0
+#define GPIO_STATUS_UNINITIALIZED 1
+#define GPIO_STATUS_INITIALIZED 2
+
+typedef struct {
+  volatile uint32_t sequence;
+  uint32_t state;
+  // GPIO_OE, a set bit is an input
+  uint32_t oe;
+  uint32_t dataout;
+  uint32_t datain;
+  // Number of times the controller was updated
+  uint32_t updates;
+} gpio_status_controller_t;
+
+typedef struct {
+  uint32_t magic;
+  gpio_status_controller_t controllers[GPIO_STATUS_CONTROLLERS];
+} gpio_status_page_t;
+
+// Maps the status page at paddr, which must be one of the client's device
+// frames, read-only so that a client can never corrupt what the others read
+static inline kos_status_t gpio_status_map(seL4_Word paddr, const gpio_status_page_t **pp_page) {
+  kos_device_frame_t frame = {.paddr = paddr, .size = KOS_EXP2(seL4_PageBits)};
+  seL4_Word base;
+
+  kos_status_t status = kos_dev_resources_map_device_frame(&frame, kos_cap_rights_read_only(), NULL, &base);
+  if (status == STATUS_OK) {
+    *pp_page = (const gpio_status_page_t *) base;
+  }
+  return status;
+}
+
+// Copies a consistent snapshot of a controller out of the page, returns false
+// if the page was never written by the service
+static inline bool gpio_status_read(const gpio_status_page_t *p_page, unsigned int controller,
+                                    gpio_status_controller_t *p_out) {
+  if (p_page->magic != GPIO_STATUS_MAGIC || controller >= GPIO_STATUS_CONTROLLERS)
+    return false;
+
+  const gpio_status_controller_t *p_entry = &p_page->controllers[controller];
+  uint32_t sequence;
+
+  do {
+    sequence = __atomic_load_n(&p_entry->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1)
+      continue;
+    p_out->state = p_entry->state;
+    p_out->oe = p_entry->oe;
+    p_out->dataout = p_entry->dataout;
+    p_out->datain = p_entry->datain;
+    p_out->updates = p_entry->updates;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((sequence & 1) || sequence != __atomic_load_n(&p_entry->sequence, __ATOMIC_RELAXED));
+
+  p_out->sequence = sequence;
+  return true;
+}
+
+#endif
@@ -0,0 +1,105 @@
+
+
+/**
+ *  @Component:   DMTIMER
+ *
+ *  @Filename:    ../../CredDataBase/dmtimer_cred.h
+ *
+ ============================================================================ */
+/*
+* Copyright (C) 2010 Texas Instruments Incorporated - http://www.ti.com/
+*/
+/*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*    Redistributions of source code must retain the above copyright
+*    notice, this list of conditions and the following disclaimer.
+*
+*    Redistributions in binary form must reproduce the above copyright
+*    notice, this list of conditions and the following disclaimer in the
+*    documentation and/or other materials provided with the
+*    distribution.
+*
+*    Neither the name of Texas Instruments Incorporated nor the names of
+*    its contributors may be used to endorse or promote products derived
+*    from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+*  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+*  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+*  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+*  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+*  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+*  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#ifndef _HW_DMTIMER_H_
+#define _HW_DMTIMER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************\
+ * Register arrangement for DMTIMER
+\***********************************************************************/
+
+#define DMTIMER_TIDR   (0x0)
+#define DMTIMER_TIOCP_CFG   (0x10)
+#define DMTIMER_IRQSTATUS   (0x28)
+#define DMTIMER_IRQENABLE_SET   (0x2C)
+#define DMTIMER_IRQENABLE_CLR   (0x30)
+#define DMTIMER_TCLR   (0x38)
+#define DMTIMER_TCRR   (0x3C)
+#define DMTIMER_TLDR   (0x40)
+#define DMTIMER_TWPS   (0x48)
+
+/**************************************************************************\
+ * Field Definition Macros
+\**************************************************************************/
+
+/* IRQSTATUS */
+#define DMTIMER_IRQSTATUS_OVF_IT_FLAG   (0x00000002u)
+#define DMTIMER_IRQSTATUS_OVF_IT_FLAG_SHIFT   (0x00000001u)
+
+/* IRQENABLE_SET */
+#define DMTIMER_IRQENABLE_SET_OVF_EN_FLAG   (0x00000002u)
+#define DMTIMER_IRQENABLE_SET_OVF_EN_FLAG_SHIFT   (0x00000001u)
+
+/* IRQENABLE_CLR */
+#define DMTIMER_IRQENABLE_CLR_OVF_EN_FLAG   (0x00000002u)
+#define DMTIMER_IRQENABLE_CLR_OVF_EN_FLAG_SHIFT   (0x00000001u)
+
+/* TIOCP_CFG */
+#define DMTIMER_TIOCP_CFG_SOFTRESET   (0x00000001u)
+#define DMTIMER_TIOCP_CFG_SOFTRESET_SHIFT   (0x00000000u)
+
+/* TCLR */
+#define DMTIMER_TCLR_AR   (0x00000002u)
+#define DMTIMER_TCLR_AR_SHIFT   (0x00000001u)
+#define DMTIMER_TCLR_AR_ONESHOT   (0x0u)
+#define DMTIMER_TCLR_AR_AUTO   (0x1u)
+
+#define DMTIMER_TCLR_ST   (0x00000001u)
+#define DMTIMER_TCLR_ST_SHIFT   (0x00000000u)
+#define DMTIMER_TCLR_ST_STOP   (0x0u)
+#define DMTIMER_TCLR_ST_START   (0x1u)
+
+/* TWPS */
+#define DMTIMER_TWPS_W_PEND_TCLR   (0x00000001u)
+#define DMTIMER_TWPS_W_PEND_TCLR_SHIFT   (0x00000000u)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,19 +3,40 @@
 // SPDX-License-Identifier: LicenseRef-Kry10
 
 #include <kos.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "hw_types.h"
+#include "hw_dmtimer.h"
 #include "gpio_v2.h"
+#include "gpio_protocol.h"
+#include "gpio_status.h"
+#include "gpio_one_way.h"
+#ifdef KOS_AM335X_IO
+#include "kos_am335x_io.h"
+#endif
 
 #define VISUALIZE_STARTUP
 
-#define EXPECTED_ARGC 2
+#define MIN_ARGC 2
 #define PROTOCOL_NAME_IDX 1
+#define FIRST_OPTION_IDX 2
+
+#define PRIORITY_PROTOCOL_OPTION "priority_protocol="
+#define ONE_WAY_PROTOCOL_OPTION "one_way_protocol="
+#define CHECKPOINT_FRAME_OPTION "checkpoint_frame="
+#define STATUS_FRAME_OPTION "status_frame="
+// Followed by a comma separated list of flat pins, e.g. "status_inputs=53,60"
+#define STATUS_INPUTS_OPTION "status_inputs="
+// Followed by the controller number, e.g. "gpio1_protocol="
+#define CONTROLLER_PROTOCOL_OPTION_PREFIX "gpio"
+#define CONTROLLER_PROTOCOL_OPTION_SUFFIX "_protocol="
 
 #define GPIO_REQUEST_LABEL (~0)
-#define GPIO_PROTOCOL_BADGE (KOS_CORE_APP_ID_LIMIT)
 
-#define RECEIVE_TOKEN_SLOT 1
-#define TRANSFER_TOKEN_SLOT 2
+// The priority listener runs above the default listener (priority 145 in the
+// manifest), this must not exceed the app's max_priority
+#define PRIORITY_LISTENER_PRIORITY 150
 
 #define AM335X_GPIO0_PADDR 0x44e07000
 #define AM335X_GPIO1_PADDR 0x4804c000
@@ -23,27 +44,142 @@
 #define AM335X_GPIO3_PADDR 0x481ae000
 #define NUM_GPIOS 4
 
+// The GPIOxA interrupt line of each controller
+#define AM335X_GPIO0_IRQ 96
+#define AM335X_GPIO1_IRQ 98
+#define AM335X_GPIO2_IRQ 32
+#define AM335X_GPIO3_IRQ 62
+
+// Timer whose overflow interrupt paces the sampling of software debounced
+// pins, it is clocked from the 24 MHz master oscillator
+#define AM335X_DMTIMER6_PADDR 0x48048000
+#define AM335X_DMTIMER6_IRQ 94
+#define TIMER_TICKS_PER_US 24
+
+// Software debounced pins are sampled this often, their windows are rounded
+// up to a whole number of samples
+#define SW_DEBOUNCE_SAMPLE_US 1000
+#define TIMER_RELOAD (0u - TIMER_TICKS_PER_US * SW_DEBOUNCE_SAMPLE_US)
+
+// The hardware debounce time is a base of 31 us plus 31 us per step
+#define HW_DEBOUNCE_STEP_US 31
+#define HW_DEBOUNCE_MAX_STEPS 255
+
 #define CONFIGURE_PIN_ARGS 2
+// Optionally followed by the level an output starts at
+#define CONFIGURE_PIN_WITH_LEVEL_ARGS 3
 #define SET_DEBOUNCE_ARGS 2
 #define SET_DEBOUNCE_TIMING_ARGS 2
 #define READ_ARGS 1
 #define WRITE_ARGS 2
+#define GET_STATS_ARGS 0
+#define SET_DEBOUNCE_WINDOW_ARGS 2
+#define SET_POWER_MODE_ARGS 2
+#define SET_PIN_WAKEUP_ARGS 2
+#define DUMP_ARGS 0
+
+// The fast requests carry their arguments in the message param instead of the
+// payload, the pin in the low byte and the level above it. A fast read
+// replies with the level in the param. A one-way write is encoded like a fast
+// write. Any other bits set are refused, so a pin that doesn't fit in the low
+// byte can't alias another one.
+#define FAST_ARG_PIN_MASK 0xff
+#define FAST_ARG_VALUE_SHIFT 8
+#define FAST_READ_VALID_BITS FAST_ARG_PIN_MASK
+#define FAST_WRITE_VALID_BITS (FAST_ARG_PIN_MASK | (1 << FAST_ARG_VALUE_SHIFT))
+
+// Each operation of a batch is the label of the request followed by its pin
+// and value, the value is ignored for reads
+#define BATCH_OP_WORDS 3
+#define MAX_BATCH_OPS 64
+
+#define POWER_MODE_ACTIVE 0
+#define POWER_MODE_LOW_POWER 1
+#define GET_STATS_RESULTS 3
+
+// A dump holds the state of a controller followed by its registers, for each
+// of the controllers
+#define DUMP_WORDS_PER_CONTROLLER 9
+#define DUMP_RESULTS (DUMP_WORDS_PER_CONTROLLER * NUM_GPIOS)
+
+#define CONTROLLER_STATE_UNAVAILABLE 0
+#define CONTROLLER_STATE_UNINITIALIZED 1
+#define CONTROLLER_STATE_INITIALIZED 2
 
 #define INPUT_MODE 0
 #define OUTPUT_MODE 1
 
+// Each entry of a configure transaction is a single word describing a pin
+#define TRANSACTION_PIN_MASK 0x7f
+#define TRANSACTION_OUTPUT (1 << 8)
+#define TRANSACTION_HIGH (1 << 9)
+#define TRANSACTION_DEBOUNCE (1 << 10)
+#define TRANSACTION_EDGE_SHIFT 12
+#define TRANSACTION_EDGE_MASK (0x3 << TRANSACTION_EDGE_SHIFT)
+#define TRANSACTION_EDGE_RISING (1 << TRANSACTION_EDGE_SHIFT)
+#define TRANSACTION_EDGE_FALLING (2 << TRANSACTION_EDGE_SHIFT)
+// Every other bit of an entry is reserved
+#define TRANSACTION_VALID_BITS \
+  (TRANSACTION_PIN_MASK | TRANSACTION_OUTPUT | TRANSACTION_HIGH | TRANSACTION_DEBOUNCE | TRANSACTION_EDGE_MASK)
+#define MAX_TRANSACTION_ENTRIES (MAX_PIN + 1)
+
 #define PINS_IN_CONTROLLER 32
 #define MAX_PIN 127
 
+// A build for a particular board is given the pins the board uses, and refuses
+// every other pin and never maps controllers without any of its pins. Reads
+// and writes of its pins are also specialised, see read_pin() and write_pin().
+#ifdef GPIO_BOARD_PIN_MAP
+#include GPIO_BOARD_PIN_MAP
+
+#define BOARD_PIN_BIT(pin, controller) \
+  | ((pin) / PINS_IN_CONTROLLER == (controller) ? 1u << ((pin) % PINS_IN_CONTROLLER) : 0u)
+#define BOARD_PIN_BIT_0(pin) BOARD_PIN_BIT(pin, 0)
+#define BOARD_PIN_BIT_1(pin) BOARD_PIN_BIT(pin, 1)
+#define BOARD_PIN_BIT_2(pin) BOARD_PIN_BIT(pin, 2)
+#define BOARD_PIN_BIT_3(pin) BOARD_PIN_BIT(pin, 3)
+
+#define BOARD_PIN_CHECK(pin) _Static_assert((pin) <= MAX_PIN, "board pin " #pin " is not a GPIO pin");
+GPIO_BOARD_PINS(BOARD_PIN_CHECK)
+
+static const uint32_t board_pin_masks[] = {
+  0u GPIO_BOARD_PINS(BOARD_PIN_BIT_0),
+  0u GPIO_BOARD_PINS(BOARD_PIN_BIT_1),
+  0u GPIO_BOARD_PINS(BOARD_PIN_BIT_2),
+  0u GPIO_BOARD_PINS(BOARD_PIN_BIT_3)
+};
+#else
+static const uint32_t board_pin_masks[] = {~0u, ~0u, ~0u, ~0u};
+#endif
+
+static inline bool board_pin_used(unsigned int flat_pin) {
+  return flat_pin <= MAX_PIN &&
+    (board_pin_masks[flat_pin / PINS_IN_CONTROLLER] & (1u << (flat_pin % PINS_IN_CONTROLLER)));
+}
+
 enum request_label {
   CONFIGURE_PIN_REQUEST = 1,
   SET_DEBOUNCE_REQUEST,
   SET_DEBOUNCE_TIMING_REQUEST,
   READ_REQUEST,
   WRITE_REQUEST,
+  GET_STATS_REQUEST,
+  SET_DEBOUNCE_WINDOW_REQUEST,
+  SET_POWER_MODE_REQUEST,
+  SET_PIN_WAKEUP_REQUEST,
+  CONFIGURE_TRANSACTION_REQUEST,
+  DUMP_REQUEST,
+  BATCH_REQUEST,
+  FAST_READ_REQUEST,
+  FAST_WRITE_REQUEST,
+  ONE_WAY_WRITE_REQUEST,
   NUM_GPIO_REQUESTS
 };
 
+_Static_assert(ONE_WAY_WRITE_REQUEST == GPIO_ONE_WAY_WRITE_REQUEST, "GPIO_ONE_WAY_WRITE_REQUEST is out of date");
+_Static_assert(FAST_ARG_PIN_MASK == GPIO_ONE_WAY_PIN_MASK && FAST_ARG_VALUE_SHIFT == GPIO_ONE_WAY_LEVEL_SHIFT,
+               "the one-way write encoding is out of date");
+
 static kos_device_frame_t gpio_controller_frames[] = {
   {.paddr = AM335X_GPIO0_PADDR, .size = KOS_EXP2(seL4_PageBits)},
   {.paddr = AM335X_GPIO1_PADDR, .size = KOS_EXP2(seL4_PageBits)},
@@ -53,60 +189,495 @@ static kos_device_frame_t gpio_controller_frames[] = {
 
 static seL4_Word gpio_controller_bases[4];
 
-static kos_msg_server_t server;
-static kos_thread_mgr_entry_t root_manager_entry;
-static kos_thread_mgr_t root_thread_mgr;
-static kos_thread_t listener_thread;
+// Controllers are only mapped if they were given to us, and are only reset the
+// first time a request touches them so that pins configured before we started
+// are left alone until then
+static bool gpio_controller_mapped[NUM_GPIOS];
+static volatile bool gpio_controller_initialized[NUM_GPIOS];
+
+static kos_device_irq_t gpio_controller_irqs[] = {
+  {.irq = AM335X_GPIO0_IRQ},
+  {.irq = AM335X_GPIO1_IRQ},
+  {.irq = AM335X_GPIO2_IRQ},
+  {.irq = AM335X_GPIO3_IRQ}
+};
+
+static kos_irq_t gpio_irqs[NUM_GPIOS];
+static bool gpio_irq_available[NUM_GPIOS];
+
+static kos_device_frame_t timer_frame = {.paddr = AM335X_DMTIMER6_PADDR, .size = KOS_EXP2(seL4_PageBits)};
+static seL4_Word timer_base;
+
+static kos_device_irq_t timer_device_irq = {.irq = AM335X_DMTIMER6_IRQ};
+static kos_irq_t timer_irq;
+static bool timer_irq_available;
+static kos_thread_t timer_thread;
+
+// Per-pin debounce state of a controller. Pins whose windows all agree and fit
+// in the hardware debounce time are debounced by the controller. Otherwise the
+// timer thread samples the pins and reads report the last level that was
+// sampled for a full window. Only the timer thread counts samples, so the
+// stable levels never depend on when the pins are read.
+typedef struct {
+  // Debounce window of each pin in microseconds, 0 if not debounced
+  uint32_t window_us[PINS_IN_CONTROLLER];
+  // Samples a level must be held for after it changed to become stable
+  volatile uint32_t window_samples[PINS_IN_CONTROLLER];
+  // Level of each pin at the last sample and the samples since it changed,
+  // only touched by the timer thread
+  uint8_t sampled_level[PINS_IN_CONTROLLER];
+  uint32_t held_samples[PINS_IN_CONTROLLER];
+  // Last level of each pin that was held for a full window
+  volatile uint8_t stable_level[PINS_IN_CONTROLLER];
+  // Pins debounced in hardware and in software respectively
+  uint32_t hw_mask;
+  volatile uint32_t sw_mask;
+  // Software debounced pins whose sampling starts over at the next sample
+  volatile uint32_t restart_mask;
+} gpio_debounce_t;
+
+static gpio_debounce_t debounce[NUM_GPIOS];
+
+// Pins of each controller that may wake the system up while it idles
+static uint32_t wakeup_masks[NUM_GPIOS];
+
+// Checkpoint of a controller that outlives the service, so that a restarted
+// service can adopt the controller as it was instead of resetting it
+typedef struct {
+  // 0 if the controller was never initialised, odd while being written
+  volatile uint32_t sequence;
+  GPIOCONTEXT context;
+  // Idle mode, auto idle and wakeup enable set by the power mode
+  uint32_t sysconfig;
+  uint32_t rising_detect;
+  uint32_t falling_detect;
+  uint32_t debounce_enable;
+  uint32_t debounce_time;
+  uint32_t window_us[PINS_IN_CONTROLLER];
+  uint32_t hw_mask;
+  uint32_t sw_mask;
+  uint32_t wakeup_mask;
+} gpio_controller_checkpoint_t;
+
+// Changes whenever the layout of the checkpoint does
+#define CHECKPOINT_MAGIC 0x47504932
+
+typedef struct {
+  uint32_t magic;
+  gpio_controller_checkpoint_t controllers[NUM_GPIOS];
+} gpio_checkpoint_t;
+
+// The checkpoint lives in a frame of memory given to us with the
+// checkpoint_frame option, such as a page of on-chip RAM
+static kos_device_frame_t checkpoint_frame = {.size = KOS_EXP2(seL4_PageBits)};
+static gpio_checkpoint_t *p_checkpoint;
+
+// The status page lives in a frame given to us with the status_frame option,
+// that the manifest also gives to the clients that read it directly
+static kos_device_frame_t status_frame = {.size = KOS_EXP2(seL4_PageBits)};
+static gpio_status_page_t *p_status;
+// Input pins of each controller whose edges update the status page, the page
+// is otherwise only updated by requests that change the controller
+static uint32_t status_input_masks[NUM_GPIOS];
+
+enum listener_id {
+  DEFAULT_LISTENER = 0,
+  PRIORITY_LISTENER,
+  // One listener per GPIO controller follows
+  FIRST_CONTROLLER_LISTENER,
+  ONE_WAY_LISTENER = FIRST_CONTROLLER_LISTENER + NUM_GPIOS,
+  NUM_LISTENERS
+};
 
-static char* protocol_name;
+#define CONTROLLER_LISTENER(controller) (FIRST_CONTROLLER_LISTENER + (controller))
+
+// The combined I/O service hands out the badges and token slots past ours
+_Static_assert(NUM_LISTENERS == GPIO_NUM_LISTENERS, "GPIO_NUM_LISTENERS is out of date");
+
+// Listeners that are not dedicated to one controller
+#define ANY_CONTROLLER (-1)
+
+typedef struct {
+  uint32_t requests;
+  uint32_t errors;
+} gpio_listener_stats_t;
+
+typedef struct {
+  char* protocol_name;
+  seL4_Word badge;
+  // Only serve requests that take a bounded amount of time
+  bool bounded_only;
+  // Never reply, only serve the registration and one-way writes
+  bool one_way;
+  // The controller this listener is dedicated to, or ANY_CONTROLLER
+  int controller;
+  kos_msg_server_t server;
+  kos_thread_t thread;
+  // ID of the only client that can be registered with this listener
+  seL4_Word client_id;
+  gpio_listener_stats_t stats;
+} gpio_listener_t;
+
+static gpio_listener_t listeners[NUM_LISTENERS] = {
+  [DEFAULT_LISTENER] = {.badge = GPIO_PROTOCOL_BADGE, .bounded_only = false, .controller = ANY_CONTROLLER},
+  [PRIORITY_LISTENER] = {.badge = GPIO_PRIORITY_PROTOCOL_BADGE, .bounded_only = true, .controller = ANY_CONTROLLER},
+  [CONTROLLER_LISTENER(0)] = {.badge = GPIO_CONTROLLER_PROTOCOL_BADGE(0), .bounded_only = false, .controller = 0},
+  [CONTROLLER_LISTENER(1)] = {.badge = GPIO_CONTROLLER_PROTOCOL_BADGE(1), .bounded_only = false, .controller = 1},
+  [CONTROLLER_LISTENER(2)] = {.badge = GPIO_CONTROLLER_PROTOCOL_BADGE(2), .bounded_only = false, .controller = 2},
+  [CONTROLLER_LISTENER(3)] = {.badge = GPIO_CONTROLLER_PROTOCOL_BADGE(3), .bounded_only = false, .controller = 3},
+  [ONE_WAY_LISTENER] = {.badge = GPIO_ONE_WAY_PROTOCOL_BADGE, .bounded_only = true, .one_way = true, .controller = ANY_CONTROLLER}
+};
+
+// The listeners plus an interrupt thread per controller and the timer thread
+#define NUM_THREADS (NUM_LISTENERS + NUM_GPIOS + 1)
 
-// ID of the only client that can be registered with us
-// TODO: Multi-client support
-seL4_Word client_id;
+_Static_assert(NUM_GPIOS == GPIO_NUM_CONTROLLERS, "GPIO_NUM_CONTROLLERS is out of date");
+_Static_assert(NUM_THREADS == GPIO_NUM_THREADS, "GPIO_NUM_THREADS is out of date");
+
+#ifndef KOS_AM335X_IO
+static kos_thread_mgr_entry_t root_manager_entries[NUM_THREADS];
+static kos_thread_mgr_t root_thread_mgr;
+#endif
+// Our own thread manager, or the one of the combined I/O service
+static kos_thread_mgr_t *p_thread_mgr;
+static kos_thread_t irq_threads[NUM_GPIOS];
 
 // Pin's given to us by the Elixir front-end are a flat number from 0 to 127.
 // Each controller (there are four) controls 32 pins.
-static inline unsigned int flat_pin_to_controller_pin(unsigned int flat_pin, unsigned int *controller, unsigned int *pin) {
+static inline void flat_pin_to_controller_pin(unsigned int flat_pin, unsigned int *controller, unsigned int *pin) {
   *controller = flat_pin / PINS_IN_CONTROLLER;
   *pin = flat_pin % PINS_IN_CONTROLLER;
 }
 
-static kos_msg_t handle_request(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id) {
-  if (badge != GPIO_PROTOCOL_BADGE)
+// A controller that has its own listener is only served by that listener, and
+// by the priority listener whose requests are single atomic register accesses.
+// This keeps the read-modify-write sequences on a controller on one thread.
+static bool listener_serves_controller(gpio_listener_t *p_listener, unsigned int controller) {
+  if (p_listener->bounded_only)
+    return true;
+  if (p_listener->controller != ANY_CONTROLLER)
+    return p_listener->controller == (int) controller;
+  return listeners[CONTROLLER_LISTENER(controller)].protocol_name == NULL;
+}
+
+static void init_gpio_modules(seL4_Word base_addr);
+
+// Entries of the status page and of the checkpoint are written by the
+// listeners and interrupt threads, at different priorities on a single core,
+// so a thread never waits for the one writing an entry. Taking the sequence
+// from even to odd makes a thread the writer. A thread that finds it odd
+// leaves its write pending instead, and the writer writes the entry again
+// before it lets go, so the entry always ends up with the latest state.
+static inline void entry_write_request(volatile uint32_t *p_pending) {
+  __atomic_store_n(p_pending, 1, __ATOMIC_SEQ_CST);
+}
+
+// Returns true with the sequence taken in *p_sequence while there is a write
+// pending that this thread should do
+static bool entry_write_begin(volatile uint32_t *p_sequence, volatile uint32_t *p_pending, uint32_t *p_taken) {
+  while (__atomic_load_n(p_pending, __ATOMIC_SEQ_CST)) {
+    uint32_t sequence = __atomic_load_n(p_sequence, __ATOMIC_SEQ_CST);
+    if (sequence & 1)
+      return false;
+    if (__atomic_compare_exchange_n(p_sequence, &sequence, sequence + 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      __atomic_store_n(p_pending, 0, __ATOMIC_SEQ_CST);
+      *p_taken = sequence;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline void entry_write_end(volatile uint32_t *p_sequence, uint32_t taken) {
+  __atomic_store_n(p_sequence, taken + 2, __ATOMIC_SEQ_CST);
+}
+
+static volatile uint32_t status_pending[NUM_GPIOS];
+static volatile uint32_t checkpoint_pending[NUM_GPIOS];
+
+static void publish_status(unsigned int controller) {
+  if (p_status == NULL)
+    return;
+
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  gpio_status_controller_t *p_entry = &p_status->controllers[controller];
+  uint32_t sequence;
+
+  entry_write_request(&status_pending[controller]);
+
+  while (entry_write_begin(&p_entry->sequence, &status_pending[controller], &sequence)) {
+    if (!gpio_controller_mapped[controller]) {
+      p_entry->state = GPIO_STATUS_UNAVAILABLE;
+    } else {
+      p_entry->state = gpio_controller_initialized[controller] ? GPIO_STATUS_INITIALIZED
+                                                               : GPIO_STATUS_UNINITIALIZED;
+      p_entry->oe = HWREG(controller_base + GPIO_OE);
+      p_entry->dataout = HWREG(controller_base + GPIO_DATAOUT);
+      p_entry->datain = HWREG(controller_base + GPIO_DATAIN);
+    }
+    p_entry->updates++;
+
+    entry_write_end(&p_entry->sequence, sequence);
+  }
+}
+
+// The status page follows every change that is checkpointed. The whole entry
+// is saved each time, so that whichever thread writes it last leaves the
+// complete state of the controller behind.
+static void checkpoint_controller(unsigned int controller) {
+  publish_status(controller);
+
+  if (p_checkpoint == NULL)
+    return;
+
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  gpio_controller_checkpoint_t *p_entry = &p_checkpoint->controllers[controller];
+  gpio_debounce_t *p_debounce = &debounce[controller];
+  uint32_t sequence;
+
+  entry_write_request(&checkpoint_pending[controller]);
+
+  while (entry_write_begin(&p_entry->sequence, &checkpoint_pending[controller], &sequence)) {
+    gpioContextSave(controller_base, &p_entry->context);
+    p_entry->sysconfig = HWREG(controller_base + GPIO_SYSCONFIG);
+    p_entry->rising_detect = HWREG(controller_base + GPIO_RISINGDETECT);
+    p_entry->falling_detect = HWREG(controller_base + GPIO_FALLINGDETECT);
+    p_entry->debounce_enable = HWREG(controller_base + GPIO_DEBOUNCENABLE);
+    p_entry->debounce_time = HWREG(controller_base + GPIO_DEBOUNCINGTIME);
+    memcpy(p_entry->window_us, p_debounce->window_us, sizeof(p_entry->window_us));
+    p_entry->hw_mask = p_debounce->hw_mask;
+    p_entry->sw_mask = p_debounce->sw_mask;
+    p_entry->wakeup_mask = wakeup_masks[controller];
+
+    entry_write_end(&p_entry->sequence, sequence);
+  }
+}
+
+// Detects both edges of the status inputs so the interrupt thread updates the
+// status page as they change
+static void arm_status_inputs(unsigned int controller) {
+  if (p_status == NULL || !gpio_irq_available[controller])
+    return;
+
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+
+  for (unsigned int pin = 0; pin < PINS_IN_CONTROLLER; pin++) {
+    if (status_input_masks[controller] & (1 << pin)) {
+      GPIOIntTypeSet(controller_base, pin, GPIO_INT_TYPE_BOTH_EDGE);
+      GPIOPinIntEnable(controller_base, GPIO_INT_LINE_1, pin);
+    }
+  }
+}
+
+static void initialize_controller(unsigned int controller) {
+  init_gpio_modules(gpio_controller_bases[controller]);
+  gpio_controller_initialized[controller] = true;
+  arm_status_inputs(controller);
+  checkpoint_controller(controller);
+}
+
+// Initializes the controller on first use. Only the listener serving the
+// controller does this, the priority listener could preempt it half way. A
+// service with a priority or one-way listener initializes every controller
+// before it starts, so neither ever finds one uninitialized.
+static bool ensure_controller_initialized(gpio_listener_t *p_listener, unsigned int controller) {
+  if (!gpio_controller_mapped[controller])
+    return false;
+  if (gpio_controller_initialized[controller])
+    return true;
+  if (p_listener->bounded_only)
+    return false;
+
+  initialize_controller(controller);
+
+  return true;
+}
+
+static uint32_t debounced_level(unsigned int controller, unsigned int pin) {
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  gpio_debounce_t *p_debounce = &debounce[controller];
+
+  // A pin that hasn't been sampled since its window changed has no stable
+  // level yet
+  if (__atomic_load_n(&p_debounce->restart_mask, __ATOMIC_ACQUIRE) & (1 << pin))
+    return !!(GPIOPinRead(controller_base, pin));
+
+  return p_debounce->stable_level[pin];
+}
+
+// Called by the timer thread on each sample. A level becomes stable once it
+// was sampled at both ends of a whole window without changing in between.
+static void sample_debounced_pins(unsigned int controller) {
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  gpio_debounce_t *p_debounce = &debounce[controller];
+
+  uint32_t sw_mask = __atomic_load_n(&p_debounce->sw_mask, __ATOMIC_ACQUIRE);
+  if (sw_mask == 0)
+    return;
+
+  uint32_t restart = __atomic_load_n(&p_debounce->restart_mask, __ATOMIC_ACQUIRE);
+  uint32_t levels = HWREG(controller_base + GPIO_DATAIN);
+
+  for (unsigned int pin = 0; pin < PINS_IN_CONTROLLER; pin++) {
+    uint32_t bit = 1 << pin;
+    if (!(sw_mask & bit))
+      continue;
+
+    uint8_t level = !!(levels & bit);
+    if (restart & bit) {
+      p_debounce->stable_level[pin] = level;
+      p_debounce->sampled_level[pin] = level;
+      p_debounce->held_samples[pin] = 0;
+    } else if (level != p_debounce->sampled_level[pin]) {
+      p_debounce->sampled_level[pin] = level;
+      p_debounce->held_samples[pin] = 0;
+    } else if (p_debounce->held_samples[pin] < p_debounce->window_samples[pin]) {
+      p_debounce->held_samples[pin]++;
+    }
+
+    if (p_debounce->held_samples[pin] >= p_debounce->window_samples[pin]) {
+      p_debounce->stable_level[pin] = level;
+    }
+  }
+
+  __atomic_and_fetch(&p_debounce->restart_mask, ~restart, __ATOMIC_RELEASE);
+}
+
+// The timer only interrupts while a pin is debounced in software. The
+// listeners turn it on after adding pins, and the timer thread turns it off
+// once there are none left. It looks again after turning it off, so a pin
+// added meanwhile isn't left without samples.
+static void start_debounce_sampling(void) {
+  HWREG((unsigned int) timer_base + DMTIMER_IRQENABLE_SET) = DMTIMER_IRQENABLE_SET_OVF_EN_FLAG;
+}
+
+static void stop_idle_debounce_sampling(void) {
+  for (int i = 0; i < NUM_GPIOS; i++) {
+    if (__atomic_load_n(&debounce[i].sw_mask, __ATOMIC_SEQ_CST) != 0)
+      return;
+  }
+
+  HWREG((unsigned int) timer_base + DMTIMER_IRQENABLE_CLR) = DMTIMER_IRQENABLE_CLR_OVF_EN_FLAG;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  for (int i = 0; i < NUM_GPIOS; i++) {
+    if (__atomic_load_n(&debounce[i].sw_mask, __ATOMIC_SEQ_CST) != 0) {
+      start_debounce_sampling();
+      return;
+    }
+  }
+}
+
+static kos_status_t configure_debounce(unsigned int controller) {
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  gpio_debounce_t *p_debounce = &debounce[controller];
+
+  uint32_t mask = 0;
+  uint32_t common_window_us = 0;
+  bool windows_agree = true;
+
+  for (unsigned int pin = 0; pin < PINS_IN_CONTROLLER; pin++) {
+    uint32_t window_us = p_debounce->window_us[pin];
+    if (window_us == 0)
+      continue;
+
+    mask |= 1 << pin;
+    if (common_window_us == 0) {
+      common_window_us = window_us;
+    } else if (window_us != common_window_us) {
+      windows_agree = false;
+    }
+  }
+
+  // Round the window up to the next hardware step
+  uint32_t steps = (common_window_us + HW_DEBOUNCE_STEP_US - 1) / HW_DEBOUNCE_STEP_US;
+  steps = steps > 0 ? steps - 1 : 0;
+  bool use_hw = windows_agree && steps <= HW_DEBOUNCE_MAX_STEPS;
+
+  if (!use_hw && !timer_irq_available)
+    return STATUS_NOT_IMPLEMENTED;
+
+  // Stop debouncing everything before switching over
+  for (unsigned int pin = 0; pin < PINS_IN_CONTROLLER; pin++) {
+    if (p_debounce->hw_mask & (1 << pin)) {
+      GPIODebounceFuncControl(controller_base, pin, GPIO_DEBOUNCE_FUNC_DISABLE);
+    }
+  }
+  p_debounce->hw_mask = 0;
+  __atomic_store_n(&p_debounce->sw_mask, 0, __ATOMIC_SEQ_CST);
+
+  if (mask == 0)
+    return STATUS_OK;
+
+  if (use_hw) {
+    GPIODebounceTimeConfig(controller_base, steps);
+    for (unsigned int pin = 0; pin < PINS_IN_CONTROLLER; pin++) {
+      if (mask & (1 << pin)) {
+        GPIODebounceFuncControl(controller_base, pin, GPIO_DEBOUNCE_FUNC_ENABLE);
+      }
+    }
+    p_debounce->hw_mask = mask;
+  } else {
+    for (unsigned int pin = 0; pin < PINS_IN_CONTROLLER; pin++) {
+      if (mask & (1 << pin)) {
+        p_debounce->window_samples[pin] =
+          (p_debounce->window_us[pin] + SW_DEBOUNCE_SAMPLE_US - 1) / SW_DEBOUNCE_SAMPLE_US;
+      }
+    }
+    __atomic_or_fetch(&p_debounce->restart_mask, mask, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&p_debounce->sw_mask, mask, __ATOMIC_SEQ_CST);
+    start_debounce_sampling();
+  }
+
+  return STATUS_OK;
+}
+
+static kos_msg_t handle_request(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  (void) msg;
+
+  if (badge != p_listener->badge)
     return kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
   if (caller_id == 0)
     return kos_msg_new_status(STATUS_BAD_REQUEST);
-  if (client_id != 0 && client_id != caller_id)
-    // Don't support more than one client
+  if (p_listener->client_id != 0 && p_listener->client_id != caller_id)
+    // Don't support more than one client per listener
     return kos_msg_new_status(STATUS_FULL);
 
+  seL4_Word transfer_token_slot = GPIO_TRANSFER_TOKEN_SLOT(p_listener - listeners);
+
   // Create the token that we send to the client
   kos_assert_created(
     kos_msg_token_create(
-      GPIO_PROTOCOL_BADGE, // IN seL4_Word badge,
+      p_listener->badge, // IN seL4_Word badge,
       KOS_MSG_FLAG_SEND_PAYLOAD, // IN uint8_t flags,
-      TRANSFER_TOKEN_SLOT
+      transfer_token_slot
     ),
     "create gpio token to give"
   );
 
-  client_id = caller_id;
+  p_listener->client_id = caller_id;
 
-  return kos_msg_new(STATUS_OK, 0, 0, TRANSFER_TOKEN_SLOT, 0);
+  return kos_msg_new(STATUS_OK, 0, 0, transfer_token_slot, 0);
 }
 
-static kos_msg_t handle_configure_pin(kos_msg_t msg, seL4_Word caller_id) {
-  if (caller_id != client_id)
+static kos_msg_t handle_configure_pin(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
     return kos_msg_new_status(STATUS_UNAUTHORIZED);
-  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * CONFIGURE_PIN_ARGS)
+
+  seL4_Word payload_size = kos_msg_payload_size(msg.metadata);
+  if (payload_size != sizeof(uint32_t) * CONFIGURE_PIN_ARGS &&
+      payload_size != sizeof(uint32_t) * CONFIGURE_PIN_WITH_LEVEL_ARGS)
     return kos_msg_new_status(STATUS_BAD_REQUEST);
 
   uint32_t *transport = kos_msg_server_payload();
 
   uint32_t pin = transport[0];
   uint32_t mode = transport[1];
+  bool has_level = payload_size == sizeof(uint32_t) * CONFIGURE_PIN_WITH_LEVEL_ARGS;
+  uint32_t level = has_level ? transport[2] : 0;
 
-  if (pin > MAX_PIN) {
+  if (!board_pin_used(pin)) {
     return kos_msg_new_status(STATUS_BAD_REQUEST);
   }
 
@@ -114,19 +685,30 @@ static kos_msg_t handle_configure_pin(kos_msg_t msg, seL4_Word caller_id) {
 
   flat_pin_to_controller_pin(pin, &controller, &pin);
 
+  if (!listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
   unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
 
   if (mode == OUTPUT_MODE) {
+    // Latch the level before the output is enabled, otherwise the pin drives
+    // whatever level was left in DATAOUT until the next write
+    if (has_level) {
+      GPIOPinWrite(controller_base, pin, level ? GPIO_PIN_HIGH : GPIO_PIN_LOW);
+    }
     GPIODirModeSet(controller_base, pin, GPIO_DIR_OUTPUT);
   } else {
     GPIODirModeSet(controller_base, pin, GPIO_DIR_INPUT);
   }
 
+  checkpoint_controller(controller);
+
   return kos_msg_new_status(STATUS_OK);
 }
 
-static kos_msg_t handle_set_debounce(kos_msg_t msg, seL4_Word caller_id) {
-  if (caller_id != client_id)
+static kos_msg_t handle_set_debounce(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
     return kos_msg_new_status(STATUS_UNAUTHORIZED);
   if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_DEBOUNCE_ARGS)
     return kos_msg_new_status(STATUS_BAD_REQUEST);
@@ -134,9 +716,9 @@ static kos_msg_t handle_set_debounce(kos_msg_t msg, seL4_Word caller_id) {
   uint32_t *transport = kos_msg_server_payload();
 
   uint32_t pin = transport[0];
-  uint32_t debounce = transport[1];
+  uint32_t enable = transport[1];
 
-  if (pin > MAX_PIN) {
+  if (!board_pin_used(pin)) {
     return kos_msg_new_status(STATUS_BAD_REQUEST);
   }
 
@@ -144,19 +726,30 @@ static kos_msg_t handle_set_debounce(kos_msg_t msg, seL4_Word caller_id) {
 
   flat_pin_to_controller_pin(pin, &controller, &pin);
 
+  if (!listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  // Pins with a debounce window are left to configure_debounce()
+  if (debounce[controller].window_us[pin] != 0) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
   unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
 
-  if (debounce) {
+  if (enable) {
     GPIODebounceFuncControl(controller_base, pin, GPIO_DEBOUNCE_FUNC_ENABLE);
   } else {
     GPIODebounceFuncControl(controller_base, pin, GPIO_DEBOUNCE_FUNC_DISABLE);
   }
 
+  checkpoint_controller(controller);
+
   return kos_msg_new_status(STATUS_OK);
 }
 
-static kos_msg_t handle_set_debounce_timing(kos_msg_t msg, seL4_Word caller_id) {
-  if (caller_id != client_id)
+static kos_msg_t handle_set_debounce_timing(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
     return kos_msg_new_status(STATUS_UNAUTHORIZED);
   if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_DEBOUNCE_TIMING_ARGS)
     return kos_msg_new_status(STATUS_BAD_REQUEST);
@@ -166,7 +759,7 @@ static kos_msg_t handle_set_debounce_timing(kos_msg_t msg, seL4_Word caller_id)
   uint32_t pin = transport[0];
   uint32_t debounce_time = transport[1];
 
-  if (pin > MAX_PIN) {
+  if (!board_pin_used(pin)) {
     return kos_msg_new_status(STATUS_BAD_REQUEST);
   }
 
@@ -174,236 +767,1160 @@ static kos_msg_t handle_set_debounce_timing(kos_msg_t msg, seL4_Word caller_id)
 
   flat_pin_to_controller_pin(pin, &controller, &pin);
 
+  if (!listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  // The timing is shared by the whole controller, and is the one that
+  // configure_debounce() set while it debounces windows in hardware
+  if (debounce[controller].hw_mask != 0) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
   unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
 
   GPIODebounceTimeConfig(controller_base, debounce_time);
 
+  checkpoint_controller(controller);
+
   return kos_msg_new_status(STATUS_OK);
 }
 
-static kos_msg_t handle_read(kos_msg_t msg, seL4_Word caller_id) {
-  if (caller_id != client_id)
-    return kos_msg_new_status(STATUS_UNAUTHORIZED);
-  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * READ_ARGS)
-    return kos_msg_new_status(STATUS_BAD_REQUEST);
+// Read or write a pin once it is known, these are inlined so that the board
+// build below folds the controller and the bit of each of its pins into
+// constants
+static inline __attribute__((always_inline))
+bool read_controller_pin(gpio_listener_t *p_listener, unsigned int controller, unsigned int pin, uint32_t *p_level) {
+  if (!listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return false;
+  }
 
-  uint32_t *transport = kos_msg_server_payload();
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
 
-  uint32_t pin = transport[0];
+  if (debounce[controller].sw_mask & (1u << pin)) {
+    *p_level = debounced_level(controller, pin);
+  } else {
+    *p_level = !!(HWREG(controller_base + GPIO_DATAIN) & (1u << pin));
+  }
 
-  if (pin > MAX_PIN) {
-    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  return true;
+}
+
+static inline __attribute__((always_inline))
+bool write_controller_pin(gpio_listener_t *p_listener, unsigned int controller, unsigned int pin, uint32_t level) {
+  if (!listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return false;
+  }
+
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+
+  // As GPIOPinWrite(), only GPIO_PIN_HIGH sets the pin
+  HWREG(controller_base + (level == GPIO_PIN_HIGH ? GPIO_SETDATAOUT : GPIO_CLEARDATAOUT)) = 1u << pin;
+
+  checkpoint_controller(controller);
+
+  return true;
+}
+
+#ifdef GPIO_BOARD_PIN_MAP
+// Each pin of the board gets its own case, so the read or write of a pin is a
+// load or store at a constant offset and bit, and any other pin is refused
+#define BOARD_READ_CASE(flat_pin) \
+  case (flat_pin): \
+    return read_controller_pin(p_listener, (flat_pin) / PINS_IN_CONTROLLER, (flat_pin) % PINS_IN_CONTROLLER, p_level);
+#define BOARD_WRITE_CASE(flat_pin) \
+  case (flat_pin): \
+    return write_controller_pin(p_listener, (flat_pin) / PINS_IN_CONTROLLER, (flat_pin) % PINS_IN_CONTROLLER, level);
+
+// Shared by the payload and the fast read requests, returns false if the pin
+// can't be read by this listener
+static bool read_pin(gpio_listener_t *p_listener, uint32_t pin, uint32_t *p_level) {
+  switch (pin) {
+    GPIO_BOARD_PINS(BOARD_READ_CASE)
+    default:
+      return false;
+  }
+}
+
+// Shared by the payload and the fast write requests, returns false if the pin
+// can't be written by this listener
+static bool write_pin(gpio_listener_t *p_listener, uint32_t pin, uint32_t level) {
+  switch (pin) {
+    GPIO_BOARD_PINS(BOARD_WRITE_CASE)
+    default:
+      return false;
+  }
+}
+#else
+// Shared by the payload and the fast read requests, returns false if the pin
+// can't be read by this listener
+static bool read_pin(gpio_listener_t *p_listener, uint32_t pin, uint32_t *p_level) {
+  if (!board_pin_used(pin)) {
+    return false;
   }
 
   unsigned int controller = 0;
 
   flat_pin_to_controller_pin(pin, &controller, &pin);
 
-  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  return read_controller_pin(p_listener, controller, pin, p_level);
+}
+
+// Shared by the payload and the fast write requests, returns false if the pin
+// can't be written by this listener
+static bool write_pin(gpio_listener_t *p_listener, uint32_t pin, uint32_t level) {
+  if (!board_pin_used(pin)) {
+    return false;
+  }
+
+  unsigned int controller = 0;
+
+  flat_pin_to_controller_pin(pin, &controller, &pin);
 
-  uint32_t level = !!(GPIOPinRead(controller_base, pin));
+  return write_controller_pin(p_listener, controller, pin, level);
+}
+#endif
+
+static kos_msg_t handle_read(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * READ_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t level;
+  if (!read_pin(p_listener, transport[0], &level)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
 
   transport[0] = level;
 
   return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t), 0, 0);
 }
 
-static kos_msg_t handle_write(kos_msg_t msg, seL4_Word caller_id) {
-  if (caller_id != client_id)
+static kos_msg_t handle_write(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
     return kos_msg_new_status(STATUS_UNAUTHORIZED);
   if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * WRITE_ARGS)
     return kos_msg_new_status(STATUS_BAD_REQUEST);
 
   uint32_t *transport = kos_msg_server_payload();
 
-  uint32_t pin = transport[0];
-  uint32_t level = transport[1];
+  if (!write_pin(p_listener, transport[0], transport[1])) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+// The fast requests never touch the payload buffer, the whole request and
+// reply fit in the message registers
+static kos_msg_t handle_fast_read(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != 0 || (msg.param & ~FAST_READ_VALID_BITS) != 0)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
 
-  if (pin > MAX_PIN) {
+  uint32_t level;
+  if (!read_pin(p_listener, msg.param & FAST_ARG_PIN_MASK, &level)) {
     return kos_msg_new_status(STATUS_BAD_REQUEST);
   }
 
-  unsigned int controller = 0;
+  return kos_msg_new(STATUS_OK, level, 0, 0, 0);
+}
 
-  flat_pin_to_controller_pin(pin, &controller, &pin);
+static kos_msg_t handle_fast_write(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != 0 || (msg.param & ~FAST_WRITE_VALID_BITS) != 0)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
 
-  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  uint32_t pin = msg.param & FAST_ARG_PIN_MASK;
+  uint32_t level = msg.param >> FAST_ARG_VALUE_SHIFT;
 
-  GPIOPinWrite(controller_base, pin, level);
+  if (!write_pin(p_listener, pin, level)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
 
   return kos_msg_new_status(STATUS_OK);
 }
 
-static void listen_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word garbage) {
-  // Publish the KOS am335x GPIO protocol
-  kos_assert_ok(
-    kos_dir_publish_str(
-      protocol_name,
-      GPIO_REQUEST_LABEL,
-      GPIO_PROTOCOL_BADGE,
-      KOS_MSG_FLAG_SEND_PAYLOAD
-    ),
-    "failed to publish AM335X GPIO protocol"
-  );
+static kos_msg_t handle_get_stats(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * GET_STATS_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
 
-  // Signal that we are done initializing
-  kos_app_ready();
+  uint32_t *transport = kos_msg_server_payload();
 
-  // Prepare to receive caps
-  kos_cap_t receive_cap = kos_cnode_cap(p_env->p_cnode, KOS_THREAD_SLOT_RECEIVE);
-  kos_cap_set_receive(receive_cap);
+  transport[0] = p_listener->stats.requests;
+  transport[1] = p_listener->stats.errors;
+  // Nothing is replied to a one-way write, so the client of the one-way
+  // listener reads its failures back here
+  gpio_listener_t *p_one_way = &listeners[ONE_WAY_LISTENER];
+  transport[2] = (p_one_way->client_id != 0 && caller_id == p_one_way->client_id) ? p_one_way->stats.errors : 0;
 
-  // Prepare the reply cap
-  kos_cap_t reply_cap = kos_cnode_cap(p_env->p_cnode, KOS_THREAD_SLOT_REPLY);
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * GET_STATS_RESULTS, 0, 0);
+}
 
-  // A slot to hold the transport
-  kos_cap_t server_cap = kos_cap_reserve();
+static kos_msg_t handle_set_debounce_window(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_DEBOUNCE_WINDOW_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
 
-  // Set up the server transport
-  kos_assert_created(
-    kos_msg_server_create(
-      server_cap,
-      reply_cap, // IN kos_cap_t reply_cap,
-      RECEIVE_TOKEN_SLOT, // IN kos_token_t receive_token_slot,
-      &server // OUT kos_msg_server_t* p_server
-    ),
-    NULL
-  );
+  uint32_t *transport = kos_msg_server_payload();
 
-  // No longer need to receive caps.
-  kos_cap_clear_receive();
+  uint32_t pin = transport[0];
+  uint32_t window_us = transport[1];
 
-  // Initial status is OK
-  kos_msg_t msg = kos_msg_new_status(STATUS_OK);
+  if (!board_pin_used(pin)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
 
-  while (true) {
-    seL4_Word badge;
-    seL4_Word seL4_badge;
-    seL4_Word caller_id;
+  unsigned int controller = 0;
 
-    seL4_SetMR(0, msg.label);
-    seL4_SetMR(1, msg.param);
-    seL4_SetMR(2, msg.metadata);
-    seL4_MessageInfo_t sel4_msg = seL4_ReplyRecv(
-      server.transport.ep_cptr,
-      seL4_MessageInfo_new(STATUS_OK, 0, 0, 3),
-      &seL4_badge,
-      server.reply_cptr);
+  flat_pin_to_controller_pin(pin, &controller, &pin);
 
-    // fill out the message struct
-    msg.label = seL4_GetMR(0);
-    msg.param = seL4_GetMR(1);
-    msg.metadata = seL4_GetMR(2);
-    badge = seL4_GetMR(3);
+  if (!listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
 
-    caller_id = seL4_MessageInfo_get_label(sel4_msg);
+  gpio_debounce_t *p_debounce = &debounce[controller];
+  uint32_t prev_window_us = p_debounce->window_us[pin];
 
-    // Check the protocol via the badge first
-    if (badge != GPIO_PROTOCOL_BADGE) {
-      msg = kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
-      continue;
-    }
+  p_debounce->window_us[pin] = window_us;
 
-    // Act on the label
-    switch (msg.label) {
-      case GPIO_REQUEST_LABEL:
-        msg = handle_request(msg, badge, caller_id);
-        break;
-      case CONFIGURE_PIN_REQUEST:
-        msg = handle_configure_pin(msg, caller_id);
-        break;
-      case SET_DEBOUNCE_REQUEST:
-        msg = handle_set_debounce(msg, caller_id);
-        break;
-      case SET_DEBOUNCE_TIMING_REQUEST:
-        msg = handle_set_debounce_timing(msg, caller_id);
-        break;
-      case READ_REQUEST:
-        msg = handle_read(msg, caller_id);
-        break;
+  kos_status_t status = configure_debounce(controller);
+  if (status != STATUS_OK) {
+    // Nothing was changed, put the previous window back
+    p_debounce->window_us[pin] = prev_window_us;
+  } else {
+    checkpoint_controller(controller);
+  }
+
+  return kos_msg_new_status(status);
+}
+
+static kos_msg_t handle_set_power_mode(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_POWER_MODE_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t controller = transport[0];
+  uint32_t mode = transport[1];
+
+  if (controller >= NUM_GPIOS || !listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+
+  switch (mode) {
+    case POWER_MODE_ACTIVE:
+      GPIOWakeupGlobalDisable(controller_base);
+      GPIOGatingRatioConfigure(controller_base, GPIO_GR_FUNC_CLK_INTER_CLK_BY_2);
+      GPIOAutoIdleModeControl(controller_base, GPIO_AUTO_IDLE_MODE_DISABLE);
+      GPIOIdleModeConfigure(controller_base, GPIO_IDLE_MODE_NO_IDLE);
+      break;
+    case POWER_MODE_LOW_POWER:
+      // Acknowledge idle requests from the power manager but raise a wakeup
+      // when one of the wakeup pins sees an edge, and gate the clocks of the
+      // module whenever it is not being accessed
+      GPIOIdleModeConfigure(controller_base, GPIO_IDLE_MODE_SMART_IDLE_WAKEUP);
+      GPIOAutoIdleModeControl(controller_base, GPIO_AUTO_IDLE_MODE_ENABLE);
+      GPIOGatingRatioConfigure(controller_base, GPIO_GR_FUNC_CLK_INTER_CLK_BY_8);
+      GPIOWakeupGlobalEnable(controller_base);
+      break;
+    default:
+      return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  checkpoint_controller(controller);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_set_pin_wakeup(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PIN_WAKEUP_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t pin = transport[0];
+  uint32_t wakeup = transport[1];
+
+  if (!board_pin_used(pin)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  unsigned int controller = 0;
+
+  flat_pin_to_controller_pin(pin, &controller, &pin);
+
+  if (!listener_serves_controller(p_listener, controller) || !ensure_controller_initialized(p_listener, controller)) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  uint32_t bit = 1 << pin;
+
+  if (wakeup) {
+    // A wakeup is raised by the edge detection of the pin
+    GPIOIntTypeSet(controller_base, pin, GPIO_INT_TYPE_BOTH_EDGE);
+    GPIOPinIntWakeUpEnable(controller_base, GPIO_INT_LINE_1, pin);
+    wakeup_masks[controller] |= bit;
+  } else {
+    GPIOPinIntWakeUpDisable(controller_base, GPIO_INT_LINE_1, pin);
+    // The status page still needs the edges
+    if (!(status_input_masks[controller] & bit)) {
+      GPIOIntTypeSet(controller_base, pin, GPIO_INT_TYPE_NO_EDGE);
+    }
+    wakeup_masks[controller] &= ~bit;
+  }
+
+  checkpoint_controller(controller);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+// Register changes of a configure transaction on one controller, each register
+// is then written once for the whole transaction
+typedef struct {
+  uint32_t touched;
+  uint32_t outputs;
+  uint32_t set_data;
+  uint32_t debounce;
+  uint32_t rising;
+  uint32_t falling;
+} gpio_transaction_t;
+
+static void commit_transaction(unsigned int controller, gpio_transaction_t *p_transaction) {
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  uint32_t touched = p_transaction->touched;
+  uint32_t inputs = touched & ~p_transaction->outputs;
+
+  // Set the levels before the directions so outputs come up at their level
+  HWREG(controller_base + GPIO_SETDATAOUT) = p_transaction->set_data;
+  HWREG(controller_base + GPIO_CLEARDATAOUT) = touched & ~p_transaction->set_data;
+
+  // OE is active low
+  HWREG(controller_base + GPIO_OE) = (HWREG(controller_base + GPIO_OE) & ~p_transaction->outputs) | inputs;
+
+  // Pins with a debounce window the controller applies keep it, and the
+  // status inputs and wakeup pins keep detecting both edges
+  uint32_t debounced = touched & debounce[controller].hw_mask;
+  uint32_t both_edges = touched & (status_input_masks[controller] | wakeup_masks[controller]);
+  HWREG(controller_base + GPIO_DEBOUNCENABLE) =
+    (HWREG(controller_base + GPIO_DEBOUNCENABLE) & ~touched) | p_transaction->debounce | debounced;
+  HWREG(controller_base + GPIO_RISINGDETECT) =
+    (HWREG(controller_base + GPIO_RISINGDETECT) & ~touched) | p_transaction->rising | both_edges;
+  HWREG(controller_base + GPIO_FALLINGDETECT) =
+    (HWREG(controller_base + GPIO_FALLINGDETECT) & ~touched) | p_transaction->falling | both_edges;
+
+  checkpoint_controller(controller);
+}
+
+static kos_msg_t handle_configure_transaction(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+
+  seL4_Word payload_size = kos_msg_payload_size(msg.metadata);
+  seL4_Word num_entries = payload_size / sizeof(uint32_t);
+
+  if (payload_size % sizeof(uint32_t) != 0 || num_entries == 0 || num_entries > MAX_TRANSACTION_ENTRIES)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  gpio_transaction_t transactions[NUM_GPIOS] = {0};
+
+  // Fold the entries into per-controller masks, nothing is touched, not even
+  // the first use initialisation of a controller, unless every entry is valid
+  for (seL4_Word i = 0; i < num_entries; i++) {
+    uint32_t entry = transport[i];
+    unsigned int pin = entry & TRANSACTION_PIN_MASK;
+    unsigned int controller = 0;
+
+    if ((entry & ~TRANSACTION_VALID_BITS) != 0 || !board_pin_used(pin)) {
+      return kos_msg_new_status(STATUS_BAD_REQUEST);
+    }
+
+    flat_pin_to_controller_pin(pin, &controller, &pin);
+
+    if (!gpio_controller_mapped[controller] || !listener_serves_controller(p_listener, controller)) {
+      return kos_msg_new_status(STATUS_BAD_REQUEST);
+    }
+
+    gpio_transaction_t *p_transaction = &transactions[controller];
+    uint32_t bit = 1 << pin;
+    uint32_t edge = entry & TRANSACTION_EDGE_MASK;
+
+    p_transaction->touched |= bit;
+    if (entry & TRANSACTION_OUTPUT)
+      p_transaction->outputs |= bit;
+    if (entry & TRANSACTION_HIGH)
+      p_transaction->set_data |= bit;
+    if (entry & TRANSACTION_DEBOUNCE)
+      p_transaction->debounce |= bit;
+    if (edge & TRANSACTION_EDGE_RISING)
+      p_transaction->rising |= bit;
+    if (edge & TRANSACTION_EDGE_FALLING)
+      p_transaction->falling |= bit;
+  }
+
+  for (unsigned int controller = 0; controller < NUM_GPIOS; controller++) {
+    if (transactions[controller].touched == 0)
+      continue;
+    if (!ensure_controller_initialized(p_listener, controller))
+      return kos_msg_new_status(STATUS_BAD_REQUEST);
+    commit_transaction(controller, &transactions[controller]);
+  }
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_dump(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * DUMP_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  // Only reads registers, so every controller is dumped whichever listener
+  // serves it, and controllers are not initialised by it
+  for (unsigned int controller = 0; controller < NUM_GPIOS; controller++) {
+    uint32_t *p_words = &transport[controller * DUMP_WORDS_PER_CONTROLLER];
+
+    if (!gpio_controller_mapped[controller]) {
+      memset(p_words, 0, sizeof(uint32_t) * DUMP_WORDS_PER_CONTROLLER);
+      p_words[0] = CONTROLLER_STATE_UNAVAILABLE;
+      continue;
+    }
+
+    unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+
+    p_words[0] = gpio_controller_initialized[controller] ? CONTROLLER_STATE_INITIALIZED
+                                                         : CONTROLLER_STATE_UNINITIALIZED;
+    p_words[1] = HWREG(controller_base + GPIO_OE);
+    p_words[2] = HWREG(controller_base + GPIO_DATAOUT);
+    p_words[3] = HWREG(controller_base + GPIO_DATAIN);
+    p_words[4] = HWREG(controller_base + GPIO_DEBOUNCENABLE);
+    p_words[5] = HWREG(controller_base + GPIO_LEVELDETECT(0));
+    p_words[6] = HWREG(controller_base + GPIO_LEVELDETECT(1));
+    p_words[7] = HWREG(controller_base + GPIO_RISINGDETECT);
+    p_words[8] = HWREG(controller_base + GPIO_FALLINGDETECT);
+  }
+
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * DUMP_RESULTS, 0, 0);
+}
+
+// Runs each operation of the batch through its own handler, so they are checked
+// exactly as if they were sent on their own. Operations run in order and stop at
+// the first one that fails. The reply starts with the number of operations that
+// succeeded followed by their results, the level for reads and 0 for the
+// others, and then the status of the failed operation if there was one.
+static kos_msg_t handle_batch(kos_msg_t msg, seL4_Word caller_id, gpio_listener_t *p_listener) {
+  if (caller_id != p_listener->client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+
+  seL4_Word payload_size = kos_msg_payload_size(msg.metadata);
+  seL4_Word num_ops = payload_size / (sizeof(uint32_t) * BATCH_OP_WORDS);
+
+  if (payload_size % (sizeof(uint32_t) * BATCH_OP_WORDS) != 0 || num_ops == 0 || num_ops > MAX_BATCH_OPS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  // The handlers take their arguments from and put their results in the
+  // transport, so the operations are copied out first
+  uint32_t ops[MAX_BATCH_OPS * BATCH_OP_WORDS];
+  memcpy(ops, transport, payload_size);
+
+  uint32_t results[MAX_BATCH_OPS + 1];
+  seL4_Word num_succeeded = 0;
+  seL4_Word num_results = 1;
+
+  for (seL4_Word i = 0; i < num_ops; i++) {
+    uint32_t *p_op = &ops[i * BATCH_OP_WORDS];
+    kos_msg_t reply;
+
+    transport[0] = p_op[1];
+    transport[1] = p_op[2];
+
+    switch (p_op[0]) {
+      case CONFIGURE_PIN_REQUEST:
+        reply = handle_configure_pin(kos_msg_new(p_op[0], 0, sizeof(uint32_t) * CONFIGURE_PIN_ARGS, 0, 0),
+                                     caller_id, p_listener);
+        break;
+      case SET_DEBOUNCE_REQUEST:
+        reply = handle_set_debounce(kos_msg_new(p_op[0], 0, sizeof(uint32_t) * SET_DEBOUNCE_ARGS, 0, 0),
+                                    caller_id, p_listener);
+        break;
+      case READ_REQUEST:
+        reply = handle_read(kos_msg_new(p_op[0], 0, sizeof(uint32_t) * READ_ARGS, 0, 0),
+                            caller_id, p_listener);
+        break;
       case WRITE_REQUEST:
-        msg = handle_write(msg, caller_id);
+        reply = handle_write(kos_msg_new(p_op[0], 0, sizeof(uint32_t) * WRITE_ARGS, 0, 0),
+                             caller_id, p_listener);
         break;
       default:
-        msg = kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
+        reply = kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
         break;
     }
+
+    if (reply.label != STATUS_OK) {
+      results[num_results++] = reply.label;
+      break;
+    }
+
+    results[num_results++] = p_op[0] == READ_REQUEST ? transport[0] : 0;
+    num_succeeded++;
   }
+
+  results[0] = num_succeeded;
+  memcpy(transport, results, sizeof(uint32_t) * num_results);
+
+  // A batch that failed part way is still a successful reply
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * num_results, 0, 0);
 }
 
-static void init_gpio_modules(seL4_Word base_addr) {
-  unsigned int controller_base = (unsigned int) base_addr;
+static void irq_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word controller) {
+  (void) p_env;
 
-  GPIOModuleDisable(controller_base);
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
 
-  GPIOModuleReset(controller_base);
+  while (true) {
+    kos_irq_wait(&gpio_irqs[controller]);
 
-  GPIOAutoIdleModeControl(controller_base, GPIO_AUTO_IDLE_MODE_DISABLE);
+    uint32_t status = HWREG(controller_base + GPIO_IRQSTATUS(GPIO_INT_LINE_1));
 
-  GPIOIdleModeConfigure(controller_base, GPIO_IDLE_MODE_NO_IDLE);
+    // Clear the edges we've seen
+    HWREG(controller_base + GPIO_IRQSTATUS(GPIO_INT_LINE_1)) = status;
+    kos_irq_ack(&gpio_irqs[controller]);
 
-  GPIOModuleEnable(controller_base);
+    if (status & status_input_masks[controller]) {
+      publish_status(controller);
+    }
+  }
 }
 
-int main(int argc, char *argv[]) {
-#ifdef VISUALIZE_STARTUP
-  kos_printf("\n");
-  kos_printf("----  %s server ----\n", argv[0]);
-#endif
+static void timer_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word garbage) {
+  (void) p_env;
+  (void) garbage;
+
+  unsigned int base = (unsigned int) timer_base;
 
-  kos_assert_eq(argc, EXPECTED_ARGC, "unexpected argument counts");
+  while (true) {
+    kos_irq_wait(&timer_irq);
 
-  protocol_name = argv[PROTOCOL_NAME_IDX];
+    HWREG(base + DMTIMER_IRQSTATUS) = DMTIMER_IRQSTATUS_OVF_IT_FLAG;
+    kos_irq_ack(&timer_irq);
 
-  // Initialize the thread manager
+    for (unsigned int controller = 0; controller < NUM_GPIOS; controller++) {
+      sample_debounced_pins(controller);
+    }
+    stop_idle_debounce_sampling();
+  }
+}
+
+// Serves a request received by a listener, or by the combined I/O service on
+// behalf of the default listener
+static kos_msg_t dispatch(gpio_listener_t *p_listener, kos_msg_t msg, seL4_Word badge, seL4_Word caller_id) {
+  p_listener->stats.requests++;
+
+  // Check the protocol via the badge first
+  if (badge != p_listener->badge) {
+    p_listener->stats.errors++;
+    return kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
+  }
+
+  // One-way writes are only served by the one-way listener, which serves
+  // nothing else as it never replies
+  if (msg.label != (seL4_Word) GPIO_REQUEST_LABEL && p_listener->one_way != (msg.label == ONE_WAY_WRITE_REQUEST)) {
+    p_listener->stats.errors++;
+    return kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
+  }
+
+  // The priority listener only serves requests on a single pin, which never
+  // loop over pins or entries and never wait for another thread; the status
+  // page and checkpoint writes they end with are skipped rather than waited
+  // for if a preempted thread is writing them. Its worst-case latency is then
+  // bounded by the longest of these requests.
+  if (p_listener->bounded_only &&
+      msg.label != (seL4_Word) GPIO_REQUEST_LABEL && msg.label != READ_REQUEST &&
+      msg.label != WRITE_REQUEST && msg.label != GET_STATS_REQUEST &&
+      msg.label != FAST_READ_REQUEST && msg.label != FAST_WRITE_REQUEST &&
+      msg.label != ONE_WAY_WRITE_REQUEST) {
+    p_listener->stats.errors++;
+    return kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
+  }
+
+  // Act on the label
+  switch (msg.label) {
+    case GPIO_REQUEST_LABEL:
+      msg = handle_request(msg, badge, caller_id, p_listener);
+      break;
+    case CONFIGURE_PIN_REQUEST:
+      msg = handle_configure_pin(msg, caller_id, p_listener);
+      break;
+    case SET_DEBOUNCE_REQUEST:
+      msg = handle_set_debounce(msg, caller_id, p_listener);
+      break;
+    case SET_DEBOUNCE_TIMING_REQUEST:
+      msg = handle_set_debounce_timing(msg, caller_id, p_listener);
+      break;
+    case READ_REQUEST:
+      msg = handle_read(msg, caller_id, p_listener);
+      break;
+    case WRITE_REQUEST:
+      msg = handle_write(msg, caller_id, p_listener);
+      break;
+    case GET_STATS_REQUEST:
+      msg = handle_get_stats(msg, caller_id, p_listener);
+      break;
+    case SET_DEBOUNCE_WINDOW_REQUEST:
+      msg = handle_set_debounce_window(msg, caller_id, p_listener);
+      break;
+    case SET_POWER_MODE_REQUEST:
+      msg = handle_set_power_mode(msg, caller_id, p_listener);
+      break;
+    case SET_PIN_WAKEUP_REQUEST:
+      msg = handle_set_pin_wakeup(msg, caller_id, p_listener);
+      break;
+    case CONFIGURE_TRANSACTION_REQUEST:
+      msg = handle_configure_transaction(msg, caller_id, p_listener);
+      break;
+    case DUMP_REQUEST:
+      msg = handle_dump(msg, caller_id, p_listener);
+      break;
+    case BATCH_REQUEST:
+      msg = handle_batch(msg, caller_id, p_listener);
+      break;
+    case FAST_READ_REQUEST:
+      msg = handle_fast_read(msg, caller_id, p_listener);
+      break;
+    case FAST_WRITE_REQUEST:
+    case ONE_WAY_WRITE_REQUEST:
+      msg = handle_fast_write(msg, caller_id, p_listener);
+      break;
+    default:
+      msg = kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
+      break;
+  }
+
+  if (msg.label != STATUS_OK) {
+    p_listener->stats.errors++;
+  }
+
+  return msg;
+}
+
+// The one-way listener receives without replying, so a client that sends it
+// a write carries on as soon as the write is received, and writes queued on
+// the endpoint are received one after the other without a reply in between.
+// Only the registration is a call, which is answered through the reply object
+// that the receive bound it to.
+static void one_way_listen(gpio_listener_t *p_listener) {
+  while (true) {
+    seL4_Word seL4_badge;
+    kos_msg_t msg;
+
+    seL4_MessageInfo_t sel4_msg = seL4_Recv(
+      p_listener->server.transport.ep_cptr,
+      &seL4_badge,
+      p_listener->server.reply_cptr);
+
+    msg.label = seL4_GetMR(0);
+    msg.param = seL4_GetMR(1);
+    msg.metadata = seL4_GetMR(2);
+    seL4_Word badge = seL4_GetMR(3);
+
+    seL4_Word caller_id = seL4_MessageInfo_get_label(sel4_msg);
+    bool registration = msg.label == (seL4_Word) GPIO_REQUEST_LABEL;
+
+    msg = dispatch(p_listener, msg, badge, caller_id);
+
+    if (registration) {
+      seL4_SetMR(0, msg.label);
+      seL4_SetMR(1, msg.param);
+      seL4_SetMR(2, msg.metadata);
+      seL4_Send(p_listener->server.reply_cptr, seL4_MessageInfo_new(STATUS_OK, 0, 0, 3));
+    }
+  }
+}
+
+static void listen_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word listener_id) {
+  gpio_listener_t *p_listener = &listeners[listener_id];
+
+  // Publish the KOS am335x GPIO protocol
   kos_assert_ok(
-    kos_thread_mgr_init(
-      &root_manager_entry, // IN_OUT kos_thread_mgr_entry_t* p_entries,
-      1, // IN seL4_Word capacity,
-      &root_thread_mgr // OUT kos_thread_mgr_t* p_thread_mgr
+    kos_dir_publish_str(
+      p_listener->protocol_name,
+      GPIO_REQUEST_LABEL,
+      p_listener->badge,
+      KOS_MSG_FLAG_SEND_PAYLOAD
+    ),
+    "failed to publish AM335X GPIO protocol"
+  );
+
+  // Signal that we are done initializing, the default listener is always
+  // started and only it needs to do this
+  if (listener_id == DEFAULT_LISTENER) {
+    kos_app_ready();
+  }
+
+  // Prepare to receive caps
+  kos_cap_t receive_cap = kos_cnode_cap(p_env->p_cnode, KOS_THREAD_SLOT_RECEIVE);
+  kos_cap_set_receive(receive_cap);
+
+  // Prepare the reply cap
+  kos_cap_t reply_cap = kos_cnode_cap(p_env->p_cnode, KOS_THREAD_SLOT_REPLY);
+
+  // A slot to hold the transport
+  kos_cap_t server_cap = kos_cap_reserve();
+
+  // Set up the server transport
+  kos_assert_created(
+    kos_msg_server_create(
+      server_cap,
+      reply_cap, // IN kos_cap_t reply_cap,
+      GPIO_RECEIVE_TOKEN_SLOT(listener_id), // IN kos_token_t receive_token_slot,
+      &p_listener->server // OUT kos_msg_server_t* p_server
     ),
     NULL
   );
 
-  // Bootstrap the message server connection
-  kos_assert_created(kos_msg_setup(), NULL);
+  // No longer need to receive caps.
+  kos_cap_clear_receive();
 
-  // Map the frames of the GPIO controllers
-  for (int i = 0; i < NUM_GPIOS; i++) {
-    kos_status_t status = kos_dev_resources_map_device_frame(&gpio_controller_frames[i],
-                                                             kos_cap_rights_all_rights(),
-                                                             NULL,
-                                                             &gpio_controller_bases[i]);
-    kos_assert_ok(status, "failed to map GPIO controller %d", i);
+  if (p_listener->one_way) {
+    one_way_listen(p_listener);
   }
 
-  // Initialise the modules
-  for (int i = 0; i < NUM_GPIOS; i++) {
-    init_gpio_modules(gpio_controller_bases[i]);
+  // Initial status is OK
+  kos_msg_t msg = kos_msg_new_status(STATUS_OK);
+
+  while (true) {
+    seL4_Word badge;
+    seL4_Word seL4_badge;
+    seL4_Word caller_id;
+
+    seL4_SetMR(0, msg.label);
+    seL4_SetMR(1, msg.param);
+    seL4_SetMR(2, msg.metadata);
+    seL4_MessageInfo_t sel4_msg = seL4_ReplyRecv(
+      p_listener->server.transport.ep_cptr,
+      seL4_MessageInfo_new(STATUS_OK, 0, 0, 3),
+      &seL4_badge,
+      p_listener->server.reply_cptr);
+
+    // fill out the message struct
+    msg.label = seL4_GetMR(0);
+    msg.param = seL4_GetMR(1);
+    msg.metadata = seL4_GetMR(2);
+    badge = seL4_GetMR(3);
+
+    caller_id = seL4_MessageInfo_get_label(sel4_msg);
+
+    msg = dispatch(p_listener, msg, badge, caller_id);
   }
+}
+
+static void start_listener(int listener_id) {
+  gpio_listener_t *p_listener = &listeners[listener_id];
 
   // Create and start the listener thread
   kos_assert_created(
-    kos_thread_create(listen_thread_fn, 0, false, &listener_thread),
-    "failed to create listener thread"
+    kos_thread_create(listen_thread_fn, listener_id, false, &p_listener->thread),
+    "failed to create listener thread %d", listener_id
+  );
+
+  kos_assert_ok(
+    kos_thread_mgr_add(
+      p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+      &p_listener->thread, // IN_OUT kos_thread_t* p_thread,
+      KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
+      listener_id, // IN seL4_Word cookie,
+      kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
+      NULL // OPTIONAL OUT seL4_Word* p_id
+    ),
+    "failed to add listener thread %d to the thread manager", listener_id
+  );
+
+  if (listener_id == PRIORITY_LISTENER) {
+    kos_assert_ok(
+      kos_thread_set_priority(&p_listener->thread, PRIORITY_LISTENER_PRIORITY),
+      "failed to raise the priority of the priority listener thread"
+    );
+  }
+
+  kos_assert_ok(
+    kos_thread_start(&p_listener->thread), // IN_OUT kos_thread_t* p_thread,
+    "failed to start listener thread %d", listener_id
+  );
+}
+
+static void start_irq_thread(unsigned int controller) {
+  // Create and start the interrupt thread
+  kos_assert_created(
+    kos_thread_create(irq_thread_fn, controller, false, &irq_threads[controller]),
+    "failed to create interrupt thread %d", controller
+  );
+
+  kos_assert_ok(
+    kos_thread_mgr_add(
+      p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+      &irq_threads[controller], // IN_OUT kos_thread_t* p_thread,
+      KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
+      NUM_LISTENERS + controller, // IN seL4_Word cookie,
+      kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
+      NULL // OPTIONAL OUT seL4_Word* p_id
+    ),
+    "failed to add interrupt thread %d to the thread manager", controller
+  );
+
+  kos_assert_ok(
+    kos_thread_start(&irq_threads[controller]), // IN_OUT kos_thread_t* p_thread,
+    "failed to start interrupt thread %d", controller
+  );
+}
+
+static void start_timer_thread(void) {
+  kos_assert_created(
+    kos_thread_create(timer_thread_fn, 0, false, &timer_thread),
+    "failed to create timer thread"
   );
 
   kos_assert_ok(
     kos_thread_mgr_add(
-      &root_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
-      &listener_thread, // IN_OUT kos_thread_t* p_thread,
+      p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+      &timer_thread, // IN_OUT kos_thread_t* p_thread,
       KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
-      0, // IN seL4_Word cookie,
+      NUM_LISTENERS + NUM_GPIOS, // IN seL4_Word cookie,
       kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
       NULL // OPTIONAL OUT seL4_Word* p_id
     ),
-    "failed to add listener thread to the thread manager"
+    "failed to add timer thread to the thread manager"
   );
 
   kos_assert_ok(
-    kos_thread_start(&listener_thread), // IN_OUT kos_thread_t* p_thread,
-    "failed to start listener thread"
+    kos_thread_start(&timer_thread), // IN_OUT kos_thread_t* p_thread,
+    "failed to start timer thread"
+  );
+}
+
+static void map_checkpoint(void) {
+  seL4_Word checkpoint_base;
+  kos_status_t status = kos_dev_resources_map_device_frame(&checkpoint_frame,
+                                                           kos_cap_rights_all_rights(),
+                                                           NULL,
+                                                           &checkpoint_base);
+  kos_assert_ok(status, "failed to map the checkpoint frame");
+
+  p_checkpoint = (gpio_checkpoint_t *) checkpoint_base;
+
+  // Anything other than our own checkpoint is left over from something else
+  if (p_checkpoint->magic != CHECKPOINT_MAGIC) {
+    memset(p_checkpoint, 0, sizeof(*p_checkpoint));
+    p_checkpoint->magic = CHECKPOINT_MAGIC;
+  }
+}
+
+// Takes over a controller that a previous instance of the service had
+// initialised. If the controller still holds the checkpointed state it is left
+// untouched, so outputs keep their levels across the restart. Otherwise it lost
+// its state and is brought back to the checkpoint.
+static void adopt_controller(unsigned int controller) {
+  gpio_controller_checkpoint_t *p_entry = &p_checkpoint->controllers[controller];
+
+  // Never initialised, or torn by a fault in the middle of a checkpoint
+  if (p_entry->sequence == 0 || (p_entry->sequence & 1))
+    return;
+
+  unsigned int controller_base = (unsigned int) gpio_controller_bases[controller];
+  gpio_debounce_t *p_debounce = &debounce[controller];
+
+  GPIOCONTEXT live;
+  gpioContextSave(controller_base, &live);
+
+  if (live.ctrl != p_entry->context.ctrl ||
+      live.dir != p_entry->context.dir ||
+      live.data != p_entry->context.data ||
+      HWREG(controller_base + GPIO_SYSCONFIG) != p_entry->sysconfig ||
+      HWREG(controller_base + GPIO_RISINGDETECT) != p_entry->rising_detect ||
+      HWREG(controller_base + GPIO_FALLINGDETECT) != p_entry->falling_detect) {
+    init_gpio_modules(gpio_controller_bases[controller]);
+    // Set the levels before the directions so outputs come up at their level
+    HWREG(controller_base + GPIO_SETDATAOUT) = p_entry->context.data;
+    HWREG(controller_base + GPIO_CLEARDATAOUT) = ~p_entry->context.data;
+    gpioContextRestore(controller_base, &p_entry->context);
+    HWREG(controller_base + GPIO_SYSCONFIG) = p_entry->sysconfig;
+    HWREG(controller_base + GPIO_RISINGDETECT) = p_entry->rising_detect;
+    HWREG(controller_base + GPIO_FALLINGDETECT) = p_entry->falling_detect;
+    HWREG(controller_base + GPIO_DEBOUNCINGTIME) = p_entry->debounce_time;
+    HWREG(controller_base + GPIO_DEBOUNCENABLE) = p_entry->debounce_enable;
+
+    for (unsigned int pin = 0; pin < PINS_IN_CONTROLLER; pin++) {
+      if (p_entry->wakeup_mask & (1 << pin)) {
+        GPIOIntTypeSet(controller_base, pin, GPIO_INT_TYPE_BOTH_EDGE);
+        GPIOPinIntWakeUpEnable(controller_base, GPIO_INT_LINE_1, pin);
+      }
+    }
+  }
+
+  wakeup_masks[controller] = p_entry->wakeup_mask;
+  memcpy(p_debounce->window_us, p_entry->window_us, sizeof(p_debounce->window_us));
+  p_debounce->hw_mask = p_entry->hw_mask;
+  p_debounce->sw_mask = p_entry->sw_mask;
+
+  // Rebuild the debounce state, this only touches the inputs being debounced
+  if (configure_debounce(controller) != STATUS_OK) {
+    kos_printf("dropping debounce windows of GPIO controller %d\n", controller);
+    memset(p_debounce->window_us, 0, sizeof(p_debounce->window_us));
+    configure_debounce(controller);
+  }
+
+  gpio_controller_initialized[controller] = true;
+  arm_status_inputs(controller);
+  checkpoint_controller(controller);
+}
+
+static void map_status(void) {
+  seL4_Word status_base;
+  kos_status_t status = kos_dev_resources_map_device_frame(&status_frame,
+                                                           kos_cap_rights_all_rights(),
+                                                           NULL,
+                                                           &status_base);
+  kos_assert_ok(status, "failed to map the status frame");
+
+  p_status = (gpio_status_page_t *) status_base;
+
+  // Readers check the magic, so it is only set once every controller is valid
+  p_status->magic = 0;
+  memset(p_status->controllers, 0, sizeof(p_status->controllers));
+  for (int i = 0; i < NUM_GPIOS; i++) {
+    publish_status(i);
+  }
+  __atomic_store_n(&p_status->magic, GPIO_STATUS_MAGIC, __ATOMIC_RELEASE);
+}
+
+static void init_timer(void) {
+  unsigned int base = (unsigned int) timer_base;
+
+  // Overflow once per sample, the interrupt is only enabled while there are
+  // pins to sample
+  HWREG(base + DMTIMER_IRQENABLE_CLR) = DMTIMER_IRQENABLE_CLR_OVF_EN_FLAG;
+  HWREG(base + DMTIMER_IRQSTATUS) = DMTIMER_IRQSTATUS_OVF_IT_FLAG;
+  HWREG(base + DMTIMER_TLDR) = TIMER_RELOAD;
+  HWREG(base + DMTIMER_TCRR) = TIMER_RELOAD;
+  HWREG(base + DMTIMER_TCLR) = DMTIMER_TCLR_AR | DMTIMER_TCLR_ST;
+}
+
+// Returns the controller of a "gpioN_protocol=" option, or ANY_CONTROLLER if
+// the option isn't one
+static int controller_protocol_option(char *option) {
+  size_t prefix_len = strlen(CONTROLLER_PROTOCOL_OPTION_PREFIX);
+  size_t suffix_len = strlen(CONTROLLER_PROTOCOL_OPTION_SUFFIX);
+
+  if (strncmp(option, CONTROLLER_PROTOCOL_OPTION_PREFIX, prefix_len) != 0)
+    return ANY_CONTROLLER;
+
+  int controller = option[prefix_len] - '0';
+  if (controller < 0 || controller >= NUM_GPIOS)
+    return ANY_CONTROLLER;
+
+  if (strncmp(option + prefix_len + 1, CONTROLLER_PROTOCOL_OPTION_SUFFIX, suffix_len) != 0)
+    return ANY_CONTROLLER;
+
+  return controller;
+}
+
+static void parse_status_inputs(char *list) {
+  char *p_next = list;
+
+  while (*p_next != '\0') {
+    char *p_end;
+    unsigned int pin = strtoul(p_next, &p_end, 0);
+
+    if (p_end == p_next || !board_pin_used(pin)) {
+      kos_printf("ignoring status inputs after '%s'\n", p_next);
+      return;
+    }
+
+    status_input_masks[pin / PINS_IN_CONTROLLER] |= 1u << (pin % PINS_IN_CONTROLLER);
+    p_next = (*p_end == ',') ? p_end + 1 : p_end;
+  }
+}
+
+// Options are given to us as "key=value" arguments after the protocol name
+static void parse_options(int argc, char *argv[]) {
+  for (int i = FIRST_OPTION_IDX; i < argc; i++) {
+    int controller = controller_protocol_option(argv[i]);
+
+    if (strncmp(argv[i], PRIORITY_PROTOCOL_OPTION, strlen(PRIORITY_PROTOCOL_OPTION)) == 0) {
+      listeners[PRIORITY_LISTENER].protocol_name = argv[i] + strlen(PRIORITY_PROTOCOL_OPTION);
+    } else if (strncmp(argv[i], ONE_WAY_PROTOCOL_OPTION, strlen(ONE_WAY_PROTOCOL_OPTION)) == 0) {
+      listeners[ONE_WAY_LISTENER].protocol_name = argv[i] + strlen(ONE_WAY_PROTOCOL_OPTION);
+    } else if (strncmp(argv[i], CHECKPOINT_FRAME_OPTION, strlen(CHECKPOINT_FRAME_OPTION)) == 0) {
+      checkpoint_frame.paddr = strtoul(argv[i] + strlen(CHECKPOINT_FRAME_OPTION), NULL, 0);
+    } else if (strncmp(argv[i], STATUS_FRAME_OPTION, strlen(STATUS_FRAME_OPTION)) == 0) {
+      status_frame.paddr = strtoul(argv[i] + strlen(STATUS_FRAME_OPTION), NULL, 0);
+    } else if (strncmp(argv[i], STATUS_INPUTS_OPTION, strlen(STATUS_INPUTS_OPTION)) == 0) {
+      parse_status_inputs(argv[i] + strlen(STATUS_INPUTS_OPTION));
+    } else if (controller != ANY_CONTROLLER) {
+      listeners[CONTROLLER_LISTENER(controller)].protocol_name = strchr(argv[i], '=') + 1;
+    } else {
+      kos_printf("ignoring unknown option '%s'\n", argv[i]);
+    }
+  }
+}
+
+static void init_gpio_modules(seL4_Word base_addr) {
+  unsigned int controller_base = (unsigned int) base_addr;
+
+  GPIOModuleDisable(controller_base);
+
+  GPIOModuleReset(controller_base);
+
+  GPIOAutoIdleModeControl(controller_base, GPIO_AUTO_IDLE_MODE_DISABLE);
+
+  GPIOIdleModeConfigure(controller_base, GPIO_IDLE_MODE_NO_IDLE);
+
+  GPIOModuleEnable(controller_base);
+}
+
+// Maps the controllers and starts the threads of the service, all but the
+// default listener when we are part of the combined I/O service
+static void start_service(int argc, char *argv[]) {
+  kos_assert_eq(argc >= MIN_ARGC, true, "unexpected argument counts");
+
+  listeners[DEFAULT_LISTENER].protocol_name = argv[PROTOCOL_NAME_IDX];
+  parse_options(argc, argv);
+
+  // Map the frames of the GPIO controllers that were given to us, they are
+  // initialised by the first request that touches them
+  for (int i = 0; i < NUM_GPIOS; i++) {
+    kos_cap_t dummy_cap;
+    if (board_pin_masks[i] == 0)
+      continue;
+    if (kos_dev_resources_find_device_frame(&gpio_controller_frames[i], &dummy_cap) != STATUS_OK)
+      continue;
+
+    kos_status_t status = kos_dev_resources_map_device_frame(&gpio_controller_frames[i],
+                                                             kos_cap_rights_all_rights(),
+                                                             NULL,
+                                                             &gpio_controller_bases[i]);
+    kos_assert_ok(status, "failed to map GPIO controller %d", i);
+    gpio_controller_mapped[i] = true;
+  }
+
+  // The timer and the interrupts are optional. The timer is only given to
+  // services that debounce in software, without it and its interrupt there is
+  // no timer thread and only windows the controllers can debounce are accepted
+  kos_cap_t dummy_cap;
+  if (kos_dev_resources_find_device_frame(&timer_frame, &dummy_cap) == STATUS_OK) {
+    kos_status_t status = kos_dev_resources_map_device_frame(&timer_frame,
+                                                             kos_cap_rights_all_rights(),
+                                                             NULL,
+                                                             &timer_base);
+    kos_assert_ok(status, "failed to map the debounce timer");
+    init_timer();
+    timer_irq_available = kos_dev_resources_find_irq(&timer_device_irq, &timer_irq) == STATUS_OK;
+    if (timer_irq_available) {
+      start_timer_thread();
+    }
+  }
+
+  for (int i = 0; i < NUM_GPIOS; i++) {
+    if (!gpio_controller_mapped[i])
+      continue;
+    gpio_irq_available[i] = kos_dev_resources_find_irq(&gpio_controller_irqs[i], &gpio_irqs[i]) == STATUS_OK;
+    if (gpio_irq_available[i]) {
+      start_irq_thread(i);
+    }
+  }
+
+  // Mapped before the controllers are adopted so the page follows them
+  if (status_frame.paddr != 0) {
+    map_status();
+  }
+
+  // Take over the controllers from the checkpoint of a previous instance
+  if (checkpoint_frame.paddr != 0) {
+    map_checkpoint();
+    for (int i = 0; i < NUM_GPIOS; i++) {
+      if (gpio_controller_mapped[i]) {
+        adopt_controller(i);
+      }
+    }
+  }
+
+  // The priority and one-way listeners can't initialize a controller on first
+  // use, so with either protocol they are all initialized before any request
+  if (listeners[PRIORITY_LISTENER].protocol_name != NULL || listeners[ONE_WAY_LISTENER].protocol_name != NULL) {
+    for (int i = 0; i < NUM_GPIOS; i++) {
+      if (gpio_controller_mapped[i] && !gpio_controller_initialized[i]) {
+        initialize_controller(i);
+      }
+    }
+  }
+
+#ifndef KOS_AM335X_IO
+  start_listener(DEFAULT_LISTENER);
+#endif
+
+  // The remaining listeners are only started if they were given a protocol
+  for (int i = PRIORITY_LISTENER; i < NUM_LISTENERS; i++) {
+    if (listeners[i].protocol_name != NULL) {
+      start_listener(i);
+    }
+  }
+}
+
+#ifdef KOS_AM335X_IO
+void gpio_service_start(int argc, char *argv[], kos_thread_mgr_t *p_io_thread_mgr) {
+  p_thread_mgr = p_io_thread_mgr;
+  start_service(argc, argv);
+}
+
+kos_msg_t gpio_service_dispatch(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id) {
+  return dispatch(&listeners[DEFAULT_LISTENER], msg, badge, caller_id);
+}
+
+bool gpio_service_register_only(seL4_Word label) {
+  return label == FAST_READ_REQUEST || label == FAST_WRITE_REQUEST;
+}
+#else
+int main(int argc, char *argv[]) {
+#ifdef VISUALIZE_STARTUP
+  kos_printf("\n");
+  kos_printf("----  %s server ----\n", argv[0]);
+#endif
+
+  // Initialize the thread manager
+  kos_assert_ok(
+    kos_thread_mgr_init(
+      root_manager_entries, // IN_OUT kos_thread_mgr_entry_t* p_entries,
+      NUM_THREADS, // IN seL4_Word capacity,
+      &root_thread_mgr // OUT kos_thread_mgr_t* p_thread_mgr
+    ),
+    NULL
   );
+  p_thread_mgr = &root_thread_mgr;
+
+  // Bootstrap the message server connection
+  kos_assert_created(kos_msg_setup(), NULL);
+
+  start_service(argc, argv);
 
   // Run app-level thread manager handler directly on this thread,
   // this should never return
@@ -411,3 +1928,4 @@ int main(int argc, char *argv[]) {
   kos_stop("KOS am335x GPIO server exited unexpectedly");
   return 0;
 }
+#endif
@@ -0,0 +1,250 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+#include <kos.h>
+#include <string.h>
+
+#include "kos_am335x_io.h"
+
+#define VISUALIZE_STARTUP
+
+#define MIN_ARGC 3
+#define GPIO_PROTOCOL_NAME_IDX 1
+#define PWM_PROTOCOL_NAME_IDX 2
+#define FIRST_OPTION_IDX 3
+#define MAX_ARGC 32
+
+// Options with this prefix are given to the PWM service without it, e.g.
+// "pwm_status_frame=0x4030c000", the other options go to the GPIO service
+#define PWM_OPTION_PREFIX "pwm_"
+
+#define IO_REQUEST_LABEL (~0)
+
+// A batch may hold requests for both services, it is sent under either badge
+// with a label past those of both services. Each operation is the service it
+// is for followed by the label and param of a register-only request, see
+// gpio_service_register_only() and pwm_service_register_only(). The reply is
+// the number of operations that succeeded followed by the reply param of each
+// of them, and the status of the one that failed if any did.
+#define IO_BATCH_REQUEST 0x100
+#define IO_BATCH_GPIO 0
+#define IO_BATCH_PWM 1
+#define IO_BATCH_OP_WORDS 3
+#define IO_MAX_BATCH_OPS 64
+
+static kos_thread_mgr_entry_t root_manager_entries[IO_NUM_THREADS];
+static kos_thread_mgr_t root_thread_mgr;
+
+static char *gpio_protocol_name;
+static char *pwm_protocol_name;
+
+static kos_thread_t listener_thread;
+static kos_msg_server_t server;
+
+static kos_msg_t handle_batch(kos_msg_t msg, seL4_Word caller_id) {
+  seL4_Word payload_size = kos_msg_payload_size(msg.metadata);
+  seL4_Word num_ops = payload_size / (sizeof(uint32_t) * IO_BATCH_OP_WORDS);
+
+  if (payload_size % (sizeof(uint32_t) * IO_BATCH_OP_WORDS) != 0 || num_ops == 0 || num_ops > IO_MAX_BATCH_OPS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+  uint32_t results[IO_MAX_BATCH_OPS + 1];
+  seL4_Word num_succeeded = 0;
+  seL4_Word num_results = 1;
+
+  // Each service checks the caller against its own client, as it would for
+  // the request on its own
+  for (seL4_Word i = 0; i < num_ops; i++) {
+    uint32_t *p_op = &transport[i * IO_BATCH_OP_WORDS];
+    kos_msg_t request = kos_msg_new(p_op[1], p_op[2], 0, 0, 0);
+    kos_msg_t reply;
+
+    if (p_op[0] == IO_BATCH_GPIO && gpio_service_register_only(p_op[1])) {
+      reply = gpio_service_dispatch(request, GPIO_PROTOCOL_BADGE, caller_id);
+    } else if (p_op[0] == IO_BATCH_PWM && pwm_service_register_only(p_op[1])) {
+      reply = pwm_service_dispatch(request, IO_PWM_PROTOCOL_BADGE, caller_id);
+    } else {
+      reply = kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
+    }
+
+    if (reply.label != STATUS_OK) {
+      results[num_results++] = reply.label;
+      break;
+    }
+
+    results[num_results++] = reply.param;
+    num_succeeded++;
+  }
+
+  results[0] = num_succeeded;
+  memcpy(transport, results, sizeof(uint32_t) * num_results);
+
+  // A batch that failed part way is still a successful reply
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * num_results, 0, 0);
+}
+
+static void listen_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word arg) {
+  (void) arg;
+
+  // Publish both protocols on the one endpoint, the badge tells them apart
+  kos_assert_ok(
+    kos_dir_publish_str(
+      gpio_protocol_name,
+      IO_REQUEST_LABEL,
+      GPIO_PROTOCOL_BADGE,
+      KOS_MSG_FLAG_SEND_PAYLOAD
+    ),
+    "failed to publish AM335X GPIO protocol"
+  );
+
+  kos_assert_ok(
+    kos_dir_publish_str(
+      pwm_protocol_name,
+      IO_REQUEST_LABEL,
+      IO_PWM_PROTOCOL_BADGE,
+      KOS_MSG_FLAG_SEND_PAYLOAD
+    ),
+    "failed to publish AM335X PWM protocol"
+  );
+
+  // Signal that we are done initializing
+  kos_app_ready();
+
+  // Prepare to receive caps
+  kos_cap_t receive_cap = kos_cnode_cap(p_env->p_cnode, KOS_THREAD_SLOT_RECEIVE);
+  kos_cap_set_receive(receive_cap);
+
+  // Prepare the reply cap
+  kos_cap_t reply_cap = kos_cnode_cap(p_env->p_cnode, KOS_THREAD_SLOT_REPLY);
+
+  // A slot to hold the transport
+  kos_cap_t server_cap = kos_cap_reserve();
+
+  // Set up the server transport
+  kos_assert_created(
+    kos_msg_server_create(
+      server_cap,
+      reply_cap, // IN kos_cap_t reply_cap,
+      IO_RECEIVE_TOKEN_SLOT, // IN kos_token_t receive_token_slot,
+      &server // OUT kos_msg_server_t* p_server
+    ),
+    NULL
+  );
+
+  // No longer need to receive caps.
+  kos_cap_clear_receive();
+
+  // Initial status is OK
+  kos_msg_t msg = kos_msg_new_status(STATUS_OK);
+
+  while (true) {
+    seL4_Word badge;
+    seL4_Word seL4_badge;
+    seL4_Word caller_id;
+
+    seL4_SetMR(0, msg.label);
+    seL4_SetMR(1, msg.param);
+    seL4_SetMR(2, msg.metadata);
+    seL4_MessageInfo_t sel4_msg = seL4_ReplyRecv(
+      server.transport.ep_cptr,
+      seL4_MessageInfo_new(STATUS_OK, 0, 0, 3),
+      &seL4_badge,
+      server.reply_cptr);
+
+    // fill out the message struct
+    msg.label = seL4_GetMR(0);
+    msg.param = seL4_GetMR(1);
+    msg.metadata = seL4_GetMR(2);
+    badge = seL4_GetMR(3);
+
+    caller_id = seL4_MessageInfo_get_label(sel4_msg);
+
+    // Each service checks the badge again and refuses the ones it doesn't know
+    if (msg.label == IO_BATCH_REQUEST && (badge == GPIO_PROTOCOL_BADGE || badge == IO_PWM_PROTOCOL_BADGE)) {
+      msg = handle_batch(msg, caller_id);
+    } else if (badge == IO_PWM_PROTOCOL_BADGE) {
+      msg = pwm_service_dispatch(msg, badge, caller_id);
+    } else {
+      msg = gpio_service_dispatch(msg, badge, caller_id);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+#ifdef VISUALIZE_STARTUP
+  kos_printf("\n");
+  kos_printf("----  %s server ----\n", argv[0]);
+#endif
+
+  kos_assert_eq(argc >= MIN_ARGC, true, "unexpected argument counts");
+  kos_assert_eq(argc <= MAX_ARGC, true, "unexpected argument counts");
+
+  gpio_protocol_name = argv[GPIO_PROTOCOL_NAME_IDX];
+  pwm_protocol_name = argv[PWM_PROTOCOL_NAME_IDX];
+
+  // Give each service the arguments it would get as its own app
+  static char *gpio_argv[MAX_ARGC];
+  static char *pwm_argv[MAX_ARGC];
+  int gpio_argc = 0;
+  int pwm_argc = 0;
+
+  gpio_argv[gpio_argc++] = argv[0];
+  gpio_argv[gpio_argc++] = gpio_protocol_name;
+  pwm_argv[pwm_argc++] = argv[0];
+  pwm_argv[pwm_argc++] = pwm_protocol_name;
+
+  for (int i = FIRST_OPTION_IDX; i < argc; i++) {
+    if (strncmp(argv[i], PWM_OPTION_PREFIX, strlen(PWM_OPTION_PREFIX)) == 0) {
+      pwm_argv[pwm_argc++] = argv[i] + strlen(PWM_OPTION_PREFIX);
+    } else {
+      gpio_argv[gpio_argc++] = argv[i];
+    }
+  }
+
+  // Initialize the thread manager, the services add their threads to it
+  kos_assert_ok(
+    kos_thread_mgr_init(
+      root_manager_entries, // IN_OUT kos_thread_mgr_entry_t* p_entries,
+      IO_NUM_THREADS, // IN seL4_Word capacity,
+      &root_thread_mgr // OUT kos_thread_mgr_t* p_thread_mgr
+    ),
+    NULL
+  );
+
+  // Bootstrap the message server connection
+  kos_assert_created(kos_msg_setup(), NULL);
+
+  gpio_service_start(gpio_argc, gpio_argv, &root_thread_mgr);
+  pwm_service_start(pwm_argc, pwm_argv, &root_thread_mgr);
+
+  // Create and start the listener thread
+  kos_assert_created(
+    kos_thread_create(listen_thread_fn, 0, false, &listener_thread),
+    "failed to create listener thread"
+  );
+
+  kos_assert_ok(
+    kos_thread_mgr_add(
+      &root_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+      &listener_thread, // IN_OUT kos_thread_t* p_thread,
+      KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
+      IO_LISTENER_COOKIE, // IN seL4_Word cookie,
+      kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
+      NULL // OPTIONAL OUT seL4_Word* p_id
+    ),
+    "failed to add listener thread to the thread manager"
+  );
+
+  kos_assert_ok(
+    kos_thread_start(&listener_thread), // IN_OUT kos_thread_t* p_thread,
+    "failed to start listener thread"
+  );
+
+  // Run app-level thread manager handler directly on this thread,
+  // this should never return
+  kos_thread_mgr_direct_handler(&root_thread_mgr);
+  kos_stop("KOS am335x I/O server exited unexpectedly");
+  return 0;
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+// Entry points of the GPIO and PWM services when they are built into the
+// combined I/O service with KOS_AM335X_IO defined. The I/O service owns the
+// thread manager and the endpoint that the default GPIO protocol and the PWM
+// protocol are both published on, and hands each request to the service its
+// badge belongs to.
+
+#ifndef _KOS_AM335X_IO_H_
+#define _KOS_AM335X_IO_H_
+
+#include <kos.h>
+
+#include "gpio_protocol.h"
+
+// The GPIO protocol is served under the default GPIO listener's badge and
+// receive token slot, the PWM protocol under the first ones the GPIO service
+// leaves free
+#define IO_RECEIVE_TOKEN_SLOT GPIO_RECEIVE_TOKEN_SLOT(0)
+
+#define IO_PWM_PROTOCOL_BADGE GPIO_FIRST_FREE_BADGE
+#define IO_PWM_TRANSFER_TOKEN_SLOT GPIO_FIRST_FREE_TOKEN_SLOT
+
+// The listener and the event trigger, encoder, capture and trip zone
+// interrupt threads
+#define IO_PWM_NUM_THREADS 5
+
+// Both services start all their threads but their listener, which the I/O
+// service's own listener replaces
+#define IO_NUM_THREADS ((GPIO_NUM_THREADS - 1) + (IO_PWM_NUM_THREADS - 1) + 1)
+
+// Thread manager cookies, the GPIO threads keep the ones they have in their
+// own app and the PWM threads and the I/O listener follow them
+#define IO_PWM_FIRST_COOKIE GPIO_NUM_THREADS
+#define IO_LISTENER_COOKIE (IO_PWM_FIRST_COOKIE + IO_PWM_NUM_THREADS)
+
+// Map the controllers and start every thread of the service but the listener
+// of the protocol served by the I/O service
+void gpio_service_start(int argc, char *argv[], kos_thread_mgr_t *p_io_thread_mgr);
+void pwm_service_start(int argc, char *argv[], kos_thread_mgr_t *p_io_thread_mgr);
+
+// Serve a request on the I/O service's endpoint and return the reply
+kos_msg_t gpio_service_dispatch(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id);
+kos_msg_t pwm_service_dispatch(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id);
+
+// Whether a request carries its arguments in the param and replies in the
+// param, without touching the IPC buffer, so it can be part of an I/O batch
+bool gpio_service_register_only(seL4_Word label);
+bool pwm_service_register_only(seL4_Word label);
+
+#endif
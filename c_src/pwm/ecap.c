@@ -0,0 +1,440 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+/**
+ *  \file   ecap.c
+ *
+ *  \brief  This file contains the device abstraction layer APIs for ECAP,
+ *          following the APIs of the StarterWare ECAP driver.
+ */
+
+/* HW Macros */
+#include "hw_types.h"
+/* Driver APIs */
+#include "ecap.h"
+#include "hw_pwmss.h"
+
+/**
+ * \brief   This API selects whether the ECAP module runs in capture mode or
+ *          in auxiliary PWM mode.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   modeSelect    Operating mode.
+ *                        Possible values are:
+ *                        - ECAP_CAPTURE_MODE
+ *                        - ECAP_APWM_MODE
+ *
+ * \return  None
+ *
+ **/
+void ECAPOperatingModeSelect(unsigned int baseAdd, unsigned int modeSelect)
+{
+    HWREGH(baseAdd + ECAP_ECCTL2) = (HWREGH(baseAdd + ECAP_ECCTL2) &
+                                     (~ECAP_ECCTL2_CAP_APWM)) |
+                                    (modeSelect & ECAP_ECCTL2_CAP_APWM);
+}
+
+/**
+ * \brief   This API configures the prescaler of the capture input.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   prescale      Input is divided by 2 * prescale, 0 bypasses the
+ *                        prescaler.
+ *
+ * \return  None
+ *
+ **/
+void ECAPPrescaleConfig(unsigned int baseAdd, unsigned int prescale)
+{
+    HWREGH(baseAdd + ECAP_ECCTL1) = (HWREGH(baseAdd + ECAP_ECCTL1) &
+                                     (~ECAP_ECCTL1_PRESCALE)) |
+                                    ((prescale << ECAP_ECCTL1_PRESCALE_SHIFT) &
+                                     ECAP_ECCTL1_PRESCALE);
+}
+
+/**
+ * \brief   This API enables loading of the capture registers on capture
+ *          events.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ *
+ * \return  None
+ *
+ **/
+void ECAPCaptureLoadingEnable(unsigned int baseAdd)
+{
+    HWREGH(baseAdd + ECAP_ECCTL1) |= ECAP_ECCTL1_CAPLDEN;
+}
+
+/**
+ * \brief   This API disables loading of the capture registers on capture
+ *          events.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ *
+ * \return  None
+ *
+ **/
+void ECAPCaptureLoadingDisable(unsigned int baseAdd)
+{
+    HWREGH(baseAdd + ECAP_ECCTL1) &= (~ECAP_ECCTL1_CAPLDEN);
+}
+
+/**
+ * \brief   This API selects the edge that triggers each capture event.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   capEvt1pol    Polarity of capture event 1.
+ * \param   capEvt2pol    Polarity of capture event 2.
+ * \param   capEvt3pol    Polarity of capture event 3.
+ * \param   capEvt4pol    Polarity of capture event 4.
+ *                        Possible values are:
+ *                        - ECAP_CAPTURE_RISING_EDGE
+ *                        - ECAP_CAPTURE_FALLING_EDGE
+ *
+ * \return  None
+ *
+ **/
+void ECAPCapeEvtPolarityConfig(unsigned int baseAdd, unsigned int capEvt1pol,
+		unsigned int capEvt2pol, unsigned int capEvt3pol,
+		unsigned int capEvt4pol)
+{
+    HWREGH(baseAdd + ECAP_ECCTL1) &= (~(ECAP_ECCTL1_CAP1POL | ECAP_ECCTL1_CAP2POL |
+                                        ECAP_ECCTL1_CAP3POL | ECAP_ECCTL1_CAP4POL));
+
+    HWREGH(baseAdd + ECAP_ECCTL1) |= ((capEvt1pol << ECAP_ECCTL1_CAP1POL_SHIFT) |
+                                      (capEvt2pol << ECAP_ECCTL1_CAP2POL_SHIFT) |
+                                      (capEvt3pol << ECAP_ECCTL1_CAP3POL_SHIFT) |
+                                      (capEvt4pol << ECAP_ECCTL1_CAP4POL_SHIFT));
+}
+
+/**
+ * \brief   This API selects whether the time-stamp counter is reset after
+ *          each capture event, i.e. whether the capture registers hold the
+ *          time since the previous event (delta mode) or absolute times.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   CounterRst1   Reset the counter after capture event 1.
+ * \param   CounterRst2   Reset the counter after capture event 2.
+ * \param   CounterRst3   Reset the counter after capture event 3.
+ * \param   CounterRst4   Reset the counter after capture event 4.
+ *
+ * \return  None
+ *
+ **/
+void ECAPCaptureEvtCntrRstConfig(unsigned int baseAdd, bool CounterRst1,
+		bool CounterRst2, bool CounterRst3, bool CounterRst4)
+{
+    HWREGH(baseAdd + ECAP_ECCTL1) &= (~(ECAP_ECCTL1_CTRRST1 | ECAP_ECCTL1_CTRRST2 |
+                                        ECAP_ECCTL1_CTRRST3 | ECAP_ECCTL1_CTRRST4));
+
+    HWREGH(baseAdd + ECAP_ECCTL1) |= ((CounterRst1 << ECAP_ECCTL1_CTRRST1_SHIFT) |
+                                      (CounterRst2 << ECAP_ECCTL1_CTRRST2_SHIFT) |
+                                      (CounterRst3 << ECAP_ECCTL1_CTRRST3_SHIFT) |
+                                      (CounterRst4 << ECAP_ECCTL1_CTRRST4_SHIFT));
+}
+
+/**
+ * \brief   This API configures continuous capture, wrapping around to
+ *          capture event 1 after capture event 4.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ *
+ * \return  None
+ *
+ **/
+void ECAPContinousModeConfig(unsigned int baseAdd)
+{
+    HWREGH(baseAdd + ECAP_ECCTL2) = (HWREGH(baseAdd + ECAP_ECCTL2) &
+                                     (~ECAP_ECCTL2_CONT_ONESHT)) |
+                                    ECAP_ECCTL2_STOP_WRAP;
+}
+
+/**
+ * \brief   This API re-arms the capture sequence, so that the next capture
+ *          event is loaded into CAP1. Despite the name this applies to
+ *          continuous mode as well.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ *
+ * \return  None
+ *
+ **/
+void ECAPOneShotREARM(unsigned int baseAdd)
+{
+    HWREGH(baseAdd + ECAP_ECCTL2) |= ECAP_ECCTL2_REARM;
+}
+
+/**
+ * \brief   This API selects the behaviour of the ECAP on an emulation
+ *          suspend.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   mode          Emulation mode, e.g. ECAP_EMULATION_FREE_RUN.
+ *
+ * \return  None
+ *
+ **/
+void ECAPEmulationModeSet(unsigned int baseAdd, unsigned int mode)
+{
+    HWREGH(baseAdd + ECAP_ECCTL1) = (HWREGH(baseAdd + ECAP_ECCTL1) &
+                                     (~ECAP_ECCTL1_FREE_SOFT)) |
+                                    (mode & ECAP_ECCTL1_FREE_SOFT);
+}
+
+/**
+ * \brief   This API selects the polarity of the APWM output.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   flag          Possible values are:
+ *                        - ECAP_APWM_ACTIVE_HIGH
+ *                        - ECAP_APWM_ACTIVE_LOW
+ *
+ * \return  None
+ *
+ **/
+void ECAPAPWMPolarityConfig(unsigned int baseAdd, unsigned int flag)
+{
+    HWREGH(baseAdd + ECAP_ECCTL2) = (HWREGH(baseAdd + ECAP_ECCTL2) &
+                                     (~ECAP_ECCTL2_APWMPOL)) |
+                                    (flag & ECAP_ECCTL2_APWMPOL);
+}
+
+/**
+ * \brief   This API loads the active compare and period registers of the
+ *          APWM. The output is active from a period match until a compare
+ *          match.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   compareVal    Compare value, 0 keeps the output inactive and
+ *                        anything above the period keeps it active.
+ * \param   periodVal     Period value, the period is periodVal + 1 counts.
+ *
+ * \return  None
+ *
+ **/
+void ECAPAPWMCaptureConfig(unsigned int baseAdd, unsigned int compareVal,
+		unsigned int periodVal)
+{
+    HWREG(baseAdd + ECAP_CAP1) = periodVal;
+    HWREG(baseAdd + ECAP_CAP2) = compareVal;
+}
+
+/**
+ * \brief   This API loads the shadow compare and period registers of the
+ *          APWM, these become active at the next period match.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   compareVal    Compare value.
+ * \param   periodVal     Period value.
+ *
+ * \return  None
+ *
+ **/
+void ECAPAPWMShadowCaptureConfig(unsigned int baseAdd, unsigned int compareVal,
+		unsigned int periodVal)
+{
+    HWREG(baseAdd + ECAP_CAP3) = periodVal;
+    HWREG(baseAdd + ECAP_CAP4) = compareVal;
+}
+
+/**
+ * \brief   This API starts or stops the time-stamp counter.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   flag          Possible values are:
+ *                        - ECAP_COUNTER_STOP
+ *                        - ECAP_COUNTER_FREE_RUNNING
+ *
+ * \return  None
+ *
+ **/
+void ECAPCounterControl(unsigned int baseAdd, unsigned int flag)
+{
+    HWREGH(baseAdd + ECAP_ECCTL2) = (HWREGH(baseAdd + ECAP_ECCTL2) &
+                                     (~ECAP_ECCTL2_TSCTRSTOP)) |
+                                    (flag & ECAP_ECCTL2_TSCTRSTOP);
+}
+
+/**
+ * \brief   This API loads the time-stamp counter.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   countVal      Value to load into the counter.
+ *
+ * \return  None
+ *
+ **/
+void ECAPCounterConfig(unsigned int baseAdd, unsigned int countVal)
+{
+    HWREG(baseAdd + ECAP_TSCTR) = countVal;
+}
+
+/**
+ * \brief   This API configures the sync-in and sync-out of the module.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   syncIn        Load the counter from CTRPHS on a sync-in event.
+ * \param   syncOut       Sync-out selection, e.g. ECAP_SYNC_OUT_DISABLE.
+ *
+ * \return  None
+ *
+ **/
+void ECAPSyncInOutSelect(unsigned int baseAdd, bool syncIn,
+		unsigned int syncOut)
+{
+    HWREGH(baseAdd + ECAP_ECCTL2) &= (~(ECAP_ECCTL2_SYNCI_EN | ECAP_ECCTL2_SYNCO_SEL));
+
+    HWREGH(baseAdd + ECAP_ECCTL2) |= ((syncIn << ECAP_ECCTL2_SYNCI_EN_SHIFT) |
+                                      (syncOut & ECAP_ECCTL2_SYNCO_SEL));
+}
+
+/**
+ * \brief   This API returns the time-stamp of a capture event.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   capEvtFlag    Capture event, ECAP_CAPTURE_EVENT_1 to
+ *                        ECAP_CAPTURE_EVENT_4.
+ *
+ * \return  Captured time-stamp.
+ *
+ **/
+unsigned int ECAPTimeStampRead(unsigned int baseAdd, unsigned int capEvtFlag)
+{
+    return HWREG(baseAdd + capEvtFlag);
+}
+
+/**
+ * \brief   This API enables interrupts.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   flag          Interrupts to enable, e.g. ECAP_INT_CEVT4.
+ *
+ * \return  None
+ *
+ **/
+void ECAPIntEnable(unsigned int baseAdd, unsigned int flag)
+{
+    HWREGH(baseAdd + ECAP_ECEINT) |= (flag & (~ECAP_INT_INT));
+}
+
+/**
+ * \brief   This API disables interrupts.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   flag          Interrupts to disable, e.g. ECAP_INT_CEVT4.
+ *
+ * \return  None
+ *
+ **/
+void ECAPIntDisable(unsigned int baseAdd, unsigned int flag)
+{
+    HWREGH(baseAdd + ECAP_ECEINT) &= (~flag);
+}
+
+/**
+ * \brief   This API returns the selected interrupt flags.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   flag          Interrupt flags to return.
+ *
+ * \return  Selected interrupt flags.
+ *
+ **/
+unsigned int ECAPIntStatus(unsigned int baseAdd, unsigned int flag)
+{
+    return HWREGH(baseAdd + ECAP_ECFLG) & flag;
+}
+
+/**
+ * \brief   This API clears interrupt flags.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   flag          Interrupt flags to clear.
+ *
+ * \return  None
+ *
+ * \note    The global interrupt flag is cleared as well, no further
+ *          interrupts are generated until it is.
+ *
+ **/
+void ECAPIntStatusClear(unsigned int baseAdd, unsigned int flag)
+{
+    HWREGH(baseAdd + ECAP_ECCLR) = flag | ECAP_INT_INT;
+}
+
+/**
+ * \brief   This functions enables clock for ECAP module in PWMSS subsystem.
+ *
+ * \param   baseAdd   It is the Memory address of the PWMSS instance used.
+ *
+ * \return  None.
+ *
+ **/
+void ECAPClockEnable(unsigned int baseAdd)
+{
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) &= ~PWMSS_ECAP_CLK_STOP_ACK;
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) |= PWMSS_ECAP_CLK_EN_ACK;
+}
+
+/**
+ * \brief   This functions disables clock for ECAP module in PWMSS subsystem.
+ *
+ * \param   baseAdd   It is the Memory address of the PWMSS instance used.
+ *
+ * \return  None.
+ *
+ **/
+void ECAPClockDisable(unsigned int baseAdd)
+{
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) &= ~PWMSS_ECAP_CLK_EN_ACK;
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) |= PWMSS_ECAP_CLK_STOP_ACK;
+}
+
+/**
+ * \brief   This API saves the context of the ECAP module.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   contextPtr    Pointer to the structure where the ECAP context
+ *                        need to be saved.
+ *
+ * \return  None.
+ *
+ * \note    CAP1 and CAP2 only hold configuration in APWM mode, where they
+ *          are the period and compare registers.
+ *
+ **/
+void ECAPContextSave(unsigned int baseAdd, ECAPCONTEXT *contextPtr)
+{
+    contextPtr->ctrphs = HWREG(baseAdd + ECAP_CTRPHS);
+    contextPtr->cap1 = HWREG(baseAdd + ECAP_CAP1);
+    contextPtr->cap2 = HWREG(baseAdd + ECAP_CAP2);
+    contextPtr->ecctl1 = HWREGH(baseAdd + ECAP_ECCTL1);
+    contextPtr->ecctl2 = HWREGH(baseAdd + ECAP_ECCTL2);
+    contextPtr->eceint = HWREGH(baseAdd + ECAP_ECEINT);
+}
+
+/**
+ * \brief   This API restores the context of the ECAP module.
+ *
+ * \param   baseAdd       Base Address of the ECAP Module Registers.
+ * \param   contextPtr    Pointer to the structure where the ECAP context
+ *                        need to be restored from.
+ *
+ * \return  None.
+ *
+ * \note    ECCTL2 is restored last so that the counter only starts once
+ *          everything else is in place.
+ *
+ **/
+void ECAPContextRestore(unsigned int baseAdd, ECAPCONTEXT *contextPtr)
+{
+    HWREG(baseAdd + ECAP_CTRPHS) = contextPtr->ctrphs;
+    HWREGH(baseAdd + ECAP_ECCTL1) = contextPtr->ecctl1;
+    HWREGH(baseAdd + ECAP_ECEINT) = contextPtr->eceint;
+    HWREGH(baseAdd + ECAP_ECCTL2) = contextPtr->ecctl2 & (~ECAP_ECCTL2_TSCTRSTOP);
+    HWREG(baseAdd + ECAP_CAP1) = contextPtr->cap1;
+    HWREG(baseAdd + ECAP_CAP2) = contextPtr->cap2;
+    HWREGH(baseAdd + ECAP_ECCTL2) = contextPtr->ecctl2;
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+/**
+ *  \file   ecap.h
+ *
+ *  \brief  This file contains the function prototypes for the device
+ *          abstraction layer for ECAP. It follows the APIs of the StarterWare
+ *          ECAP driver.
+ */
+
+#ifndef _ECAP_H_
+#define _ECAP_H_
+
+#include <stdbool.h>
+#include "hw_ecap.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Capture events */
+#define ECAP_CAPTURE_EVENT_1		ECAP_CAP1
+#define ECAP_CAPTURE_EVENT_2		ECAP_CAP2
+#define ECAP_CAPTURE_EVENT_3		ECAP_CAP3
+#define ECAP_CAPTURE_EVENT_4		ECAP_CAP4
+
+/* Capture event polarity */
+#define ECAP_CAPTURE_RISING_EDGE	0
+#define ECAP_CAPTURE_FALLING_EDGE	1
+
+/* Operating mode */
+#define ECAP_CAPTURE_MODE		0
+#define ECAP_APWM_MODE			ECAP_ECCTL2_CAP_APWM
+
+/* APWM output polarity */
+#define ECAP_APWM_ACTIVE_HIGH		0
+#define ECAP_APWM_ACTIVE_LOW		ECAP_ECCTL2_APWMPOL
+
+/* Counter control */
+#define ECAP_COUNTER_STOP		0
+#define ECAP_COUNTER_FREE_RUNNING	ECAP_ECCTL2_TSCTRSTOP
+
+/* Sync out selection */
+#define ECAP_SYNC_OUT_DISABLE		(ECAP_ECCTL2_SYNCO_SEL_DISABLE << \
+							ECAP_ECCTL2_SYNCO_SEL_SHIFT)
+
+/* Emulation mode */
+#define ECAP_EMULATION_FREE_RUN		(ECAP_ECCTL1_FREE_SOFT_FREERUN << \
+							ECAP_ECCTL1_FREE_SOFT_SHIFT)
+
+/* Structure to save the ECAP context */
+typedef struct ecapContext {
+    unsigned int ctrphs;
+    unsigned int cap1;
+    unsigned int cap2;
+    unsigned short ecctl1;
+    unsigned short ecctl2;
+    unsigned short eceint;
+}ECAPCONTEXT;
+
+/* Capture configuration */
+void ECAPOperatingModeSelect(unsigned int baseAdd, unsigned int modeSelect);
+void ECAPPrescaleConfig(unsigned int baseAdd, unsigned int prescale);
+void ECAPCaptureLoadingEnable(unsigned int baseAdd);
+void ECAPCaptureLoadingDisable(unsigned int baseAdd);
+void ECAPCapeEvtPolarityConfig(unsigned int baseAdd, unsigned int capEvt1pol,
+		unsigned int capEvt2pol, unsigned int capEvt3pol,
+		unsigned int capEvt4pol);
+void ECAPCaptureEvtCntrRstConfig(unsigned int baseAdd, bool CounterRst1,
+		bool CounterRst2, bool CounterRst3, bool CounterRst4);
+void ECAPContinousModeConfig(unsigned int baseAdd);
+void ECAPOneShotREARM(unsigned int baseAdd);
+void ECAPEmulationModeSet(unsigned int baseAdd, unsigned int mode);
+
+/* APWM configuration */
+void ECAPAPWMPolarityConfig(unsigned int baseAdd, unsigned int flag);
+void ECAPAPWMCaptureConfig(unsigned int baseAdd, unsigned int compareVal,
+		unsigned int periodVal);
+void ECAPAPWMShadowCaptureConfig(unsigned int baseAdd, unsigned int compareVal,
+		unsigned int periodVal);
+
+/* Time-stamp counter */
+void ECAPCounterControl(unsigned int baseAdd, unsigned int flag);
+void ECAPCounterConfig(unsigned int baseAdd, unsigned int countVal);
+void ECAPSyncInOutSelect(unsigned int baseAdd, bool syncIn,
+		unsigned int syncOut);
+unsigned int ECAPTimeStampRead(unsigned int baseAdd, unsigned int capEvtFlag);
+
+/* Interrupts */
+void ECAPIntEnable(unsigned int baseAdd, unsigned int flag);
+void ECAPIntDisable(unsigned int baseAdd, unsigned int flag);
+unsigned int ECAPIntStatus(unsigned int baseAdd, unsigned int flag);
+void ECAPIntStatusClear(unsigned int baseAdd, unsigned int flag);
+
+/* Clock and context */
+void ECAPClockEnable(unsigned int baseAdd);
+void ECAPClockDisable(unsigned int baseAdd);
+void ECAPContextSave(unsigned int baseAdd, ECAPCONTEXT *contextPtr);
+void ECAPContextRestore(unsigned int baseAdd, ECAPCONTEXT *contextPtr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
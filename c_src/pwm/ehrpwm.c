@@ -1241,3 +1241,64 @@ unsigned int EHRPWMClockDisableStatusGet(unsigned int baseAdd)
     return status;
 }
 
+/**
+ * \brief   This API saves the context of the EHRPWM module.
+ *
+ * \param   baseAddr      Base Address of the PWM Module Registers.
+ * \param   contextPtr    Pointer to the structure where the EHRPWM context
+ *                        need to be saved.
+ *
+ * \return  None.
+ *
+ **/
+void EHRPWMContextSave(unsigned int baseAddr, EHRPWMCONTEXT *contextPtr)
+{
+    contextPtr->tbctl = HWREGH(baseAddr + EHRPWM_TBCTL);
+    contextPtr->tbprd = HWREGH(baseAddr + EHRPWM_TBPRD);
+    contextPtr->cmpctl = HWREGH(baseAddr + EHRPWM_CMPCTL);
+    contextPtr->cmpa = HWREGH(baseAddr + EHRPWM_CMPA);
+    contextPtr->cmpb = HWREGH(baseAddr + EHRPWM_CMPB);
+    contextPtr->aqctla = HWREGH(baseAddr + EHRPWM_AQCTLA);
+    contextPtr->aqctlb = HWREGH(baseAddr + EHRPWM_AQCTLB);
+    contextPtr->aqcsfrc = HWREGH(baseAddr + EHRPWM_AQCSFRC);
+    contextPtr->dbctl = HWREGH(baseAddr + EHRPWM_DBCTL);
+    contextPtr->pcctl = HWREGH(baseAddr + EHRPWM_PCCTL);
+    contextPtr->tzsel = HWREGH(baseAddr + EHRPWM_TZSEL);
+    contextPtr->tzctl = HWREGH(baseAddr + EHRPWM_TZCTL);
+    contextPtr->etsel = HWREGH(baseAddr + EHRPWM_ETSEL);
+    contextPtr->etps = HWREGH(baseAddr + EHRPWM_ETPS);
+    contextPtr->hrcnfg = HWREGH(baseAddr + EHRPWM_HRCNFG);
+}
+
+
+/**
+ * \brief   This API restores the context of the EHRPWM module.
+ *
+ * \param   baseAddr      Base Address of the PWM Module Registers.
+ * \param   contextPtr    Pointer to the structure where the EHRPWM context
+ *                        need to be restored from.
+ *
+ * \return  None.
+ *
+ * \note    The time-base control register is restored last so that the
+ *          counter only starts once everything else is in place.
+ *
+ **/
+void EHRPWMContextRestore(unsigned int baseAddr, EHRPWMCONTEXT *contextPtr)
+{
+    HWREGH(baseAddr + EHRPWM_TBPRD) = contextPtr->tbprd;
+    HWREGH(baseAddr + EHRPWM_CMPCTL) = contextPtr->cmpctl;
+    HWREGH(baseAddr + EHRPWM_CMPA) = contextPtr->cmpa;
+    HWREGH(baseAddr + EHRPWM_CMPB) = contextPtr->cmpb;
+    HWREGH(baseAddr + EHRPWM_AQCTLA) = contextPtr->aqctla;
+    HWREGH(baseAddr + EHRPWM_AQCTLB) = contextPtr->aqctlb;
+    HWREGH(baseAddr + EHRPWM_AQCSFRC) = contextPtr->aqcsfrc;
+    HWREGH(baseAddr + EHRPWM_DBCTL) = contextPtr->dbctl;
+    HWREGH(baseAddr + EHRPWM_PCCTL) = contextPtr->pcctl;
+    HWREGH(baseAddr + EHRPWM_TZSEL) = contextPtr->tzsel;
+    HWREGH(baseAddr + EHRPWM_TZCTL) = contextPtr->tzctl;
+    HWREGH(baseAddr + EHRPWM_ETSEL) = contextPtr->etsel;
+    HWREGH(baseAddr + EHRPWM_ETPS) = contextPtr->etps;
+    HWREGH(baseAddr + EHRPWM_HRCNFG) = contextPtr->hrcnfg;
+    HWREGH(baseAddr + EHRPWM_TBCTL) = contextPtr->tbctl;
+}
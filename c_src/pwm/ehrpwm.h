@@ -161,6 +161,25 @@ extern "C" {
 #define  EPWM   0x02
 #define  EQEP   0x03
 
+/* Structure to save the EHRPWM context */
+typedef struct ehrpwmContext{
+    unsigned short tbctl;
+    unsigned short tbprd;
+    unsigned short cmpctl;
+    unsigned short cmpa;
+    unsigned short cmpb;
+    unsigned short aqctla;
+    unsigned short aqctlb;
+    unsigned short aqcsfrc;
+    unsigned short dbctl;
+    unsigned short pcctl;
+    unsigned short tzsel;
+    unsigned short tzctl;
+    unsigned short etsel;
+    unsigned short etps;
+    unsigned short hrcnfg;
+}EHRPWMCONTEXT;
+
 
 
 //**********************************************************************
@@ -256,6 +275,8 @@ void EHRPWMClockEnable(unsigned int baseAdd);
 void EHRPWMClockDisable(unsigned int baseAdd);
 unsigned int EHRPWMClockEnableStatusGet(unsigned int baseAdd);
 unsigned int EHRPWMClockDisableStatusGet(unsigned int baseAdd);
+void EHRPWMContextSave(unsigned int baseAddr, EHRPWMCONTEXT *contextPtr);
+void EHRPWMContextRestore(unsigned int baseAddr, EHRPWMCONTEXT *contextPtr);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,389 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+/**
+ *  \file   eqep.c
+ *
+ *  \brief  This file contains the device abstraction layer APIs for EQEP,
+ *          written in the style of the StarterWare EHRPWM APIs.
+ */
+
+/* HW Macros */
+#include "hw_types.h"
+/* Driver APIs */
+#include "eqep.h"
+#include "hw_pwmss.h"
+
+/**
+ * \brief   This API configures the quadrature decoder unit.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   source        Source of the position counter clock and direction.
+ *                        Possible values are:
+ *                        - EQEP_SOURCE_QUADRATURE
+ *                        - EQEP_SOURCE_DIRECTION
+ * \param   swapInputs    Swap the QEPA and QEPB inputs, which reverses the
+ *                        counting direction.
+ *
+ * \return  None
+ *
+ **/
+void EQEPDecoderConfigure(unsigned int baseAddr, unsigned int source,
+		bool swapInputs)
+{
+    unsigned short qdecctl = source & EQEP_QDECCTL_QSRC;
+
+    if (swapInputs)
+    {
+        qdecctl |= EQEP_QDECCTL_SWAP;
+    }
+
+    HWREGH(baseAddr + EQEP_QDECCTL) = qdecctl;
+}
+
+/**
+ * \brief   This API configures the position counter, leaving it disabled.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   resetMode     Event on which the position counter is reset.
+ *                        Possible values are:
+ *                        - EQEP_POSITION_RESET_INDEX
+ *                        - EQEP_POSITION_RESET_MAXPOS
+ *                        - EQEP_POSITION_RESET_FIRSTINDEX
+ *                        - EQEP_POSITION_RESET_UNITTIME
+ * \param   maxPosition   Maximum value of the position counter.
+ * \param   indexLatch    Edge of the index input on which the position
+ *                        counter is latched into QPOSILAT.
+ *                        Possible values are:
+ *                        - EQEP_INDEX_LATCH_RISING
+ *                        - EQEP_INDEX_LATCH_FALLING
+ *
+ * \return  None
+ *
+ **/
+void EQEPPositionCounterConfigure(unsigned int baseAddr, unsigned int resetMode,
+		unsigned int maxPosition, unsigned int indexLatch)
+{
+    HWREGH(baseAddr + EQEP_QEPCTL) &= (~(EQEP_QEPCTL_QPEN | EQEP_QEPCTL_PCRM |
+                                         EQEP_QEPCTL_IEL));
+
+    HWREG(baseAddr + EQEP_QPOSMAX) = maxPosition;
+    HWREG(baseAddr + EQEP_QPOSINIT) = 0;
+
+    HWREGH(baseAddr + EQEP_QEPCTL) |= (resetMode & EQEP_QEPCTL_PCRM) |
+                                      (indexLatch & EQEP_QEPCTL_IEL);
+}
+
+/**
+ * \brief   This API enables the position counter.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ *
+ * \return  None
+ *
+ **/
+void EQEPPositionCounterEnable(unsigned int baseAddr)
+{
+    HWREGH(baseAddr + EQEP_QEPCTL) |= EQEP_QEPCTL_QPEN;
+}
+
+/**
+ * \brief   This API disables the position counter, which also resets the
+ *          internal state of the decoder.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ *
+ * \return  None
+ *
+ **/
+void EQEPPositionCounterDisable(unsigned int baseAddr)
+{
+    HWREGH(baseAddr + EQEP_QEPCTL) &= (~EQEP_QEPCTL_QPEN);
+}
+
+/**
+ * \brief   This API returns whether the position counter is enabled.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ *
+ * \return  true if the position counter is enabled.
+ *
+ **/
+bool EQEPPositionCounterEnabled(unsigned int baseAddr)
+{
+    return (HWREGH(baseAddr + EQEP_QEPCTL) & EQEP_QEPCTL_QPEN) != 0;
+}
+
+/**
+ * \brief   This API returns the position counter.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ *
+ * \return  Position counter value.
+ *
+ **/
+unsigned int EQEPPositionGet(unsigned int baseAddr)
+{
+    return HWREG(baseAddr + EQEP_QPOSCNT);
+}
+
+/**
+ * \brief   This API loads the position counter.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   position      Value to load into the position counter.
+ *
+ * \return  None
+ *
+ **/
+void EQEPPositionSet(unsigned int baseAddr, unsigned int position)
+{
+    HWREG(baseAddr + EQEP_QPOSCNT) = position;
+}
+
+/**
+ * \brief   This API returns the position counter value latched on the last
+ *          unit time out event, or on the last read of the position counter
+ *          if the unit timer does not control the latch.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ *
+ * \return  Latched position counter value.
+ *
+ **/
+unsigned int EQEPPositionLatchGet(unsigned int baseAddr)
+{
+    return HWREG(baseAddr + EQEP_QPOSLAT);
+}
+
+/**
+ * \brief   This API returns the position counter value latched on the last
+ *          index event.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ *
+ * \return  Index latched position counter value.
+ *
+ **/
+unsigned int EQEPIndexLatchGet(unsigned int baseAddr)
+{
+    return HWREG(baseAddr + EQEP_QPOSILAT);
+}
+
+/**
+ * \brief   This API selects the behaviour of the EQEP on an emulation
+ *          suspend.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   mode          Emulation mode, e.g. EQEP_EMULATION_FREE_RUN.
+ *
+ * \return  None
+ *
+ **/
+void EQEPEmulationModeSet(unsigned int baseAddr, unsigned int mode)
+{
+    HWREGH(baseAddr + EQEP_QEPCTL) = (HWREGH(baseAddr + EQEP_QEPCTL) &
+                                      (~EQEP_QEPCTL_FREE_SOFT)) |
+                                     (mode & EQEP_QEPCTL_FREE_SOFT);
+}
+
+/**
+ * \brief   This API enables the unit timer. On every unit time out the
+ *          position counter is latched into QPOSLAT and the UTO flag is set.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   period        Unit timer period in SYSCLKOUT cycles.
+ *
+ * \return  None
+ *
+ **/
+void EQEPUnitTimerEnable(unsigned int baseAddr, unsigned int period)
+{
+    HWREGH(baseAddr + EQEP_QEPCTL) &= (~EQEP_QEPCTL_UTE);
+
+    HWREG(baseAddr + EQEP_QUPRD) = period;
+    HWREG(baseAddr + EQEP_QUTMR) = 0;
+
+    HWREGH(baseAddr + EQEP_QEPCTL) |= (EQEP_QEPCTL_QCLM | EQEP_QEPCTL_UTE);
+}
+
+/**
+ * \brief   This API disables the unit timer.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ *
+ * \return  None
+ *
+ **/
+void EQEPUnitTimerDisable(unsigned int baseAddr)
+{
+    HWREGH(baseAddr + EQEP_QEPCTL) &= (~(EQEP_QEPCTL_QCLM | EQEP_QEPCTL_UTE));
+}
+
+/**
+ * \brief   This API returns the selected bits of the status register.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   flags         Status bits to return, e.g. EQEP_QEPSTS_QDF.
+ *
+ * \return  Selected status bits.
+ *
+ **/
+unsigned int EQEPStatusGet(unsigned int baseAddr, unsigned int flags)
+{
+    return HWREGH(baseAddr + EQEP_QEPSTS) & flags;
+}
+
+/**
+ * \brief   This API clears the sticky bits of the status register.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   flags         Sticky status bits to clear, e.g. EQEP_QEPSTS_PCEF.
+ *
+ * \return  None
+ *
+ **/
+void EQEPStatusClear(unsigned int baseAddr, unsigned int flags)
+{
+    HWREGH(baseAddr + EQEP_QEPSTS) = flags;
+}
+
+/**
+ * \brief   This API enables interrupts.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   intFlags      Interrupts to enable, e.g. EQEP_INT_UTO.
+ *
+ * \return  None
+ *
+ **/
+void EQEPIntEnable(unsigned int baseAddr, unsigned int intFlags)
+{
+    HWREGH(baseAddr + EQEP_QEINT) |= (intFlags & (~EQEP_INT_INT));
+}
+
+/**
+ * \brief   This API disables interrupts.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   intFlags      Interrupts to disable, e.g. EQEP_INT_UTO.
+ *
+ * \return  None
+ *
+ **/
+void EQEPIntDisable(unsigned int baseAddr, unsigned int intFlags)
+{
+    HWREGH(baseAddr + EQEP_QEINT) &= (~intFlags);
+}
+
+/**
+ * \brief   This API returns the selected interrupt flags.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   intFlags      Interrupt flags to return.
+ *
+ * \return  Selected interrupt flags.
+ *
+ **/
+unsigned int EQEPIntStatus(unsigned int baseAddr, unsigned int intFlags)
+{
+    return HWREGH(baseAddr + EQEP_QFLG) & intFlags;
+}
+
+/**
+ * \brief   This API clears interrupt flags.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   intFlags      Interrupt flags to clear.
+ *
+ * \return  None
+ *
+ * \note    The global interrupt flag is cleared as well, no further
+ *          interrupts are generated until it is.
+ *
+ **/
+void EQEPIntClear(unsigned int baseAddr, unsigned int intFlags)
+{
+    HWREGH(baseAddr + EQEP_QCLR) = intFlags | EQEP_INT_INT;
+}
+
+/**
+ * \brief   This functions enables clock for EQEP module in PWMSS subsystem.
+ *
+ * \param   baseAdd   It is the Memory address of the PWMSS instance used.
+ *
+ * \return  None.
+ *
+ **/
+void EQEPClockEnable(unsigned int baseAdd)
+{
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) &= ~PWMSS_EQEP_CLK_STOP_ACK;
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) |= PWMSS_EQEP_CLK_EN_ACK;
+}
+
+/**
+ * \brief   This functions disables clock for EQEP module in PWMSS subsystem.
+ *
+ * \param   baseAdd   It is the Memory address of the PWMSS instance used.
+ *
+ * \return  None.
+ *
+ **/
+void EQEPClockDisable(unsigned int baseAdd)
+{
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) &= ~PWMSS_EQEP_CLK_EN_ACK;
+    HWREG(baseAdd + PWMSS_CLOCK_CONFIG) |= PWMSS_EQEP_CLK_STOP_ACK;
+}
+
+/**
+ * \brief   This API saves the context of the EQEP module.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   contextPtr    Pointer to the structure where the EQEP context
+ *                        need to be saved.
+ *
+ * \return  None.
+ *
+ **/
+void EQEPContextSave(unsigned int baseAddr, EQEPCONTEXT *contextPtr)
+{
+    contextPtr->qposinit = HWREG(baseAddr + EQEP_QPOSINIT);
+    contextPtr->qposmax = HWREG(baseAddr + EQEP_QPOSMAX);
+    contextPtr->qposcmp = HWREG(baseAddr + EQEP_QPOSCMP);
+    contextPtr->quprd = HWREG(baseAddr + EQEP_QUPRD);
+    contextPtr->qwdprd = HWREGH(baseAddr + EQEP_QWDPRD);
+    contextPtr->qdecctl = HWREGH(baseAddr + EQEP_QDECCTL);
+    contextPtr->qepctl = HWREGH(baseAddr + EQEP_QEPCTL);
+    contextPtr->qcapctl = HWREGH(baseAddr + EQEP_QCAPCTL);
+    contextPtr->qposctl = HWREGH(baseAddr + EQEP_QPOSCTL);
+    contextPtr->qeint = HWREGH(baseAddr + EQEP_QEINT);
+}
+
+/**
+ * \brief   This API restores the context of the EQEP module.
+ *
+ * \param   baseAddr      Base Address of the EQEP Module Registers.
+ * \param   contextPtr    Pointer to the structure where the EQEP context
+ *                        need to be restored from.
+ *
+ * \return  None.
+ *
+ * \note    The control register is restored last so that the position
+ *          counter only starts once everything else is in place. The
+ *          position itself is not part of the context.
+ *
+ **/
+void EQEPContextRestore(unsigned int baseAddr, EQEPCONTEXT *contextPtr)
+{
+    HWREG(baseAddr + EQEP_QPOSINIT) = contextPtr->qposinit;
+    HWREG(baseAddr + EQEP_QPOSMAX) = contextPtr->qposmax;
+    HWREG(baseAddr + EQEP_QPOSCMP) = contextPtr->qposcmp;
+    HWREG(baseAddr + EQEP_QUPRD) = contextPtr->quprd;
+    HWREGH(baseAddr + EQEP_QWDPRD) = contextPtr->qwdprd;
+    HWREGH(baseAddr + EQEP_QDECCTL) = contextPtr->qdecctl;
+    HWREGH(baseAddr + EQEP_QCAPCTL) = contextPtr->qcapctl;
+    HWREGH(baseAddr + EQEP_QPOSCTL) = contextPtr->qposctl;
+    HWREGH(baseAddr + EQEP_QEINT) = contextPtr->qeint;
+    HWREGH(baseAddr + EQEP_QEPCTL) = contextPtr->qepctl;
+}
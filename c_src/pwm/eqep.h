@@ -0,0 +1,98 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+/**
+ *  \file   eqep.h
+ *
+ *  \brief  This file contains the function prototypes for the device
+ *          abstraction layer for EQEP. It follows the APIs of ehrpwm.h.
+ */
+
+#ifndef _EQEP_H_
+#define _EQEP_H_
+
+#include <stdbool.h>
+#include "hw_eqep.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Quadrature decoder source */
+#define EQEP_SOURCE_QUADRATURE		(EQEP_QDECCTL_QSRC_QUADRATURE << \
+							EQEP_QDECCTL_QSRC_SHIFT)
+#define EQEP_SOURCE_DIRECTION		(EQEP_QDECCTL_QSRC_DIRECTION << \
+							EQEP_QDECCTL_QSRC_SHIFT)
+
+/* Position counter reset */
+#define EQEP_POSITION_RESET_INDEX	(EQEP_QEPCTL_PCRM_INDEX << \
+							EQEP_QEPCTL_PCRM_SHIFT)
+#define EQEP_POSITION_RESET_MAXPOS	(EQEP_QEPCTL_PCRM_MAXPOS << \
+							EQEP_QEPCTL_PCRM_SHIFT)
+#define EQEP_POSITION_RESET_FIRSTINDEX	(EQEP_QEPCTL_PCRM_FIRSTINDEX << \
+							EQEP_QEPCTL_PCRM_SHIFT)
+#define EQEP_POSITION_RESET_UNITTIME	(EQEP_QEPCTL_PCRM_UNITTIME << \
+							EQEP_QEPCTL_PCRM_SHIFT)
+
+/* Index event latch */
+#define EQEP_INDEX_LATCH_RISING		(EQEP_QEPCTL_IEL_RISING << \
+							EQEP_QEPCTL_IEL_SHIFT)
+#define EQEP_INDEX_LATCH_FALLING	(EQEP_QEPCTL_IEL_FALLING << \
+							EQEP_QEPCTL_IEL_SHIFT)
+
+/* Emulation mode */
+#define EQEP_EMULATION_FREE_RUN		(EQEP_QEPCTL_FREE_SOFT_FREERUN << \
+							EQEP_QEPCTL_FREE_SOFT_SHIFT)
+
+/* Structure to save the EQEP context */
+typedef struct eqepContext {
+    unsigned int qposinit;
+    unsigned int qposmax;
+    unsigned int qposcmp;
+    unsigned int quprd;
+    unsigned short qwdprd;
+    unsigned short qdecctl;
+    unsigned short qepctl;
+    unsigned short qcapctl;
+    unsigned short qposctl;
+    unsigned short qeint;
+}EQEPCONTEXT;
+
+/* Decoder unit */
+void EQEPDecoderConfigure(unsigned int baseAddr, unsigned int source,
+		bool swapInputs);
+
+/* Position counter and control unit */
+void EQEPPositionCounterConfigure(unsigned int baseAddr, unsigned int resetMode,
+		unsigned int maxPosition, unsigned int indexLatch);
+void EQEPPositionCounterEnable(unsigned int baseAddr);
+void EQEPPositionCounterDisable(unsigned int baseAddr);
+bool EQEPPositionCounterEnabled(unsigned int baseAddr);
+unsigned int EQEPPositionGet(unsigned int baseAddr);
+void EQEPPositionSet(unsigned int baseAddr, unsigned int position);
+unsigned int EQEPPositionLatchGet(unsigned int baseAddr);
+unsigned int EQEPIndexLatchGet(unsigned int baseAddr);
+void EQEPEmulationModeSet(unsigned int baseAddr, unsigned int mode);
+
+/* Unit timer */
+void EQEPUnitTimerEnable(unsigned int baseAddr, unsigned int period);
+void EQEPUnitTimerDisable(unsigned int baseAddr);
+
+/* Status and interrupts */
+unsigned int EQEPStatusGet(unsigned int baseAddr, unsigned int flags);
+void EQEPStatusClear(unsigned int baseAddr, unsigned int flags);
+void EQEPIntEnable(unsigned int baseAddr, unsigned int intFlags);
+void EQEPIntDisable(unsigned int baseAddr, unsigned int intFlags);
+unsigned int EQEPIntStatus(unsigned int baseAddr, unsigned int intFlags);
+void EQEPIntClear(unsigned int baseAddr, unsigned int intFlags);
+
+/* Clock and context */
+void EQEPClockEnable(unsigned int baseAdd);
+void EQEPClockDisable(unsigned int baseAdd);
+void EQEPContextSave(unsigned int baseAddr, EQEPCONTEXT *contextPtr);
+void EQEPContextRestore(unsigned int baseAddr, EQEPCONTEXT *contextPtr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,173 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+/**
+ * \file  hw_eqep.h
+ *
+ * \brief EQEP register definitions, following the layout of the other
+ *        StarterWare hw_*.h files. Offsets are relative to the eQEP register
+ *        set, which is 0x180 off the PWMSS base.
+ */
+
+#ifndef _HW_EQEP_H_
+#define _HW_EQEP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EQEP_QPOSCNT    (0x0)
+#define EQEP_QPOSINIT   (0x4)
+#define EQEP_QPOSMAX    (0x8)
+#define EQEP_QPOSCMP    (0xC)
+#define EQEP_QPOSILAT   (0x10)
+#define EQEP_QPOSSLAT   (0x14)
+#define EQEP_QPOSLAT    (0x18)
+#define EQEP_QUTMR      (0x1C)
+#define EQEP_QUPRD      (0x20)
+#define EQEP_QWDTMR     (0x24)
+#define EQEP_QWDPRD     (0x26)
+#define EQEP_QDECCTL    (0x28)
+#define EQEP_QEPCTL     (0x2A)
+#define EQEP_QCAPCTL    (0x2C)
+#define EQEP_QPOSCTL    (0x2E)
+#define EQEP_QEINT      (0x30)
+#define EQEP_QFLG       (0x32)
+#define EQEP_QCLR       (0x34)
+#define EQEP_QFRC       (0x36)
+#define EQEP_QEPSTS     (0x38)
+#define EQEP_QCTMR      (0x3A)
+#define EQEP_QCPRD      (0x3C)
+#define EQEP_QCTMRLAT   (0x3E)
+#define EQEP_QCPRDLAT   (0x40)
+#define EQEP_REVID      (0x5C)
+
+/**************************************************************************\
+* Field Definition Macros
+\**************************************************************************/
+
+/* QDECCTL */
+
+#define EQEP_QDECCTL_QSRC       (0xC000u)
+#define EQEP_QDECCTL_QSRC_SHIFT      (0x000Eu)
+#define EQEP_QDECCTL_QSRC_QUADRATURE (0x0000u)
+#define EQEP_QDECCTL_QSRC_DIRECTION  (0x0001u)
+#define EQEP_QDECCTL_QSRC_UPCOUNT    (0x0002u)
+#define EQEP_QDECCTL_QSRC_DOWNCOUNT  (0x0003u)
+
+#define EQEP_QDECCTL_SOEN       (0x2000u)
+#define EQEP_QDECCTL_SOEN_SHIFT      (0x000Du)
+
+#define EQEP_QDECCTL_SPSEL      (0x1000u)
+#define EQEP_QDECCTL_SPSEL_SHIFT     (0x000Cu)
+
+#define EQEP_QDECCTL_XCR        (0x0800u)
+#define EQEP_QDECCTL_XCR_SHIFT       (0x000Bu)
+
+#define EQEP_QDECCTL_SWAP       (0x0400u)
+#define EQEP_QDECCTL_SWAP_SHIFT      (0x000Au)
+
+#define EQEP_QDECCTL_IGATE      (0x0200u)
+#define EQEP_QDECCTL_IGATE_SHIFT     (0x0009u)
+
+#define EQEP_QDECCTL_QAP        (0x0100u)
+#define EQEP_QDECCTL_QAP_SHIFT       (0x0008u)
+
+#define EQEP_QDECCTL_QBP        (0x0080u)
+#define EQEP_QDECCTL_QBP_SHIFT       (0x0007u)
+
+#define EQEP_QDECCTL_QIP        (0x0040u)
+#define EQEP_QDECCTL_QIP_SHIFT       (0x0006u)
+
+#define EQEP_QDECCTL_QSP        (0x0020u)
+#define EQEP_QDECCTL_QSP_SHIFT       (0x0005u)
+
+/* QEPCTL */
+
+#define EQEP_QEPCTL_FREE_SOFT   (0xC000u)
+#define EQEP_QEPCTL_FREE_SOFT_SHIFT  (0x000Eu)
+#define EQEP_QEPCTL_FREE_SOFT_STOPIMMEDIATE (0x0000u)
+#define EQEP_QEPCTL_FREE_SOFT_STOPATROLLOVER (0x0001u)
+#define EQEP_QEPCTL_FREE_SOFT_FREERUN (0x0002u)
+
+#define EQEP_QEPCTL_PCRM        (0x3000u)
+#define EQEP_QEPCTL_PCRM_SHIFT       (0x000Cu)
+#define EQEP_QEPCTL_PCRM_INDEX       (0x0000u)
+#define EQEP_QEPCTL_PCRM_MAXPOS      (0x0001u)
+#define EQEP_QEPCTL_PCRM_FIRSTINDEX  (0x0002u)
+#define EQEP_QEPCTL_PCRM_UNITTIME    (0x0003u)
+
+#define EQEP_QEPCTL_SEI         (0x0C00u)
+#define EQEP_QEPCTL_SEI_SHIFT        (0x000Au)
+
+#define EQEP_QEPCTL_IEI         (0x0300u)
+#define EQEP_QEPCTL_IEI_SHIFT        (0x0008u)
+
+#define EQEP_QEPCTL_SWI         (0x0080u)
+#define EQEP_QEPCTL_SWI_SHIFT        (0x0007u)
+
+#define EQEP_QEPCTL_SEL         (0x0040u)
+#define EQEP_QEPCTL_SEL_SHIFT        (0x0006u)
+
+#define EQEP_QEPCTL_IEL         (0x0030u)
+#define EQEP_QEPCTL_IEL_SHIFT        (0x0004u)
+#define EQEP_QEPCTL_IEL_RISING       (0x0001u)
+#define EQEP_QEPCTL_IEL_FALLING      (0x0002u)
+#define EQEP_QEPCTL_IEL_MARKER       (0x0003u)
+
+#define EQEP_QEPCTL_QPEN        (0x0008u)
+#define EQEP_QEPCTL_QPEN_SHIFT       (0x0003u)
+
+#define EQEP_QEPCTL_QCLM        (0x0004u)
+#define EQEP_QEPCTL_QCLM_SHIFT       (0x0002u)
+
+#define EQEP_QEPCTL_UTE         (0x0002u)
+#define EQEP_QEPCTL_UTE_SHIFT        (0x0001u)
+
+#define EQEP_QEPCTL_WDE         (0x0001u)
+#define EQEP_QEPCTL_WDE_SHIFT        (0x0000u)
+
+/* QCAPCTL */
+
+#define EQEP_QCAPCTL_CEN        (0x8000u)
+#define EQEP_QCAPCTL_CEN_SHIFT       (0x000Fu)
+
+#define EQEP_QCAPCTL_CCPS       (0x0070u)
+#define EQEP_QCAPCTL_CCPS_SHIFT      (0x0004u)
+
+#define EQEP_QCAPCTL_UPPS       (0x000Fu)
+#define EQEP_QCAPCTL_UPPS_SHIFT      (0x0000u)
+
+/* QEINT, QFLG, QCLR and QFRC share the same layout, INT only exists in QFLG
+   and QCLR */
+
+#define EQEP_INT_INT            (0x0001u)
+#define EQEP_INT_PCE            (0x0002u)
+#define EQEP_INT_PHE            (0x0004u)
+#define EQEP_INT_QDC            (0x0008u)
+#define EQEP_INT_WTO            (0x0010u)
+#define EQEP_INT_PCU            (0x0020u)
+#define EQEP_INT_PCO            (0x0040u)
+#define EQEP_INT_PCR            (0x0080u)
+#define EQEP_INT_PCM            (0x0100u)
+#define EQEP_INT_SEL            (0x0200u)
+#define EQEP_INT_IEL            (0x0400u)
+#define EQEP_INT_UTO            (0x0800u)
+
+/* QEPSTS */
+
+#define EQEP_QEPSTS_UPEVNT      (0x0080u)
+#define EQEP_QEPSTS_FIDF        (0x0040u)
+#define EQEP_QEPSTS_QDF         (0x0020u)
+#define EQEP_QEPSTS_QDLF        (0x0010u)
+#define EQEP_QEPSTS_COEF        (0x0008u)
+#define EQEP_QEPSTS_CDEF        (0x0004u)
+#define EQEP_QEPSTS_FIMF        (0x0002u)
+#define EQEP_QEPSTS_PCEF        (0x0001u)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -50,6 +50,10 @@
 
 #define PWMSS_ECAP_CLK_STOP_ACK_SHIFT    0x01
 
+#define PWMSS_EQEP_CLK_EN_ACK_SHIFT      0x04
+
+#define PWMSS_EQEP_CLK_STOP_ACK_SHIFT    0x05
+
 #define PWMSS_EHRPWM_CLK_EN_ACK_SHIFT    0x08
 
 #define PWMSS_EHRPWM_CLK_STOP_ACK_SHIFT  0x09  
@@ -58,6 +62,10 @@
 
 #define PWMSS_ECAP_CLK_STOP_ACK          0x02
 
+#define PWMSS_EQEP_CLK_EN_ACK            0x10
+
+#define PWMSS_EQEP_CLK_STOP_ACK          0x20
+
 #define PWMSS_EHRPWM_CLK_EN_ACK          0x100
 
 #define PWMSS_EHRPWM_CLK_STOP_ACK        0x200
@@ -3,161 +3,1670 @@
 // SPDX-License-Identifier: LicenseRef-Kry10
 
 #include <kos.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "hw_types.h"
+#include "hw_pwmss.h"
 #include "ehrpwm.h"
+#include "eqep.h"
+#include "ecap.h"
+#include "pwm_status.h"
 
 #define VISUALIZE_STARTUP
 
-#define EXPECTED_ARGC 2
+#define MIN_ARGC 2
 #define PROTOCOL_NAME_IDX 1
+#define FIRST_OPTION_IDX 2
+
+#define CHECKPOINT_FRAME_OPTION "checkpoint_frame="
+#define CHECKPOINT_MAGIC 0x5057534d
+#define STATUS_FRAME_OPTION "status_frame="
 
 #define PWM_REQUEST_LABEL (~0)
+
+#ifdef KOS_AM335X_IO
+#include "kos_am335x_io.h"
+// Part of the combined I/O service, which serves our protocol on its own
+// endpoint under a badge and token slot of ours
+#define PWM_PROTOCOL_BADGE IO_PWM_PROTOCOL_BADGE
+#define TRANSFER_TOKEN_SLOT IO_PWM_TRANSFER_TOKEN_SLOT
+#else
 #define PWM_PROTOCOL_BADGE (KOS_CORE_APP_ID_LIMIT)
 
-#define RECEIVE_TOKEN_SLOT 1
-#define TRANSFER_TOKEN_SLOT 2
+#define RECEIVE_TOKEN_SLOT 1
+#define TRANSFER_TOKEN_SLOT 2
+#endif
+
+#define AM335X_PWM0_PADDR 0x48300000
+#define AM335X_PWM1_PADDR 0x48302000
+#define AM335X_PWM2_PADDR 0x48304000
+#define NUM_PWM 3
+
+#define AM335X_EPWM0_IRQ 86
+#define AM335X_EPWM1_IRQ 87
+#define AM335X_EPWM2_IRQ 39
+
+#define AM335X_EQEP0_IRQ 79
+#define AM335X_EQEP1_IRQ 88
+#define AM335X_EQEP2_IRQ 89
+
+#define AM335X_ECAP0_IRQ 31
+#define AM335X_ECAP1_IRQ 47
+#define AM335X_ECAP2_IRQ 61
+
+#define AM335X_EPWM0_TZ_IRQ 58
+#define AM335X_EPWM1_TZ_IRQ 59
+#define AM335X_EPWM2_TZ_IRQ 60
+
+#define MODULE_CLK 100000000
+#define TB_CLK 100000000
+
+#define PIN_A 0
+#define PIN_B 1
+#define NUM_PINS 2
+// The eCAP in APWM mode, it has its own period so it isn't one of the ePWM
+// pins
+#define PIN_APWM 2
+
+#define SET_PWM_FREQUENCY_ARGS 1
+#define SET_PWM_DUTY_CYCLE_ARGS 2
+// Duty cycles are in percent
+#define MAX_DUTY_CYCLE 100
+#define SET_PWM_COUNTER_MODE_ARGS 1
+
+#define SET_PWM_OUTPUT_MODE_ARGS 2
+#define GET_PWM_COUNTER_ARGS 0
+#define SET_PWM_PERIOD_EVENTS_ARGS 1
+#define SET_PWM_CLOCK_ARGS 1
+#define SET_APWM_FREQUENCY_ARGS 1
+#define SET_PWM_IDLE_STOP_ARGS 1
+#define GET_PWM_CLOCK_STATUS_ARGS 0
+// The fast duty cycle request carries its arguments in the message param
+// instead of the payload, the pin in the low byte and the duty cycle above it
+#define FAST_ARG_PIN_MASK 0xff
+#define FAST_ARG_VALUE_SHIFT 8
+// CLOCK_STATUS and the number of acknowledge timeouts, followed by the
+// state of each submodule clock
+#define GET_PWM_CLOCK_STATUS_HEADER 2
+#define PWMSS_CLOCK_STATUS_WORDS 4
+#define GET_PWM_COUNTER_RESULTS 6
+
+#define CONFIGURE_QEP_ARGS 2
+#define GET_QEP_POSITION_ARGS 0
+#define GET_QEP_VELOCITY_ARGS 0
+#define GET_QEP_INDEX_ARGS 0
+#define GET_QEP_POSITION_RESULTS 2
+#define GET_QEP_VELOCITY_RESULTS 2
+#define GET_QEP_INDEX_RESULTS 2
+
+// The unit timer counts SYSCLKOUT cycles, which is the module clock
+#define QEP_CYCLES_PER_US (MODULE_CLK / 1000000)
+#define QEP_MAX_UNIT_PERIOD_US (UINT32_MAX / QEP_CYCLES_PER_US)
+
+#define CONFIGURE_ECAP_CAPTURE_ARGS 3
+#define GET_ECAP_CAPTURES_ARGS 0
+// Number of captures and overruns, followed by the captures
+#define GET_ECAP_CAPTURES_HEADER 2
+#define ECAP_CAPTURE_WORDS 2
+#define MAX_ECAP_CAPTURE_BATCH 32
+
+#define ECAP_NUM_EVENTS 4
+#define ECAP_ALL_EVENTS ((1 << ECAP_NUM_EVENTS) - 1)
+// Must be a power of two so that the ring indices can wrap freely
+#define ECAP_RING_SIZE 256
+
+#define ECAP_MODE_OFF 0
+#define ECAP_MODE_CAPTURE 1
+#define ECAP_MODE_APWM 2
+
+// Submodule clocks of the PWMSS
+#define PWMSS_CLOCK_EPWM 0
+#define PWMSS_CLOCK_ECAP 1
+#define PWMSS_CLOCK_EQEP 2
+#define NUM_PWMSS_CLOCKS 3
+
+// Upper bound on the CLOCK_STATUS reads while waiting for an acknowledge, the
+// handshake normally completes within a few reads
+#define PWMSS_CLOCK_ACK_POLLS 100000
+
+#define COUNTER_MODE_UP 0
+#define COUNTER_MODE_UP_DOWN 1
+
+#define OUTPUT_MODE_NORMAL 0
+#define OUTPUT_MODE_INVERTED 1
+#define OUTPUT_MODE_FORCE_LOW 2
+#define OUTPUT_MODE_FORCE_HIGH 3
+
+// The action qualifier encodings are the same for every event on both
+// channels
+#define AQ_ACTION_DO_NOTHING EHRPWM_AQCTLA_ZRO_DONOTHING
+#define AQ_ACTION_LOW EHRPWM_AQCTLA_ZRO_EPWMXALOW
+#define AQ_ACTION_HIGH EHRPWM_AQCTLA_ZRO_EPWMXAHIGH
+
+// Likewise for the continuous software force encodings
+#define CONT_FORCE_DISABLED 0
+#define CONT_FORCE_LOW EHRPWM_AQCSFRC_CSFA_LOW
+#define CONT_FORCE_HIGH EHRPWM_AQCSFRC_CSFA_HIGH
+
+// The listener thread, the event trigger interrupt thread, the encoder
+// interrupt thread, the capture interrupt thread and the trip zone interrupt
+// thread
+#define NUM_THREADS 5
+
+#ifdef KOS_AM335X_IO
+_Static_assert(NUM_THREADS == IO_PWM_NUM_THREADS, "IO_PWM_NUM_THREADS is out of date");
+// Our threads follow those of the GPIO service in the combined thread manager
+#define FIRST_THREAD_COOKIE IO_PWM_FIRST_COOKIE
+#else
+#define FIRST_THREAD_COOKIE 0
+#endif
+
+// Thread manager cookies of the threads
+enum thread_cookie {
+  LISTENER_COOKIE = FIRST_THREAD_COOKIE,
+  IRQ_COOKIE,
+  QEP_IRQ_COOKIE,
+  ECAP_IRQ_COOKIE,
+  TZ_IRQ_COOKIE
+};
+
+#ifndef KOS_AM335X_IO
+static kos_msg_server_t server;
+static kos_thread_mgr_entry_t root_manager_entries[NUM_THREADS];
+static kos_thread_mgr_t root_thread_mgr;
+static kos_thread_t listener_thread;
+#endif
+// Our own thread manager, or the one of the combined I/O service
+static kos_thread_mgr_t *p_thread_mgr;
+static kos_thread_t irq_thread;
+static kos_thread_t qep_irq_thread;
+static kos_thread_t ecap_irq_thread;
+static kos_thread_t tz_irq_thread;
+
+static char* protocol_name;
+
+// ID of the only client that can be registered with us, only support one client
+static seL4_Word client_id;
+
+enum request_label {
+  SET_PWM_FREQUENCY_REQUEST = 1,
+  SET_PWM_DUTY_CYCLE_REQUEST,
+  SET_PWM_COUNTER_MODE_REQUEST,
+  SET_PWM_OUTPUT_MODE_REQUEST,
+  GET_PWM_COUNTER_REQUEST,
+  SET_PWM_PERIOD_EVENTS_REQUEST,
+  SET_PWM_CLOCK_REQUEST,
+  CONFIGURE_QEP_REQUEST,
+  GET_QEP_POSITION_REQUEST,
+  GET_QEP_VELOCITY_REQUEST,
+  GET_QEP_INDEX_REQUEST,
+  CONFIGURE_ECAP_CAPTURE_REQUEST,
+  GET_ECAP_CAPTURES_REQUEST,
+  SET_APWM_FREQUENCY_REQUEST,
+  SET_PWM_IDLE_STOP_REQUEST,
+  GET_PWM_CLOCK_STATUS_REQUEST,
+  FAST_SET_PWM_DUTY_CYCLE_REQUEST,
+  NUM_PWM_REQUESTS
+};
+
+static kos_device_frame_t pwm_controller_frames[] = {
+  {.paddr = AM335X_PWM0_PADDR, .size = KOS_EXP2(seL4_PageBits)},
+  {.paddr = AM335X_PWM1_PADDR, .size = KOS_EXP2(seL4_PageBits)},
+  {.paddr = AM335X_PWM2_PADDR, .size = KOS_EXP2(seL4_PageBits)}
+};
+
+static kos_device_irq_t pwm_controller_irqs[] = {
+  {.irq = AM335X_EPWM0_IRQ},
+  {.irq = AM335X_EPWM1_IRQ},
+  {.irq = AM335X_EPWM2_IRQ}
+};
+
+static kos_device_irq_t qep_controller_irqs[] = {
+  {.irq = AM335X_EQEP0_IRQ},
+  {.irq = AM335X_EQEP1_IRQ},
+  {.irq = AM335X_EQEP2_IRQ}
+};
+
+static kos_device_irq_t ecap_controller_irqs[] = {
+  {.irq = AM335X_ECAP0_IRQ},
+  {.irq = AM335X_ECAP1_IRQ},
+  {.irq = AM335X_ECAP2_IRQ}
+};
+
+static kos_device_irq_t tz_controller_irqs[] = {
+  {.irq = AM335X_EPWM0_TZ_IRQ},
+  {.irq = AM335X_EPWM1_TZ_IRQ},
+  {.irq = AM335X_EPWM2_TZ_IRQ}
+};
+
+static seL4_Word pwmss_base;
+static seL4_Word pwm_controller_base;
+// Only set when the client stopped the ePWM clock, not by idle stop
+static bool pwm_clock_stopped;
+static kos_irq_t pwm_irq;
+static bool pwm_irq_available;
+// Raised when a trip zone event trips the outputs, so that the status page
+// shows the trip without waiting for the next request
+static kos_irq_t tz_irq;
+static bool tz_irq_available;
+static uint32_t curr_freq;
+static uint32_t curr_pin_duty_cycle[NUM_PINS] = {0};
+static uint32_t curr_counter_mode = COUNTER_MODE_UP;
+static uint32_t curr_pin_output_mode[NUM_PINS] = {OUTPUT_MODE_NORMAL, OUTPUT_MODE_NORMAL};
+
+// Number of counter-zero events seen since period events were enabled, only
+// written by the interrupt thread
+static volatile uint32_t period_event_count;
+static bool period_events_enabled;
+
+// Each submodule clock is requested through CLOCK_CONFIG and acknowledged
+// through CLOCK_STATUS, the enable and stop bits are in the same place in
+// both registers
+typedef struct {
+  unsigned int enable_bit;
+  unsigned int stop_bit;
+  bool running;
+  // Restarts from stopped, with the number of CLOCK_STATUS reads until the
+  // enable was acknowledged
+  uint32_t restarts;
+  uint32_t last_restart_polls;
+  uint32_t max_restart_polls;
+} pwmss_clock_t;
+
+static pwmss_clock_t pwmss_clocks[NUM_PWMSS_CLOCKS] = {
+  [PWMSS_CLOCK_EPWM] = {.enable_bit = PWMSS_EHRPWM_CLK_EN_ACK, .stop_bit = PWMSS_EHRPWM_CLK_STOP_ACK},
+  [PWMSS_CLOCK_ECAP] = {.enable_bit = PWMSS_ECAP_CLK_EN_ACK, .stop_bit = PWMSS_ECAP_CLK_STOP_ACK},
+  [PWMSS_CLOCK_EQEP] = {.enable_bit = PWMSS_EQEP_CLK_EN_ACK, .stop_bit = PWMSS_EQEP_CLK_STOP_ACK}
+};
+static uint32_t pwmss_clock_ack_timeouts;
+
+// Stop the clocks of submodules that have nothing to do after every request,
+// they are started again when a request needs them
+static bool idle_stop;
+
+// The eQEP shares the frame of the PWMSS with the ePWM, it decodes the
+// quadrature encoder inputs in hardware. The encoder is not running while the
+// unit period is 0.
+static seL4_Word qep_base;
+static kos_irq_t qep_irq;
+static bool qep_irq_available;
+static uint32_t qep_unit_period_us;
+static uint32_t qep_max_position;
+
+// Updated by the encoder interrupt thread on every unit time out and index
+// event
+static uint32_t qep_last_latch;
+static volatile int32_t qep_velocity;
+static volatile uint32_t qep_unit_event_count;
+static volatile uint32_t qep_index_event_count;
+
+// Each configuration of the encoder gets a new generation. Only the interrupt
+// thread resets the state above, when it first runs for a new generation, so
+// a thread that was part way through the old configuration can't leave its
+// results behind in the new one. Until it has, the state reads as reset.
+static volatile uint32_t qep_config_generation;
+static volatile uint32_t qep_state_generation;
+
+// The eCAP is also in the PWMSS frame, in capture mode it timestamps edges of
+// its input with the 100 MHz module clock
+static seL4_Word ecap_base;
+static kos_irq_t ecap_irq;
+static bool ecap_irq_available;
+static uint32_t ecap_mode = ECAP_MODE_OFF;
+// Bit n set captures a falling edge on event n + 1, otherwise a rising edge
+static uint32_t ecap_falling_edges;
+// Reset the counter on every event so each capture is the time since the
+// previous event
+static bool ecap_delta;
+
+// In APWM mode the eCAP is a third PWM output, the APWM doesn't run while its
+// frequency is 0
+static uint32_t curr_apwm_freq;
+static uint32_t curr_apwm_duty_cycle;
+static uint32_t curr_apwm_output_mode = OUTPUT_MODE_NORMAL;
+
+typedef struct {
+  uint32_t event;
+  uint32_t timestamp;
+} ecap_capture_t;
+
+// Captures waiting to be collected. Only the interrupt thread advances the
+// head and only the listener advances the tail.
+static ecap_capture_t ecap_ring[ECAP_RING_SIZE];
+static volatile uint32_t ecap_ring_head;
+static volatile uint32_t ecap_ring_tail;
+// Captures lost because the ring was full or the interrupt thread fell behind
+static volatile uint32_t ecap_overrun_count;
+static uint32_t ecap_overrun_base;
+
+// Checkpoint of the controller that outlives the service, so that a restarted
+// service can adopt the controller as it was instead of resetting it
+typedef struct {
+  uint32_t magic;
+  // 0 if the controller was never initialised, odd while being written
+  volatile uint32_t sequence;
+  uint32_t paddr;
+  EHRPWMCONTEXT context;
+  uint32_t freq;
+  uint32_t pin_duty_cycle[NUM_PINS];
+  uint32_t counter_mode;
+  uint32_t pin_output_mode[NUM_PINS];
+  uint32_t clock_stopped;
+  EQEPCONTEXT qep_context;
+  uint32_t qep_unit_period_us;
+  uint32_t qep_max_position;
+  uint32_t ecap_mode;
+  uint32_t ecap_falling_edges;
+  uint32_t ecap_delta;
+  ECAPCONTEXT ecap_context;
+  uint32_t apwm_freq;
+  uint32_t apwm_duty_cycle;
+  uint32_t apwm_output_mode;
+  uint32_t idle_stop;
+} pwm_checkpoint_t;
+
+// The checkpoint lives in a frame of memory given to us with the
+// checkpoint_frame option, such as a page of on-chip RAM
+static kos_device_frame_t checkpoint_frame = {.size = KOS_EXP2(seL4_PageBits)};
+static pwm_checkpoint_t *p_checkpoint;
+static uint32_t pwm_controller_paddr;
+
+// The status page lives in a frame given to us with the status_frame option,
+// that the manifest also gives to the clients that read it directly. Both the
+// listener and the trip zone interrupt thread write it.
+static kos_device_frame_t status_frame = {.size = KOS_EXP2(seL4_PageBits)};
+static pwm_status_page_t *p_status;
+static volatile uint32_t status_pending;
+
+static kos_msg_t handle_request(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id) {
+  (void) msg;
+
+  if (badge != PWM_PROTOCOL_BADGE)
+    return kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
+  if (caller_id == 0)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  if (client_id != 0 && client_id != caller_id)
+    // Don't support more than one client
+    return kos_msg_new_status(STATUS_FULL);
+
+  // Create the token that we send to the client
+  kos_assert_created(
+    kos_msg_token_create(
+      PWM_PROTOCOL_BADGE, // IN seL4_Word badge,
+      KOS_MSG_FLAG_SEND_PAYLOAD, // IN uint8_t flags,
+      TRANSFER_TOKEN_SLOT
+    ),
+    "create pwm token to give"
+  );
+
+  client_id = caller_id;
+
+  return kos_msg_new(STATUS_OK, 0, 0, TRANSFER_TOKEN_SLOT, 0);
+}
+
+static unsigned int counter_direction(void) {
+  if (curr_counter_mode == COUNTER_MODE_UP_DOWN) {
+    return EHRPWM_COUNT_UP_DOWN;
+  }
+  return EHRPWM_COUNT_UP;
+}
+
+static void configure_action_qualifiers(void) {
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+
+  // Work out the level that each pin drives during the 'on' part of the duty
+  // cycle and the level it drives afterwards
+  unsigned int active[NUM_PINS];
+  unsigned int inactive[NUM_PINS];
+  for (int i = 0; i < NUM_PINS; i++) {
+    bool inverted = curr_pin_output_mode[i] == OUTPUT_MODE_INVERTED;
+    active[i] = inverted ? AQ_ACTION_LOW : AQ_ACTION_HIGH;
+    inactive[i] = inverted ? AQ_ACTION_HIGH : AQ_ACTION_LOW;
+  }
+
+  if (curr_counter_mode == COUNTER_MODE_UP_DOWN) {
+    // Center-aligned: the output is active while the counter is below the
+    // compare value, i.e. it goes inactive on the way up and active on the way
+    // down
+    EHRPWMConfigureAQActionOnA(controller_base,
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               inactive[PIN_A],
+                               active[PIN_A],
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               EHRPWM_AQSFRC_ACTSFA_DONOTHING);
+
+    EHRPWMConfigureAQActionOnB(controller_base,
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               inactive[PIN_B],
+                               active[PIN_B],
+                               EHRPWM_AQSFRC_ACTSFB_DONOTHING);
+  } else {
+    // Edge-aligned: the output goes active at zero and inactive on the compare
+    // match
+    EHRPWMConfigureAQActionOnA(controller_base,
+                               active[PIN_A],
+                               AQ_ACTION_DO_NOTHING,
+                               inactive[PIN_A],
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               EHRPWM_AQSFRC_ACTSFA_DONOTHING);
+
+    EHRPWMConfigureAQActionOnB(controller_base,
+                               active[PIN_B],
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               AQ_ACTION_DO_NOTHING,
+                               inactive[PIN_B],
+                               AQ_ACTION_DO_NOTHING,
+                               EHRPWM_AQSFRC_ACTSFB_DONOTHING);
+  }
+}
+
+static void apply_output_force(int pin) {
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+
+  bool inverted = curr_pin_output_mode[pin] == OUTPUT_MODE_INVERTED;
+  uint32_t duty_cycle = curr_pin_duty_cycle[pin];
+  unsigned int force = CONT_FORCE_DISABLED;
+
+  switch (curr_pin_output_mode[pin]) {
+    case OUTPUT_MODE_FORCE_LOW:
+      force = CONT_FORCE_LOW;
+      break;
+    case OUTPUT_MODE_FORCE_HIGH:
+      force = CONT_FORCE_HIGH;
+      break;
+    default:
+      // Hold the output at 0% and 100% instead of relying on the compare
+      // match, which would otherwise glitch at the period boundary
+      if (duty_cycle == 0) {
+        force = inverted ? CONT_FORCE_HIGH : CONT_FORCE_LOW;
+      } else if (duty_cycle >= 100) {
+        force = inverted ? CONT_FORCE_LOW : CONT_FORCE_HIGH;
+      }
+      break;
+  }
+
+  if (pin == PIN_A) {
+    EHRPWMAQContSWForceOnA(controller_base, force, EHRPWM_AQSFRC_RLDCSF_IMMEDIATE);
+  } else {
+    EHRPWMAQContSWForceOnB(controller_base, force, EHRPWM_AQSFRC_RLDCSF_IMMEDIATE);
+  }
+}
+
+static void calc_and_set_counter_values(int pin, uint32_t duty_cycle) {
+  if (curr_freq == 0) {
+    // Avoid divide by zero
+    return;
+  }
+
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+
+  // EHRPWMPWMOpFreqSet halves TBPRD when counting up-down, so the compare
+  // values need to be scaled against the same period
+  uint32_t period_count = TB_CLK / curr_freq;
+  if (curr_counter_mode == COUNTER_MODE_UP_DOWN) {
+    period_count /= 2;
+  }
+  uint32_t counter_value = (uint32_t) (duty_cycle / 100.0 * period_count);
+
+  if (pin == PIN_A) {
+    EHRPWMLoadCMPA(controller_base,
+                   counter_value,
+                   EHRPWM_SHADOW_WRITE_ENABLE,
+                   EHRPWM_CMPCTL_LOADAMODE_TBCTRZERO,
+                   EHRPWM_CMPCTL_OVERWR_SH_FL);
+  } else {
+    EHRPWMLoadCMPB(controller_base,
+                   counter_value,
+                   EHRPWM_SHADOW_WRITE_ENABLE,
+                   EHRPWM_CMPCTL_LOADAMODE_TBCTRZERO,
+                   EHRPWM_CMPCTL_OVERWR_SH_FL);
+  }
+}
+
+static void calc_apwm_counter_values(uint32_t *p_compare, uint32_t *p_period, unsigned int *p_polarity) {
+  // The output is active from the period match until the compare match, so a
+  // compare value past the period keeps it active for the whole period
+  uint32_t period_count = TB_CLK / curr_apwm_freq;
+
+  *p_period = period_count - 1;
+  *p_polarity = ECAP_APWM_ACTIVE_HIGH;
+
+  switch (curr_apwm_output_mode) {
+    case OUTPUT_MODE_FORCE_LOW:
+      *p_compare = 0;
+      break;
+    case OUTPUT_MODE_FORCE_HIGH:
+      *p_compare = period_count;
+      break;
+    default:
+      if (curr_apwm_duty_cycle >= 100) {
+        *p_compare = period_count;
+      } else {
+        *p_compare = (uint32_t) (curr_apwm_duty_cycle / 100.0 * period_count);
+      }
+      if (curr_apwm_output_mode == OUTPUT_MODE_INVERTED) {
+        *p_polarity = ECAP_APWM_ACTIVE_LOW;
+      }
+      break;
+  }
+}
+
+// Updates the running APWM through the shadow registers, so that the new
+// values take effect at the next period match without a glitch
+static void apply_apwm(void) {
+  if (ecap_mode != ECAP_MODE_APWM) {
+    return;
+  }
+
+  unsigned int capture_base = (unsigned int) ecap_base;
+  uint32_t compare;
+  uint32_t period;
+  unsigned int polarity;
+
+  calc_apwm_counter_values(&compare, &period, &polarity);
+  ECAPAPWMPolarityConfig(capture_base, polarity);
+  ECAPAPWMShadowCaptureConfig(capture_base, compare, period);
+}
+
+static kos_msg_t handle_set_pwm_frequency(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_FREQUENCY_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t frequency = transport[0];
+
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+
+  // Set the frequency
+  EHRPWMPWMOpFreqSet(controller_base, TB_CLK, frequency, counter_direction(), EHRPWM_SHADOW_WRITE_ENABLE);
+
+  curr_freq = frequency;
+
+  // Update the counter values of the PWMs
+  calc_and_set_counter_values(PIN_A, curr_pin_duty_cycle[PIN_A]);
+  calc_and_set_counter_values(PIN_B, curr_pin_duty_cycle[PIN_B]);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+// Shared by the payload and the fast duty cycle requests, only the pins
+// themselves are accepted so that no other value stands for one of them
+static bool duty_cycle_args_valid(seL4_Word pin, seL4_Word duty_cycle) {
+  return (pin == PIN_A || pin == PIN_B || pin == PIN_APWM) && duty_cycle <= MAX_DUTY_CYCLE;
+}
+
+// Shared by the payload and the fast duty cycle requests
+static void set_pwm_duty_cycle(uint32_t pin, uint32_t duty_cycle) {
+  // Load the duty cycle value in
+  if (pin == PIN_APWM) {
+    curr_apwm_duty_cycle = duty_cycle;
+    apply_apwm();
+  } else if (pin == PIN_A) {
+    curr_pin_duty_cycle[PIN_A] = duty_cycle;
+    calc_and_set_counter_values(PIN_A, curr_pin_duty_cycle[PIN_A]);
+    apply_output_force(PIN_A);
+  } else {
+    curr_pin_duty_cycle[PIN_B] = duty_cycle;
+    calc_and_set_counter_values(PIN_B, curr_pin_duty_cycle[PIN_B]);
+    apply_output_force(PIN_B);
+  }
+}
+
+static kos_msg_t handle_set_pwm_duty_cycle(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_DUTY_CYCLE_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  if (!duty_cycle_args_valid(transport[0], transport[1]))
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  set_pwm_duty_cycle(transport[0], transport[1]);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+// Same as handle_set_pwm_duty_cycle, but the request fits in the message
+// registers and never touches the payload buffer
+static kos_msg_t handle_fast_set_pwm_duty_cycle(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != 0)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t pin = msg.param & FAST_ARG_PIN_MASK;
+  seL4_Word duty_cycle = msg.param >> FAST_ARG_VALUE_SHIFT;
+
+  if (!duty_cycle_args_valid(pin, duty_cycle))
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  set_pwm_duty_cycle(pin, duty_cycle);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_set_pwm_counter_mode(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_COUNTER_MODE_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t counter_mode = transport[0];
+
+  if (counter_mode != COUNTER_MODE_UP && counter_mode != COUNTER_MODE_UP_DOWN) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+
+  curr_counter_mode = counter_mode;
+
+  configure_action_qualifiers();
+
+  // Reprogram the period for the new counting direction, nothing is running
+  // yet if the frequency has not been set
+  if (curr_freq != 0) {
+    EHRPWMPWMOpFreqSet(controller_base, TB_CLK, curr_freq, counter_direction(), EHRPWM_SHADOW_WRITE_ENABLE);
+  }
+
+  // Update the counter values of the PWMs
+  calc_and_set_counter_values(PIN_A, curr_pin_duty_cycle[PIN_A]);
+  calc_and_set_counter_values(PIN_B, curr_pin_duty_cycle[PIN_B]);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_set_pwm_output_mode(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_OUTPUT_MODE_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t pin = transport[0];
+  uint32_t output_mode = transport[1];
+
+  if ((pin >= NUM_PINS && pin != PIN_APWM) || output_mode > OUTPUT_MODE_FORCE_HIGH) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  if (pin == PIN_APWM) {
+    curr_apwm_output_mode = output_mode;
+    apply_apwm();
+    return kos_msg_new_status(STATUS_OK);
+  }
+
+  bool polarity_changed =
+    (curr_pin_output_mode[pin] == OUTPUT_MODE_INVERTED) != (output_mode == OUTPUT_MODE_INVERTED);
+
+  curr_pin_output_mode[pin] = output_mode;
+
+  // Only the polarity lives in the action qualifiers, parking a pin is done
+  // purely through the continuous software force
+  if (polarity_changed) {
+    configure_action_qualifiers();
+  }
+  apply_output_force(pin);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_get_pwm_counter(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * GET_PWM_COUNTER_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+
+  // Sample the counter first so that it is as close to the request as possible
+  transport[0] = EHRPWMReadTBCount(controller_base);
+  transport[1] = EHRPWMTBStatusGet(controller_base,
+                                   EHRPWM_TBSTS_CTRMAX | EHRPWM_TBSTS_SYNCI | EHRPWM_TBSTS_CTRDIR);
+  // These are the active values, which may lag the last requested duty cycle
+  // or frequency until the next shadow load
+  transport[2] = HWREGH(controller_base + EHRPWM_CMPA);
+  transport[3] = HWREGH(controller_base + EHRPWM_CMPB);
+  transport[4] = HWREGH(controller_base + EHRPWM_TBPRD);
+  transport[5] = period_event_count;
+
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * GET_PWM_COUNTER_RESULTS, 0, 0);
+}
+
+static kos_msg_t handle_set_pwm_period_events(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_PERIOD_EVENTS_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  if (!pwm_irq_available)
+    return kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t enable = transport[0];
+
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+
+  period_events_enabled = enable != 0;
+
+  if (enable) {
+    period_event_count = 0;
+    // Interrupt on every counter-zero event, this is once per period in both
+    // counter modes
+    EHRPWMETIntSourceSelect(controller_base, EHRPWM_ETSEL_INTSEL_TBCTREQUZERO);
+    EHRPWMETIntPrescale(controller_base, EHRPWM_ETPS_INTPRD_FIRSTEVENT);
+    EHRPWMETIntClear(controller_base);
+    EHRPWMETIntEnable(controller_base);
+  } else {
+    EHRPWMETIntDisable(controller_base);
+    EHRPWMETIntClear(controller_base);
+  }
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+// An interrupt thread only touches the registers of its submodule while the
+// clock runs, and the listener doesn't stop a clock while one of them is doing
+// so. An interrupt that comes in with the clock stopped keeps its flag set, it
+// is acknowledged once the clock runs again so that it is raised again.
+typedef struct {
+  int clock;
+  kos_irq_t *p_irq;
+  volatile uint32_t busy;
+  volatile uint32_t deferred;
+} pwmss_irq_guard_t;
+
+enum irq_guard {
+  IRQ_GUARD_EPWM,
+  IRQ_GUARD_TZ,
+  IRQ_GUARD_QEP,
+  IRQ_GUARD_ECAP,
+  NUM_IRQ_GUARDS
+};
+
+static pwmss_irq_guard_t irq_guards[NUM_IRQ_GUARDS] = {
+  [IRQ_GUARD_EPWM] = {.clock = PWMSS_CLOCK_EPWM, .p_irq = &pwm_irq},
+  [IRQ_GUARD_TZ] = {.clock = PWMSS_CLOCK_EPWM, .p_irq = &tz_irq},
+  [IRQ_GUARD_QEP] = {.clock = PWMSS_CLOCK_EQEP, .p_irq = &qep_irq},
+  [IRQ_GUARD_ECAP] = {.clock = PWMSS_CLOCK_ECAP, .p_irq = &ecap_irq}
+};
+
+static inline bool pwmss_clock_running(int clock) {
+  return __atomic_load_n(&pwmss_clocks[clock].running, __ATOMIC_SEQ_CST);
+}
+
+// Acknowledges the interrupts that came in while the clock was stopped, once
+// it runs again
+static void resume_deferred_irqs(int clock) {
+  for (int i = 0; i < NUM_IRQ_GUARDS; i++) {
+    if (irq_guards[i].clock == clock && __atomic_exchange_n(&irq_guards[i].deferred, 0, __ATOMIC_SEQ_CST)) {
+      kos_irq_ack(irq_guards[i].p_irq);
+    }
+  }
+}
+
+// Called by an interrupt thread before it touches the registers, returns false
+// without acknowledging the interrupt if the clock is stopped
+static bool irq_guard_begin(int guard) {
+  pwmss_irq_guard_t *p_guard = &irq_guards[guard];
+
+  __atomic_store_n(&p_guard->busy, 1, __ATOMIC_SEQ_CST);
+  if (pwmss_clock_running(p_guard->clock))
+    return true;
+  __atomic_store_n(&p_guard->busy, 0, __ATOMIC_SEQ_CST);
+
+  __atomic_store_n(&p_guard->deferred, 1, __ATOMIC_SEQ_CST);
+  // The clock may have started again before the interrupt was deferred
+  if (pwmss_clock_running(p_guard->clock) && __atomic_exchange_n(&p_guard->deferred, 0, __ATOMIC_SEQ_CST)) {
+    kos_irq_ack(p_guard->p_irq);
+  }
+  return false;
+}
+
+static inline void irq_guard_end(int guard) {
+  __atomic_store_n(&irq_guards[guard].busy, 0, __ATOMIC_SEQ_CST);
+}
+
+// Requests a submodule clock to start or stop and waits for the PWMSS to
+// acknowledge it, the submodule registers must not be touched before that.
+// Returns false if the clock was left running because an interrupt thread was
+// using the submodule.
+static bool pwmss_clock_set(int clock, bool enable) {
+  unsigned int subsystem_base = (unsigned int) pwmss_base;
+  pwmss_clock_t *p_clock = &pwmss_clocks[clock];
+
+  if (!enable) {
+    // Keep the interrupt threads out of the registers first, then make sure
+    // none of them is still in there
+    __atomic_store_n(&p_clock->running, false, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < NUM_IRQ_GUARDS; i++) {
+      if (irq_guards[i].clock == clock && __atomic_load_n(&irq_guards[i].busy, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&p_clock->running, true, __ATOMIC_SEQ_CST);
+        resume_deferred_irqs(clock);
+        return false;
+      }
+    }
+  }
+
+  // Only one of the two requests may be set at a time
+  unsigned int config = HWREG(subsystem_base + PWMSS_CLOCK_CONFIG);
+  unsigned int ack;
+  if (enable) {
+    config = (config & ~p_clock->stop_bit) | p_clock->enable_bit;
+    ack = p_clock->enable_bit;
+  } else {
+    config = (config & ~p_clock->enable_bit) | p_clock->stop_bit;
+    ack = p_clock->stop_bit;
+  }
+  HWREG(subsystem_base + PWMSS_CLOCK_CONFIG) = config;
+
+  uint32_t polls = 0;
+  while ((HWREG(subsystem_base + PWMSS_CLOCK_STATUS) & ack) == 0) {
+    if (++polls == PWMSS_CLOCK_ACK_POLLS) {
+      pwmss_clock_ack_timeouts++;
+      kos_printf("PWMSS clock %d did not acknowledge %s\n", clock, enable ? "enable" : "stop");
+      break;
+    }
+  }
+
+  if (enable && !p_clock->running) {
+    p_clock->restarts++;
+    p_clock->last_restart_polls = polls;
+    if (polls > p_clock->max_restart_polls) {
+      p_clock->max_restart_polls = polls;
+    }
+  }
+  __atomic_store_n(&p_clock->running, enable, __ATOMIC_SEQ_CST);
+  if (enable) {
+    resume_deferred_irqs(clock);
+  }
+  return true;
+}
+
+static void ensure_pwmss_clock(int clock) {
+  if (!pwmss_clocks[clock].running) {
+    pwmss_clock_set(clock, true);
+  }
+}
+
+static void set_pwm_clock(bool enable) {
+  pwmss_clock_set(PWMSS_CLOCK_EPWM, enable);
+  pwm_clock_stopped = !enable;
+}
+
+// A writer of the status page never waits for another one. It marks a write as
+// pending and only takes the sequence from even to odd if no other writer
+// holds it. A writer that preempted another one leaves its write pending, and
+// the writer it preempted does it again before it lets the sequence go.
+static inline void status_write_request(void) {
+  __atomic_store_n(&status_pending, 1, __ATOMIC_SEQ_CST);
+}
+
+// Returns true with the sequence taken in *p_taken while there is a write
+// pending that this thread should do
+static bool status_write_begin(uint32_t *p_taken) {
+  while (__atomic_load_n(&status_pending, __ATOMIC_SEQ_CST)) {
+    uint32_t sequence = __atomic_load_n(&p_status->sequence, __ATOMIC_SEQ_CST);
+    if (sequence & 1)
+      return false;
+    if (__atomic_compare_exchange_n(&p_status->sequence, &sequence, sequence + 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&status_pending, 0, __ATOMIC_SEQ_CST);
+      *p_taken = sequence;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline void status_write_end(uint32_t taken) {
+  __atomic_store_n(&p_status->sequence, taken + 2, __ATOMIC_SEQ_CST);
+}
+
+static void publish_status(void) {
+  if (p_status == NULL)
+    return;
+
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
+  pwm_status_t *p_entry = &p_status->status;
+  uint32_t sequence;
+
+  status_write_request();
+
+  while (status_write_begin(&sequence)) {
+    p_entry->freq = curr_freq;
+    memcpy(p_entry->duty_cycle, curr_pin_duty_cycle, sizeof(p_entry->duty_cycle));
+    p_entry->counter_mode = curr_counter_mode;
+    memcpy(p_entry->output_mode, curr_pin_output_mode, sizeof(p_entry->output_mode));
+    p_entry->apwm_freq = curr_apwm_freq;
+    p_entry->apwm_duty_cycle = curr_apwm_duty_cycle;
+    p_entry->apwm_output_mode = curr_apwm_output_mode;
+    // The registers can't be read while the clock is stopped
+    if (pwmss_clocks[PWMSS_CLOCK_EPWM].running) {
+      unsigned int tbctl = HWREGH(controller_base + EHRPWM_TBCTL);
+      p_entry->tbprd = HWREGH(controller_base + EHRPWM_TBPRD);
+      p_entry->clkdiv = (tbctl & EHRPWM_TBCTL_CLKDIV) >> EHRPWM_TBCTL_CLKDIV_SHIFT;
+      p_entry->hspclkdiv = (tbctl & EHRPWM_TBCTL_HSPCLKDIV) >> EHRPWM_TBCTL_HSPCLKDIV_SHIFT;
+      p_entry->cmpa = HWREGH(controller_base + EHRPWM_CMPA);
+      p_entry->cmpb = HWREGH(controller_base + EHRPWM_CMPB);
+      p_entry->trip_flags = HWREGH(controller_base + EHRPWM_TZFLG);
+    }
+    p_entry->clock_stopped = pwm_clock_stopped;
+    p_entry->updates++;
+
+    status_write_end(sequence);
+  }
+}
+
+// The status page follows every change that is checkpointed
+static void checkpoint_pwm(void) {
+  publish_status();
+
+  if (p_checkpoint == NULL)
+    return;
+
+  p_checkpoint->sequence++;
+  __sync_synchronize();
+
+  // The registers can't be read while the clock is stopped, the context saved
+  // before it was stopped still holds
+  if (pwmss_clocks[PWMSS_CLOCK_EPWM].running) {
+    EHRPWMContextSave((unsigned int) pwm_controller_base, &p_checkpoint->context);
+  }
+  p_checkpoint->paddr = pwm_controller_paddr;
+  p_checkpoint->freq = curr_freq;
+  memcpy(p_checkpoint->pin_duty_cycle, curr_pin_duty_cycle, sizeof(curr_pin_duty_cycle));
+  p_checkpoint->counter_mode = curr_counter_mode;
+  memcpy(p_checkpoint->pin_output_mode, curr_pin_output_mode, sizeof(curr_pin_output_mode));
+  p_checkpoint->clock_stopped = pwm_clock_stopped;
+  if (qep_unit_period_us != 0) {
+    EQEPContextSave((unsigned int) qep_base, &p_checkpoint->qep_context);
+  }
+  p_checkpoint->qep_unit_period_us = qep_unit_period_us;
+  p_checkpoint->qep_max_position = qep_max_position;
+  p_checkpoint->ecap_mode = ecap_mode;
+  p_checkpoint->ecap_falling_edges = ecap_falling_edges;
+  p_checkpoint->ecap_delta = ecap_delta;
+  if (ecap_mode == ECAP_MODE_APWM) {
+    ECAPContextSave((unsigned int) ecap_base, &p_checkpoint->ecap_context);
+    // The shadow registers may not have been loaded yet, record the values
+    // they are about to load
+    uint32_t compare;
+    uint32_t period;
+    unsigned int polarity;
+    calc_apwm_counter_values(&compare, &period, &polarity);
+    p_checkpoint->ecap_context.cap1 = period;
+    p_checkpoint->ecap_context.cap2 = compare;
+  }
+  p_checkpoint->apwm_freq = curr_apwm_freq;
+  p_checkpoint->apwm_duty_cycle = curr_apwm_duty_cycle;
+  p_checkpoint->apwm_output_mode = curr_apwm_output_mode;
+  p_checkpoint->idle_stop = idle_stop;
+
+  __sync_synchronize();
+  p_checkpoint->sequence++;
+}
+
+static kos_msg_t handle_set_pwm_clock(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_CLOCK_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t enable = transport[0];
+
+  set_pwm_clock(enable != 0);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_set_pwm_idle_stop(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_IDLE_STOP_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  // The idle clocks are stopped once the request is done
+  idle_stop = transport[0] != 0;
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_get_pwm_clock_status(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * GET_PWM_CLOCK_STATUS_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  transport[0] = HWREG((unsigned int) pwmss_base + PWMSS_CLOCK_STATUS);
+  transport[1] = pwmss_clock_ack_timeouts;
+  for (int i = 0; i < NUM_PWMSS_CLOCKS; i++) {
+    uint32_t *p_entry = &transport[GET_PWM_CLOCK_STATUS_HEADER + i * PWMSS_CLOCK_STATUS_WORDS];
+    p_entry[0] = pwmss_clocks[i].running;
+    p_entry[1] = pwmss_clocks[i].restarts;
+    p_entry[2] = pwmss_clocks[i].last_restart_polls;
+    p_entry[3] = pwmss_clocks[i].max_restart_polls;
+  }
+
+  return kos_msg_new(STATUS_OK, 0,
+                     sizeof(uint32_t) * (GET_PWM_CLOCK_STATUS_HEADER + NUM_PWMSS_CLOCKS * PWMSS_CLOCK_STATUS_WORDS),
+                     0, 0);
+}
+
+static void configure_qep(uint32_t unit_period_us, uint32_t max_position) {
+  unsigned int encoder_base = (unsigned int) qep_base;
+
+  ensure_pwmss_clock(PWMSS_CLOCK_EQEP);
+
+  // Stop the encoder and its interrupts for the whole of the reconfiguration,
+  // so the interrupt thread doesn't see a unit time out against the new period
+  EQEPIntDisable(encoder_base, EQEP_INT_UTO | EQEP_INT_IEL);
+  EQEPPositionCounterDisable(encoder_base);
+  EQEPIntClear(encoder_base, EQEP_INT_UTO | EQEP_INT_IEL);
+
+  qep_unit_period_us = unit_period_us;
+  qep_max_position = max_position;
+  __atomic_add_fetch(&qep_config_generation, 1, __ATOMIC_SEQ_CST);
+
+  // Count both edges of both inputs, wrapping at the maximum position in
+  // either direction. The index only latches the position, so a missing or
+  // noisy index pulse can't corrupt the count.
+  EQEPDecoderConfigure(encoder_base, EQEP_SOURCE_QUADRATURE, false);
+  EQEPPositionCounterConfigure(encoder_base,
+                               EQEP_POSITION_RESET_MAXPOS,
+                               qep_max_position,
+                               EQEP_INDEX_LATCH_RISING);
+  EQEPEmulationModeSet(encoder_base, EQEP_EMULATION_FREE_RUN);
+  EQEPUnitTimerEnable(encoder_base, qep_unit_period_us * QEP_CYCLES_PER_US);
+  EQEPPositionCounterEnable(encoder_base);
+  EQEPPositionSet(encoder_base, 0);
+
+  if (qep_irq_available) {
+    EQEPIntEnable(encoder_base, EQEP_INT_UTO | EQEP_INT_IEL);
+  }
+}
+
+// Signed number of counts moved between two position latches, taking the
+// shorter way around the wrap at the maximum position
+static int64_t qep_position_delta(uint32_t latch, uint32_t previous) {
+  int64_t range = (int64_t) qep_max_position + 1;
+  int64_t delta = (int64_t) latch - (int64_t) previous;
+
+  if (delta > range / 2) {
+    delta -= range;
+  } else if (delta < -(range / 2)) {
+    delta += range;
+  }
+  return delta;
+}
+
+static kos_msg_t handle_configure_qep(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * CONFIGURE_QEP_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t unit_period_us = transport[0];
+  uint32_t max_position = transport[1];
+
+  if (unit_period_us == 0 || unit_period_us > QEP_MAX_UNIT_PERIOD_US || max_position == 0) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  configure_qep(unit_period_us, max_position);
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_get_qep_position(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * GET_QEP_POSITION_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  if (qep_unit_period_us == 0)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  unsigned int encoder_base = (unsigned int) qep_base;
+
+  transport[0] = EQEPPositionGet(encoder_base);
+  transport[1] = EQEPStatusGet(encoder_base, EQEP_QEPSTS_QDF) != 0;
+
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * GET_QEP_POSITION_RESULTS, 0, 0);
+}
+
+static kos_msg_t handle_get_qep_velocity(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * GET_QEP_VELOCITY_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  if (!qep_irq_available)
+    return kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
+  if (qep_unit_period_us == 0)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+  bool reset = qep_state_generation != __atomic_load_n(&qep_config_generation, __ATOMIC_ACQUIRE);
+
+  transport[0] = reset ? 0 : (uint32_t) qep_velocity;
+  transport[1] = reset ? 0 : qep_unit_event_count;
+
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * GET_QEP_VELOCITY_RESULTS, 0, 0);
+}
+
+static kos_msg_t handle_get_qep_index(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * GET_QEP_INDEX_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  if (!qep_irq_available)
+    return kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
+  if (qep_unit_period_us == 0)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+  bool reset = qep_state_generation != __atomic_load_n(&qep_config_generation, __ATOMIC_ACQUIRE);
+
+  transport[0] = reset ? 0 : qep_index_event_count;
+  transport[1] = EQEPIndexLatchGet((unsigned int) qep_base);
+
+  return kos_msg_new(STATUS_OK, 0, sizeof(uint32_t) * GET_QEP_INDEX_RESULTS, 0, 0);
+}
+
+static unsigned int ecap_event_polarity(int event) {
+  return (ecap_falling_edges & (1 << event)) ? ECAP_CAPTURE_FALLING_EDGE : ECAP_CAPTURE_RISING_EDGE;
+}
+
+static void configure_ecap(void) {
+  unsigned int capture_base = (unsigned int) ecap_base;
+
+  ensure_pwmss_clock(PWMSS_CLOCK_ECAP);
+
+  // Stop capturing while the eCAP is reconfigured
+  ECAPIntDisable(capture_base, ECAP_INT_CEVT2 | ECAP_INT_CEVT4);
+  ECAPCounterControl(capture_base, ECAP_COUNTER_STOP);
+  ECAPCaptureLoadingDisable(capture_base);
+
+  // Drop anything that was captured with the old configuration
+  ecap_ring_tail = ecap_ring_head;
+  ecap_overrun_base = ecap_overrun_count;
+
+  if (ecap_mode == ECAP_MODE_APWM) {
+    uint32_t compare;
+    uint32_t period;
+    unsigned int polarity;
+
+    calc_apwm_counter_values(&compare, &period, &polarity);
+    ECAPOperatingModeSelect(capture_base, ECAP_APWM_MODE);
+    ECAPEmulationModeSet(capture_base, ECAP_EMULATION_FREE_RUN);
+    ECAPSyncInOutSelect(capture_base, false, ECAP_SYNC_OUT_DISABLE);
+    ECAPAPWMPolarityConfig(capture_base, polarity);
+    ECAPAPWMCaptureConfig(capture_base, compare, period);
+    ECAPAPWMShadowCaptureConfig(capture_base, compare, period);
+    ECAPCounterConfig(capture_base, 0);
+    ECAPCounterControl(capture_base, ECAP_COUNTER_FREE_RUNNING);
+    return;
+  }
+
+  if (ecap_mode != ECAP_MODE_CAPTURE) {
+    return;
+  }
+
+  ECAPOperatingModeSelect(capture_base, ECAP_CAPTURE_MODE);
+  ECAPEmulationModeSet(capture_base, ECAP_EMULATION_FREE_RUN);
+  ECAPPrescaleConfig(capture_base, 0);
+  ECAPCapeEvtPolarityConfig(capture_base,
+                            ecap_event_polarity(0),
+                            ecap_event_polarity(1),
+                            ecap_event_polarity(2),
+                            ecap_event_polarity(3));
+  ECAPCaptureEvtCntrRstConfig(capture_base, ecap_delta, ecap_delta, ecap_delta, ecap_delta);
+  ECAPContinousModeConfig(capture_base);
+  ECAPSyncInOutSelect(capture_base, false, ECAP_SYNC_OUT_DISABLE);
+  ECAPCounterConfig(capture_base, 0);
+  ECAPIntStatusClear(capture_base,
+                     ECAP_INT_CEVT1 | ECAP_INT_CEVT2 | ECAP_INT_CEVT3 | ECAP_INT_CEVT4 | ECAP_INT_CTROVF);
+  ECAPOneShotREARM(capture_base);
+  ECAPCaptureLoadingEnable(capture_base);
+
+  // Collect the captures two at a time, so that CAP1 and CAP2 are read while
+  // CAP3 and CAP4 are being filled and the other way around
+  ECAPIntEnable(capture_base, ECAP_INT_CEVT2 | ECAP_INT_CEVT4);
+  ECAPCounterControl(capture_base, ECAP_COUNTER_FREE_RUNNING);
+}
+
+static kos_msg_t handle_configure_ecap_capture(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * CONFIGURE_ECAP_CAPTURE_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  if (!ecap_irq_available)
+    return kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t enable = transport[0];
+  uint32_t falling_edges = transport[1];
+  uint32_t delta = transport[2];
+
+  if (falling_edges & ~ECAP_ALL_EVENTS) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  // Stopping capture leaves the APWM alone, starting it takes over the eCAP
+  if (!enable && ecap_mode != ECAP_MODE_CAPTURE) {
+    return kos_msg_new_status(STATUS_OK);
+  }
+
+  ecap_mode = enable ? ECAP_MODE_CAPTURE : ECAP_MODE_OFF;
+  ecap_falling_edges = falling_edges;
+  ecap_delta = delta != 0;
+
+  configure_ecap();
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static kos_msg_t handle_get_ecap_captures(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * GET_ECAP_CAPTURES_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  if (ecap_mode != ECAP_MODE_CAPTURE)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t tail = ecap_ring_tail;
+  uint32_t count = ecap_ring_head - tail;
+  if (count > MAX_ECAP_CAPTURE_BATCH) {
+    count = MAX_ECAP_CAPTURE_BATCH;
+  }
+  // Don't read the entries before the head that published them
+  __sync_synchronize();
+
+  transport[0] = count;
+  transport[1] = ecap_overrun_count - ecap_overrun_base;
+  for (uint32_t i = 0; i < count; i++) {
+    ecap_capture_t *p_capture = &ecap_ring[(tail + i) % ECAP_RING_SIZE];
+    transport[GET_ECAP_CAPTURES_HEADER + i * ECAP_CAPTURE_WORDS] = p_capture->event;
+    transport[GET_ECAP_CAPTURES_HEADER + i * ECAP_CAPTURE_WORDS + 1] = p_capture->timestamp;
+  }
+
+  // Hand the entries back to the interrupt thread only once they are copied
+  __sync_synchronize();
+  ecap_ring_tail = tail + count;
+
+  return kos_msg_new(STATUS_OK, 0,
+                     sizeof(uint32_t) * (GET_ECAP_CAPTURES_HEADER + count * ECAP_CAPTURE_WORDS),
+                     0, 0);
+}
+
+static kos_msg_t handle_set_apwm_frequency(kos_msg_t msg, seL4_Word caller_id) {
+  if (caller_id != client_id)
+    return kos_msg_new_status(STATUS_UNAUTHORIZED);
+  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_APWM_FREQUENCY_ARGS)
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+
+  uint32_t *transport = kos_msg_server_payload();
+
+  uint32_t frequency = transport[0];
+
+  // The period needs at least two counts for the output to ever toggle
+  if (frequency > TB_CLK / 2) {
+    return kos_msg_new_status(STATUS_BAD_REQUEST);
+  }
+
+  curr_apwm_freq = frequency;
+
+  if (frequency == 0) {
+    // Stopping the APWM leaves capture alone
+    if (ecap_mode == ECAP_MODE_APWM) {
+      ecap_mode = ECAP_MODE_OFF;
+      configure_ecap();
+    }
+  } else if (ecap_mode != ECAP_MODE_APWM) {
+    // Starting the APWM takes over the eCAP from capture
+    ecap_mode = ECAP_MODE_APWM;
+    configure_ecap();
+  } else {
+    apply_apwm();
+  }
+
+  return kos_msg_new_status(STATUS_OK);
+}
+
+static void irq_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word garbage) {
+  (void) p_env;
+  (void) garbage;
 
-#define AM335X_PWM0_PADDR 0x48300000
-#define AM335X_PWM1_PADDR 0x48302000
-#define AM335X_PWM2_PADDR 0x48304000
-#define NUM_PWM 3
+  unsigned int controller_base = (unsigned int) pwm_controller_base;
 
-#define MODULE_CLK 100000000
-#define TB_CLK 100000000
+  while (true) {
+    kos_irq_wait(&pwm_irq);
 
-#define PIN_A 0
-#define PIN_B 1
-#define NUM_PINS 2
+    if (!irq_guard_begin(IRQ_GUARD_EPWM))
+      continue;
 
-#define SET_PWM_FREQUENCY_ARGS 1
-#define SET_PWM_DUTY_CYCLE_ARGS 2
+    if (EHRPWMETIntStatus(controller_base)) {
+      period_event_count++;
+    }
 
-static kos_msg_server_t server;
-static kos_thread_mgr_entry_t root_manager_entry;
-static kos_thread_mgr_t root_thread_mgr;
-static kos_thread_t listener_thread;
+    // The event trigger only raises another interrupt once its flag is cleared
+    EHRPWMETIntClear(controller_base);
+    irq_guard_end(IRQ_GUARD_EPWM);
+    kos_irq_ack(&pwm_irq);
+  }
+}
 
-static char* protocol_name;
+static void qep_irq_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word garbage) {
+  (void) p_env;
+  (void) garbage;
 
-// ID of the only client that can be registered with us, only support one client
-seL4_Word client_id;
+  unsigned int encoder_base = (unsigned int) qep_base;
 
-enum request_label {
-  SET_PWM_FREQUENCY_REQUEST = 1,
-  SET_PWM_DUTY_CYCLE_REQUEST,
-  NUM_PWM_REQUESTS
-};
+  while (true) {
+    kos_irq_wait(&qep_irq);
 
-static kos_device_frame_t pwm_controller_frames[] = {
-  {.paddr = AM335X_PWM0_PADDR, .size = KOS_EXP2(seL4_PageBits)},
-  {.paddr = AM335X_PWM1_PADDR, .size = KOS_EXP2(seL4_PageBits)},
-  {.paddr = AM335X_PWM2_PADDR, .size = KOS_EXP2(seL4_PageBits)}
-};
+    if (!irq_guard_begin(IRQ_GUARD_QEP))
+      continue;
 
-static seL4_Word pwm_controller_base;
-static uint32_t curr_freq;
-static uint32_t curr_pin_duty_cycle[NUM_PINS] = {0};
+    uint32_t generation = __atomic_load_n(&qep_config_generation, __ATOMIC_ACQUIRE);
+    uint32_t unit_period_us = qep_unit_period_us;
 
-static kos_msg_t handle_request(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id) {
-  if (badge != PWM_PROTOCOL_BADGE)
-    return kos_msg_new_status(STATUS_NOT_IMPLEMENTED);
-  if (caller_id == 0)
-    return kos_msg_new_status(STATUS_BAD_REQUEST);
-  if (client_id != 0 && client_id != caller_id)
-    // Don't support more than one client
-    return kos_msg_new_status(STATUS_FULL);
+    if (generation != qep_state_generation) {
+      qep_last_latch = 0;
+      qep_velocity = 0;
+      qep_unit_event_count = 0;
+      qep_index_event_count = 0;
+      __atomic_store_n(&qep_state_generation, generation, __ATOMIC_RELEASE);
+    }
 
-  // Create the token that we send to the client
-  kos_assert_created(
-    kos_msg_token_create(
-      PWM_PROTOCOL_BADGE, // IN seL4_Word badge,
-      KOS_MSG_FLAG_SEND_PAYLOAD, // IN uint8_t flags,
-      TRANSFER_TOKEN_SLOT
-    ),
-    "create pwm token to give"
-  );
+    unsigned int flags = EQEPIntStatus(encoder_base, EQEP_INT_UTO | EQEP_INT_IEL);
 
-  client_id = caller_id;
+    if ((flags & EQEP_INT_UTO) && unit_period_us != 0) {
+      // The position was latched by the hardware at the unit time out, so the
+      // velocity is exact however late this thread gets to run
+      uint32_t latch = EQEPPositionLatchGet(encoder_base);
+      int64_t delta = qep_position_delta(latch, qep_last_latch);
+      qep_last_latch = latch;
+      qep_velocity = (int32_t) (delta * 1000000 / unit_period_us);
+      qep_unit_event_count++;
+    }
+    if (flags & EQEP_INT_IEL) {
+      qep_index_event_count++;
+    }
 
-  return kos_msg_new(STATUS_OK, 0, 0, TRANSFER_TOKEN_SLOT, 0);
+    // No further interrupts are raised until the flags are cleared
+    EQEPIntClear(encoder_base, flags);
+    irq_guard_end(IRQ_GUARD_QEP);
+    kos_irq_ack(&qep_irq);
+  }
 }
 
-static void calc_and_set_counter_values(int pin, uint32_t duty_cycle) {
-  if (curr_freq == 0) {
-    // Avoid divide by zero
-    return;
-  }
+static void tz_irq_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word garbage) {
+  (void) p_env;
+  (void) garbage;
 
   unsigned int controller_base = (unsigned int) pwm_controller_base;
 
-  uint32_t period_count = TB_CLK / curr_freq;
-  uint32_t counter_value = (uint32_t) (duty_cycle / 100.0 * period_count);
+  while (true) {
+    kos_irq_wait(&tz_irq);
 
-  if (pin == PIN_A) {
-    EHRPWMLoadCMPA(controller_base,
-                   counter_value,
-                   EHRPWM_SHADOW_WRITE_ENABLE,
-                   EHRPWM_CMPCTL_LOADAMODE_TBCTRZERO,
-                   EHRPWM_CMPCTL_OVERWR_SH_FL);
-  } else {
-    EHRPWMLoadCMPB(controller_base,
-                   counter_value,
-                   EHRPWM_SHADOW_WRITE_ENABLE,
-                   EHRPWM_CMPCTL_LOADAMODE_TBCTRZERO,
-                   EHRPWM_CMPCTL_OVERWR_SH_FL);
+    if (!irq_guard_begin(IRQ_GUARD_TZ))
+      continue;
+
+    // The trip flags stay set until they are cleared, the page shows them
+    // as they are
+    publish_status();
+
+    // No further interrupts are raised until the flag is cleared
+    EHRPWMTZFlagClear(controller_base, EHRPWM_TZCLR_INT);
+    irq_guard_end(IRQ_GUARD_TZ);
+    kos_irq_ack(&tz_irq);
   }
 }
 
-static kos_msg_t handle_set_pwm_frequency(kos_msg_t msg, seL4_Word caller_id) {
-  if (caller_id != client_id)
-    return kos_msg_new_status(STATUS_UNAUTHORIZED);
-  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_FREQUENCY_ARGS)
-    return kos_msg_new_status(STATUS_BAD_REQUEST);
+static void ecap_push_capture(uint32_t event, unsigned int capture_register) {
+  unsigned int capture_base = (unsigned int) ecap_base;
+  uint32_t head = ecap_ring_head;
 
-  uint32_t *transport = kos_msg_server_payload();
+  if (head - ecap_ring_tail >= ECAP_RING_SIZE) {
+    ecap_overrun_count++;
+    return;
+  }
 
-  uint32_t frequency = transport[0];
+  ecap_ring[head % ECAP_RING_SIZE].event = event;
+  ecap_ring[head % ECAP_RING_SIZE].timestamp = ECAPTimeStampRead(capture_base, capture_register);
 
-  unsigned int controller_base = (unsigned int) pwm_controller_base;
+  // Publish the entry only once it is written
+  __sync_synchronize();
+  ecap_ring_head = head + 1;
+}
 
-  // Set the frequency
-  EHRPWMPWMOpFreqSet(controller_base, TB_CLK, frequency, EHRPWM_COUNT_UP, EHRPWM_SHADOW_WRITE_ENABLE);
+static void ecap_irq_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word garbage) {
+  (void) p_env;
+  (void) garbage;
 
-  curr_freq = frequency;
+  unsigned int capture_base = (unsigned int) ecap_base;
 
-  // Update the counter values of the PWMs
-  calc_and_set_counter_values(PIN_A, curr_pin_duty_cycle[PIN_A]);
-  calc_and_set_counter_values(PIN_B, curr_pin_duty_cycle[PIN_B]);
+  while (true) {
+    kos_irq_wait(&ecap_irq);
 
-  return kos_msg_new_status(STATUS_OK);
+    if (!irq_guard_begin(IRQ_GUARD_ECAP))
+      continue;
+
+    unsigned int flags = ECAPIntStatus(capture_base, ECAP_INT_CEVT2 | ECAP_INT_CEVT4);
+
+    // With both halves pending the older one may already have been
+    // overwritten, and there is no telling which one is older
+    if (flags == (ECAP_INT_CEVT2 | ECAP_INT_CEVT4)) {
+      ecap_overrun_count++;
+    }
+    if (flags & ECAP_INT_CEVT2) {
+      ecap_push_capture(0, ECAP_CAPTURE_EVENT_1);
+      ecap_push_capture(1, ECAP_CAPTURE_EVENT_2);
+    }
+    if (flags & ECAP_INT_CEVT4) {
+      ecap_push_capture(2, ECAP_CAPTURE_EVENT_3);
+      ecap_push_capture(3, ECAP_CAPTURE_EVENT_4);
+    }
+
+    // No further interrupts are raised until the flags are cleared
+    ECAPIntStatusClear(capture_base, flags);
+    irq_guard_end(IRQ_GUARD_ECAP);
+    kos_irq_ack(&ecap_irq);
+  }
 }
 
-static kos_msg_t handle_set_pwm_duty_cycle(kos_msg_t msg, seL4_Word caller_id) {
-  if (caller_id != client_id)
-    return kos_msg_new_status(STATUS_UNAUTHORIZED);
-  if (kos_msg_payload_size(msg.metadata) != sizeof(uint32_t) * SET_PWM_DUTY_CYCLE_ARGS)
-    return kos_msg_new_status(STATUS_BAD_REQUEST);
+// An ePWM pin is static when its output is held by the continuous software
+// force, so it keeps its level with the clock stopped
+static bool epwm_pin_static(int pin) {
+  return curr_pin_output_mode[pin] == OUTPUT_MODE_FORCE_LOW ||
+         curr_pin_output_mode[pin] == OUTPUT_MODE_FORCE_HIGH ||
+         curr_pin_duty_cycle[pin] == 0 ||
+         curr_pin_duty_cycle[pin] >= 100;
+}
 
-  uint32_t *transport = kos_msg_server_payload();
+static void stop_idle_clocks(void) {
+  if (pwmss_clocks[PWMSS_CLOCK_EPWM].running && !period_events_enabled &&
+      epwm_pin_static(PIN_A) && epwm_pin_static(PIN_B)) {
+    pwmss_clock_set(PWMSS_CLOCK_EPWM, false);
+  }
+  if (pwmss_clocks[PWMSS_CLOCK_ECAP].running && ecap_mode == ECAP_MODE_OFF) {
+    pwmss_clock_set(PWMSS_CLOCK_ECAP, false);
+  }
+  if (pwmss_clocks[PWMSS_CLOCK_EQEP].running && qep_unit_period_us == 0) {
+    pwmss_clock_set(PWMSS_CLOCK_EQEP, false);
+  }
+}
 
-  uint32_t pin = transport[0];
-  uint32_t duty_cycle = transport[1];
+// Whether a request touches the ePWM registers, the eCAP and eQEP requests
+// start their own clocks when they need them
+static bool request_needs_epwm(kos_msg_t msg) {
+  switch (msg.label) {
+    case SET_PWM_DUTY_CYCLE_REQUEST:
+    case SET_PWM_OUTPUT_MODE_REQUEST:
+      // These address the APWM as well, which is part of the eCAP
+      if (kos_msg_payload_size(msg.metadata) >= sizeof(uint32_t)) {
+        uint32_t *transport = kos_msg_server_payload();
+        return transport[0] != PIN_APWM;
+      }
+      return true;
+    case FAST_SET_PWM_DUTY_CYCLE_REQUEST:
+      return (msg.param & FAST_ARG_PIN_MASK) != PIN_APWM;
+    case SET_PWM_FREQUENCY_REQUEST:
+    case SET_PWM_COUNTER_MODE_REQUEST:
+    case GET_PWM_COUNTER_REQUEST:
+    case SET_PWM_PERIOD_EVENTS_REQUEST:
+      return true;
+    default:
+      return false;
+  }
+}
 
-  unsigned int controller_base = (unsigned int) pwm_controller_base;
+// Requests that only read state, these don't need a new checkpoint
+static bool is_query_request(seL4_Word request) {
+  return request == (seL4_Word) PWM_REQUEST_LABEL ||
+         request == GET_PWM_COUNTER_REQUEST ||
+         request == GET_QEP_POSITION_REQUEST ||
+         request == GET_QEP_VELOCITY_REQUEST ||
+         request == GET_QEP_INDEX_REQUEST ||
+         request == GET_ECAP_CAPTURES_REQUEST ||
+         request == GET_PWM_CLOCK_STATUS_REQUEST;
+}
 
-  // Load the duty cycle value in
-  if (pin == PIN_A) {
-    curr_pin_duty_cycle[PIN_A] = duty_cycle;
-    calc_and_set_counter_values(PIN_A, curr_pin_duty_cycle[PIN_A]);
-  } else {
-    curr_pin_duty_cycle[PIN_B] = duty_cycle;
-    calc_and_set_counter_values(PIN_B, curr_pin_duty_cycle[PIN_B]);
+// Serves a request received by the listener, or by the combined I/O service
+// on our behalf
+static kos_msg_t dispatch(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id) {
+  // Check the protocol via the badge first
+  if (badge != PWM_PROTOCOL_BADGE) {
+    return kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
   }
 
-  return kos_msg_new_status(STATUS_OK);
+  // The ePWM registers can't be accessed while its clock is stopped. If
+  // the client stopped it the request is refused, if idle stop did it is
+  // started again.
+  if (request_needs_epwm(msg)) {
+    if (pwm_clock_stopped) {
+      return kos_msg_new_status(STATUS_BAD_REQUEST);
+    }
+    ensure_pwmss_clock(PWMSS_CLOCK_EPWM);
+  }
+
+  seL4_Word request = msg.label;
+
+  // Act on the label
+  switch (msg.label) {
+    case PWM_REQUEST_LABEL:
+      msg = handle_request(msg, badge, caller_id);
+      break;
+    case SET_PWM_FREQUENCY_REQUEST:
+      msg = handle_set_pwm_frequency(msg, caller_id);
+      break;
+    case SET_PWM_DUTY_CYCLE_REQUEST:
+      msg = handle_set_pwm_duty_cycle(msg, caller_id);
+      break;
+    case FAST_SET_PWM_DUTY_CYCLE_REQUEST:
+      msg = handle_fast_set_pwm_duty_cycle(msg, caller_id);
+      break;
+    case SET_PWM_COUNTER_MODE_REQUEST:
+      msg = handle_set_pwm_counter_mode(msg, caller_id);
+      break;
+    case SET_PWM_OUTPUT_MODE_REQUEST:
+      msg = handle_set_pwm_output_mode(msg, caller_id);
+      break;
+    case GET_PWM_COUNTER_REQUEST:
+      msg = handle_get_pwm_counter(msg, caller_id);
+      break;
+    case SET_PWM_PERIOD_EVENTS_REQUEST:
+      msg = handle_set_pwm_period_events(msg, caller_id);
+      break;
+    case SET_PWM_CLOCK_REQUEST:
+      msg = handle_set_pwm_clock(msg, caller_id);
+      break;
+    case CONFIGURE_QEP_REQUEST:
+      msg = handle_configure_qep(msg, caller_id);
+      break;
+    case GET_QEP_POSITION_REQUEST:
+      msg = handle_get_qep_position(msg, caller_id);
+      break;
+    case GET_QEP_VELOCITY_REQUEST:
+      msg = handle_get_qep_velocity(msg, caller_id);
+      break;
+    case GET_QEP_INDEX_REQUEST:
+      msg = handle_get_qep_index(msg, caller_id);
+      break;
+    case CONFIGURE_ECAP_CAPTURE_REQUEST:
+      msg = handle_configure_ecap_capture(msg, caller_id);
+      break;
+    case GET_ECAP_CAPTURES_REQUEST:
+      msg = handle_get_ecap_captures(msg, caller_id);
+      break;
+    case SET_APWM_FREQUENCY_REQUEST:
+      msg = handle_set_apwm_frequency(msg, caller_id);
+      break;
+    case SET_PWM_IDLE_STOP_REQUEST:
+      msg = handle_set_pwm_idle_stop(msg, caller_id);
+      break;
+    case GET_PWM_CLOCK_STATUS_REQUEST:
+      msg = handle_get_pwm_clock_status(msg, caller_id);
+      break;
+    default:
+      msg = kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
+      break;
+  }
+
+  // Keep the checkpoint up to date with anything that changed the controller
+  if (msg.label == STATUS_OK && !is_query_request(request)) {
+    checkpoint_pwm();
+  }
+
+  // A stop of the ePWM clock that an interrupt thread held off is done after a
+  // later request
+  if (pwm_clock_stopped && pwmss_clocks[PWMSS_CLOCK_EPWM].running) {
+    pwmss_clock_set(PWMSS_CLOCK_EPWM, false);
+  }
+
+  if (idle_stop) {
+    stop_idle_clocks();
+  }
+
+  return msg;
 }
 
+#ifndef KOS_AM335X_IO
 static void listen_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word garbage) {
+  (void) garbage;
+
   // Publish the KOS am335x PWM protocol
   kos_assert_ok(
     kos_dir_publish_str(
@@ -221,29 +1730,10 @@ static void listen_thread_fn(IN kos_thread_environment_t* p_env, IN seL4_Word ga
 
     caller_id = seL4_MessageInfo_get_label(sel4_msg);
 
-    // Check the protocol via the badge first
-    if (badge != PWM_PROTOCOL_BADGE) {
-      msg = kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
-      continue;
-    }
-
-    // Act on the label
-    switch (msg.label) {
-      case PWM_REQUEST_LABEL:
-        msg = handle_request(msg, badge, caller_id);
-        break;
-      case SET_PWM_FREQUENCY_REQUEST:
-        msg = handle_set_pwm_frequency(msg, caller_id);
-        break;
-      case SET_PWM_DUTY_CYCLE_REQUEST:
-        msg = handle_set_pwm_duty_cycle(msg, caller_id);
-        break;
-      default:
-        msg = kos_msg_new(STATUS_NOT_IMPLEMENTED, 0, 0, 0, 0);
-        break;
-    }
+    msg = dispatch(msg, badge, caller_id);
   }
 }
+#endif
 
 static void init_pwm_controller() {
   // Note that the pwmss timebase clocks have to be configured in the control
@@ -252,8 +1742,8 @@ static void init_pwm_controller() {
 
   unsigned int controller_base = (unsigned int) pwm_controller_base;
 
-  // Disable the clock
-  EHRPWMClockDisable(controller_base);
+  // The ePWM clock has to be running for its registers to be written
+  set_pwm_clock(true);
 
   // Configure the clock frequency
   EHRPWMTimebaseClkConfig(controller_base, TB_CLK, MODULE_CLK);
@@ -280,25 +1770,15 @@ static void init_pwm_controller() {
   EHRPWMETIntClear(controller_base);
   EHRPWMETIntDisable(controller_base);
 
-  // Configure the action qualifiers for the two PWMs to output a high-to-low
-  // signal
-  EHRPWMConfigureAQActionOnA(controller_base,
-                             EHRPWM_AQCTLA_ZRO_EPWMXAHIGH,
-                             EHRPWM_AQCTLA_PRD_DONOTHING,
-                             EHRPWM_AQCTLA_CAU_EPWMXALOW,
-                             EHRPWM_AQCTLA_CAD_DONOTHING,
-                             EHRPWM_AQCTLA_CBU_DONOTHING,
-                             EHRPWM_AQCTLA_CBD_DONOTHING,
-                             EHRPWM_AQSFRC_ACTSFA_DONOTHING);
-
-  EHRPWMConfigureAQActionOnB(controller_base,
-                             EHRPWM_AQCTLB_ZRO_EPWMXBHIGH,
-                             EHRPWM_AQCTLB_PRD_DONOTHING,
-                             EHRPWM_AQCTLB_CAU_DONOTHING,
-                             EHRPWM_AQCTLB_CAD_DONOTHING,
-                             EHRPWM_AQCTLB_CBU_EPWMXBLOW,
-                             EHRPWM_AQCTLB_CBD_DONOTHING,
-                             EHRPWM_AQSFRC_ACTSFB_DONOTHING);
+  // Trips are reported to the trip zone interrupt thread, if there is one,
+  // to refresh the status page
+  EHRPWMTZFlagClear(controller_base, EHRPWM_TZ_ONESHOT_CLEAR | EHRPWM_TZ_CYCLEBYCYCLE_CLEAR);
+  EHRPWMTZIntEnable(controller_base, EHRPWM_TZ_ONESHOT);
+  EHRPWMTZIntEnable(controller_base, EHRPWM_TZ_CYCLEBYCYCLE);
+
+  // Configure the action qualifiers for the two PWMs, this defaults to
+  // edge-aligned (count up) mode
+  configure_action_qualifiers();
 
   // Load zero into the counters for the two PWMs, this will set the duty cycle
   // to 0 and output a low signal and effectively 'stop' it
@@ -314,32 +1794,138 @@ static void init_pwm_controller() {
                  EHRPWM_CMPCTL_LOADAMODE_TBCTRZERO,
                  EHRPWM_CMPCTL_OVERWR_SH_FL);
 
-  // Enable the clock
-  EHRPWMClockEnable(controller_base);
+  // Hold both outputs at their inactive level until a duty cycle is set
+  apply_output_force(PIN_A);
+  apply_output_force(PIN_B);
 }
 
-int main(int argc, char *argv[]) {
-#ifdef VISUALIZE_STARTUP
-  kos_printf("\n");
-  kos_printf("----  %s server ----\n", argv[0]);
-#endif
+static void parse_options(int argc, char *argv[]) {
+  for (int i = FIRST_OPTION_IDX; i < argc; i++) {
+    if (strncmp(argv[i], CHECKPOINT_FRAME_OPTION, strlen(CHECKPOINT_FRAME_OPTION)) == 0) {
+      checkpoint_frame.paddr = strtoul(argv[i] + strlen(CHECKPOINT_FRAME_OPTION), NULL, 0);
+    } else if (strncmp(argv[i], STATUS_FRAME_OPTION, strlen(STATUS_FRAME_OPTION)) == 0) {
+      status_frame.paddr = strtoul(argv[i] + strlen(STATUS_FRAME_OPTION), NULL, 0);
+    } else {
+      kos_printf("ignoring unknown option '%s'\n", argv[i]);
+    }
+  }
+}
 
-  kos_assert_eq(argc, EXPECTED_ARGC, "unexpected argument counts");
+// The page is filled in by the first checkpoint, readers ignore it until the
+// magic is set
+static void map_status(void) {
+  seL4_Word status_base;
+  kos_status_t status = kos_dev_resources_map_device_frame(&status_frame,
+                                                           kos_cap_rights_all_rights(),
+                                                           NULL,
+                                                           &status_base);
+  kos_assert_ok(status, "failed to map the status frame");
+
+  p_status = (pwm_status_page_t *) status_base;
+  memset(p_status, 0, sizeof(*p_status));
+}
 
-  protocol_name = argv[PROTOCOL_NAME_IDX];
+// Takes over the controller from the checkpoint of a previous instance of the
+// service. If the controller still holds the checkpointed state it is left
+// untouched, so the outputs keep running across the restart. Returns false if
+// there is nothing to adopt and the controller needs to be initialised.
+static bool adopt_pwm_controller(void) {
+  seL4_Word checkpoint_base;
+  kos_status_t status = kos_dev_resources_map_device_frame(&checkpoint_frame,
+                                                           kos_cap_rights_all_rights(),
+                                                           NULL,
+                                                           &checkpoint_base);
+  kos_assert_ok(status, "failed to map the checkpoint frame");
+
+  p_checkpoint = (pwm_checkpoint_t *) checkpoint_base;
+
+  // Anything other than our own checkpoint of this controller is left over
+  // from something else, and an odd sequence was torn by a fault
+  if (p_checkpoint->magic != CHECKPOINT_MAGIC ||
+      p_checkpoint->paddr != pwm_controller_paddr ||
+      p_checkpoint->sequence == 0 ||
+      (p_checkpoint->sequence & 1)) {
+    memset(p_checkpoint, 0, sizeof(*p_checkpoint));
+    p_checkpoint->magic = CHECKPOINT_MAGIC;
+    return false;
+  }
 
-  // Initialize the thread manager
-  kos_assert_ok(
-    kos_thread_mgr_init(
-      &root_manager_entry, // IN_OUT kos_thread_mgr_entry_t* p_entries,
-      1, // IN seL4_Word capacity,
-      &root_thread_mgr // OUT kos_thread_mgr_t* p_thread_mgr
-    ),
-    NULL
-  );
+  if (p_checkpoint->clock_stopped && !pwmss_clocks[PWMSS_CLOCK_EPWM].running) {
+    // Nothing to compare against, the clock is started again on request
+    pwm_clock_stopped = true;
+  } else {
+    // Idle stop may have left the clock stopped, and a reset of the subsystem
+    // starts a clock that the checkpoint has as stopped
+    ensure_pwmss_clock(PWMSS_CLOCK_EPWM);
+    EHRPWMCONTEXT live;
+    EHRPWMContextSave((unsigned int) pwm_controller_base, &live);
+    if (memcmp(&live, &p_checkpoint->context, sizeof(live)) != 0) {
+      // The controller lost its state, bring it back to the checkpoint
+      init_pwm_controller();
+      EHRPWMContextRestore((unsigned int) pwm_controller_base, &p_checkpoint->context);
+    }
+    if (p_checkpoint->clock_stopped) {
+      set_pwm_clock(false);
+    }
+  }
+  period_events_enabled = (p_checkpoint->context.etsel & EHRPWM_ETSEL_INTEN) != 0;
+
+  // The encoder keeps counting across the restart as long as it kept its
+  // configuration, otherwise it starts again from position 0
+  qep_unit_period_us = p_checkpoint->qep_unit_period_us;
+  qep_max_position = p_checkpoint->qep_max_position;
+  if (qep_unit_period_us != 0) {
+    EQEPCONTEXT live;
+    ensure_pwmss_clock(PWMSS_CLOCK_EQEP);
+    EQEPContextSave((unsigned int) qep_base, &live);
+    if (memcmp(&live, &p_checkpoint->qep_context, sizeof(live)) != 0) {
+      configure_qep(qep_unit_period_us, qep_max_position);
+    } else {
+      qep_last_latch = EQEPPositionLatchGet((unsigned int) qep_base);
+    }
+  }
 
-  // Bootstrap the message server connection
-  kos_assert_created(kos_msg_setup(), NULL);
+  // Captures don't survive the restart, capturing starts again afresh. The
+  // APWM keeps running like the ePWM outputs.
+  ecap_mode = p_checkpoint->ecap_mode;
+  ecap_falling_edges = p_checkpoint->ecap_falling_edges;
+  ecap_delta = p_checkpoint->ecap_delta;
+  curr_apwm_freq = p_checkpoint->apwm_freq;
+  curr_apwm_duty_cycle = p_checkpoint->apwm_duty_cycle;
+  curr_apwm_output_mode = p_checkpoint->apwm_output_mode;
+  if (ecap_mode == ECAP_MODE_CAPTURE && !ecap_irq_available) {
+    ecap_mode = ECAP_MODE_OFF;
+  }
+  if (ecap_mode == ECAP_MODE_APWM) {
+    // Zeroed so that the padding compares equal to the checkpoint
+    ECAPCONTEXT live;
+    memset(&live, 0, sizeof(live));
+    ensure_pwmss_clock(PWMSS_CLOCK_ECAP);
+    ECAPContextSave((unsigned int) ecap_base, &live);
+    if (memcmp(&live, &p_checkpoint->ecap_context, sizeof(live)) != 0) {
+      configure_ecap();
+    }
+  } else if (ecap_mode != ECAP_MODE_OFF) {
+    configure_ecap();
+  }
+
+  idle_stop = p_checkpoint->idle_stop;
+
+  curr_freq = p_checkpoint->freq;
+  memcpy(curr_pin_duty_cycle, p_checkpoint->pin_duty_cycle, sizeof(curr_pin_duty_cycle));
+  curr_counter_mode = p_checkpoint->counter_mode;
+  memcpy(curr_pin_output_mode, p_checkpoint->pin_output_mode, sizeof(curr_pin_output_mode));
+
+  return true;
+}
+
+// Brings up the controller and starts the threads of the service, all but the
+// listener when we are part of the combined I/O service
+static void start_service(int argc, char *argv[]) {
+  kos_assert_eq(argc >= MIN_ARGC, true, "unexpected argument counts");
+
+  protocol_name = argv[PROTOCOL_NAME_IDX];
+  parse_options(argc, argv);
 
   // Find the frame of the PWM controller, it could be any one of the
   // controllers that were given to us
@@ -350,18 +1936,61 @@ int main(int argc, char *argv[]) {
     if (status == STATUS_OK) {
       status = kos_dev_resources_map_device_frame(&pwm_controller_frames[i],
                                                   kos_cap_rights_all_rights(),
-                                                  NULL, &pwm_controller_base);
+                                                  NULL, &pwmss_base);
       // The PWM register set is 0x200 off the base, there are other submodules before this
-      pwm_controller_base += 0x200;
+      pwm_controller_base = pwmss_base + 0x200;
+      pwm_controller_paddr = pwm_controller_frames[i].paddr;
+      // As are the eCAP and eQEP register sets
+      ecap_base = pwmss_base + 0x100;
+      qep_base = pwmss_base + 0x180;
+
+      // The event trigger interrupt is optional, period events are not
+      // available without it
+      pwm_irq_available = kos_dev_resources_find_irq(&pwm_controller_irqs[i], &pwm_irq) == STATUS_OK;
+
+      // Likewise the encoder interrupt, only the position is available
+      // without it
+      qep_irq_available = kos_dev_resources_find_irq(&qep_controller_irqs[i], &qep_irq) == STATUS_OK;
+
+      // Captures are collected by the capture interrupt, so there is no
+      // capturing without it
+      ecap_irq_available = kos_dev_resources_find_irq(&ecap_controller_irqs[i], &ecap_irq) == STATUS_OK;
+
+      // Without the trip zone interrupt the trip flags on the status page
+      // are only refreshed by requests
+      tz_irq_available = kos_dev_resources_find_irq(&tz_controller_irqs[i], &tz_irq) == STATUS_OK;
 
       break;
     }
   }
   kos_assert_ok(status, "failed to map a PWM controller");
 
-  // Initialize the PWM controller now
-  init_pwm_controller();
+  // Pick up the state that the submodule clocks were left in from what the
+  // PWMSS acknowledges rather than what was requested, all of them are enabled
+  // out of reset
+  unsigned int clock_status = HWREG((unsigned int) pwmss_base + PWMSS_CLOCK_STATUS);
+  for (int i = 0; i < NUM_PWMSS_CLOCKS; i++) {
+    pwmss_clocks[i].running =
+      (clock_status & pwmss_clocks[i].enable_bit) != 0 && (clock_status & pwmss_clocks[i].stop_bit) == 0;
+  }
+
+  // Initialize the PWM controller now, unless a previous instance of the
+  // service left it running
+  if (checkpoint_frame.paddr == 0 || !adopt_pwm_controller()) {
+    init_pwm_controller();
+  }
+  if (status_frame.paddr != 0) {
+    map_status();
+  }
+  checkpoint_pwm();
+  if (p_status != NULL) {
+    __atomic_store_n(&p_status->magic, PWM_STATUS_MAGIC, __ATOMIC_RELEASE);
+  }
+  if (idle_stop) {
+    stop_idle_clocks();
+  }
 
+#ifndef KOS_AM335X_IO
   // Create and start the listener thread
   kos_assert_created(
     kos_thread_create(listen_thread_fn, 0, false, &listener_thread),
@@ -370,10 +1999,10 @@ int main(int argc, char *argv[]) {
 
   kos_assert_ok(
     kos_thread_mgr_add(
-      &root_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+      p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
       &listener_thread, // IN_OUT kos_thread_t* p_thread,
       KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
-      0, // IN seL4_Word cookie,
+      LISTENER_COOKIE, // IN seL4_Word cookie,
       kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
       NULL // OPTIONAL OUT seL4_Word* p_id
     ),
@@ -384,6 +2013,144 @@ int main(int argc, char *argv[]) {
     kos_thread_start(&listener_thread), // IN_OUT kos_thread_t* p_thread,
     "failed to start listener thread"
   );
+#endif
+
+  if (pwm_irq_available) {
+    // Create and start the event trigger interrupt thread
+    kos_assert_created(
+      kos_thread_create(irq_thread_fn, 0, false, &irq_thread),
+      "failed to create interrupt thread"
+    );
+
+    kos_assert_ok(
+      kos_thread_mgr_add(
+        p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+        &irq_thread, // IN_OUT kos_thread_t* p_thread,
+        KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
+        IRQ_COOKIE, // IN seL4_Word cookie,
+        kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
+        NULL // OPTIONAL OUT seL4_Word* p_id
+      ),
+      "failed to add interrupt thread to the thread manager"
+    );
+
+    kos_assert_ok(
+      kos_thread_start(&irq_thread), // IN_OUT kos_thread_t* p_thread,
+      "failed to start interrupt thread"
+    );
+  }
+
+  if (qep_irq_available) {
+    // Create and start the encoder interrupt thread
+    kos_assert_created(
+      kos_thread_create(qep_irq_thread_fn, 0, false, &qep_irq_thread),
+      "failed to create encoder interrupt thread"
+    );
+
+    kos_assert_ok(
+      kos_thread_mgr_add(
+        p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+        &qep_irq_thread, // IN_OUT kos_thread_t* p_thread,
+        KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
+        QEP_IRQ_COOKIE, // IN seL4_Word cookie,
+        kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
+        NULL // OPTIONAL OUT seL4_Word* p_id
+      ),
+      "failed to add encoder interrupt thread to the thread manager"
+    );
+
+    kos_assert_ok(
+      kos_thread_start(&qep_irq_thread), // IN_OUT kos_thread_t* p_thread,
+      "failed to start encoder interrupt thread"
+    );
+  }
+
+  if (ecap_irq_available) {
+    // Create and start the capture interrupt thread
+    kos_assert_created(
+      kos_thread_create(ecap_irq_thread_fn, 0, false, &ecap_irq_thread),
+      "failed to create capture interrupt thread"
+    );
+
+    kos_assert_ok(
+      kos_thread_mgr_add(
+        p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+        &ecap_irq_thread, // IN_OUT kos_thread_t* p_thread,
+        KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
+        ECAP_IRQ_COOKIE, // IN seL4_Word cookie,
+        kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
+        NULL // OPTIONAL OUT seL4_Word* p_id
+      ),
+      "failed to add capture interrupt thread to the thread manager"
+    );
+
+    kos_assert_ok(
+      kos_thread_start(&ecap_irq_thread), // IN_OUT kos_thread_t* p_thread,
+      "failed to start capture interrupt thread"
+    );
+  }
+
+  if (tz_irq_available) {
+    // Create and start the trip zone interrupt thread
+    kos_assert_created(
+      kos_thread_create(tz_irq_thread_fn, 0, false, &tz_irq_thread),
+      "failed to create trip zone interrupt thread"
+    );
+
+    kos_assert_ok(
+      kos_thread_mgr_add(
+        p_thread_mgr, // IN_OUT kos_thread_mgr_t* p_thread_mgr,
+        &tz_irq_thread, // IN_OUT kos_thread_t* p_thread,
+        KOS_THREAD_MGR_NO_LIMIT, // IN seL4_Word fault_limit,
+        TZ_IRQ_COOKIE, // IN seL4_Word cookie,
+        kos_thread_fault_fn_print_faults, // OPTIONAL IN kos_thread_fault_fn fault_fn
+        NULL // OPTIONAL OUT seL4_Word* p_id
+      ),
+      "failed to add trip zone interrupt thread to the thread manager"
+    );
+
+    kos_assert_ok(
+      kos_thread_start(&tz_irq_thread), // IN_OUT kos_thread_t* p_thread,
+      "failed to start trip zone interrupt thread"
+    );
+  }
+}
+
+#ifdef KOS_AM335X_IO
+void pwm_service_start(int argc, char *argv[], kos_thread_mgr_t *p_io_thread_mgr) {
+  p_thread_mgr = p_io_thread_mgr;
+  start_service(argc, argv);
+}
+
+kos_msg_t pwm_service_dispatch(kos_msg_t msg, seL4_Word badge, seL4_Word caller_id) {
+  return dispatch(msg, badge, caller_id);
+}
+
+bool pwm_service_register_only(seL4_Word label) {
+  return label == FAST_SET_PWM_DUTY_CYCLE_REQUEST;
+}
+#else
+int main(int argc, char *argv[]) {
+#ifdef VISUALIZE_STARTUP
+  kos_printf("\n");
+  kos_printf("----  %s server ----\n", argv[0]);
+#endif
+
+  // Initialize the thread manager
+  kos_assert_ok(
+    kos_thread_mgr_init(
+      root_manager_entries, // IN_OUT kos_thread_mgr_entry_t* p_entries,
+      NUM_THREADS, // IN seL4_Word capacity,
+      &root_thread_mgr // OUT kos_thread_mgr_t* p_thread_mgr
+    ),
+    NULL
+  );
+  p_thread_mgr = &root_thread_mgr;
+
+  // Bootstrap the message server connection
+  kos_assert_created(kos_msg_setup(), NULL);
+
+  start_service(argc, argv);
 
   // Run app-level thread manager handler directly on this thread,
   // this should never return
@@ -391,3 +2158,4 @@ int main(int argc, char *argv[]) {
   kos_stop("KOS am335x PWM server exited unexpectedly");
   return 0;
 }
+#endif
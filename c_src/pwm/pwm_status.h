@@ -0,0 +1,71 @@
+// Copyright (c) 2023, Kry10 Limited. All rights reserved.
+//
+// SPDX-License-Identifier: LicenseRef-Kry10
+
+// Layout of the status page that the PWM service keeps in the frame given to
+// it with the status_frame option. Clients that are given the same frame in
+// their manifest read the configuration from it instead of remembering it.
+//
+// The sequence is odd while the service updates the page. A reader retries
+// until it sees the same even sequence before and after reading, see
+// pwm_status_read(). The page is updated by every request that changes the
+// configuration and, for the trip zone flags, by every trip.
+
+#ifndef _PWM_STATUS_H_
+#define _PWM_STATUS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PWM_STATUS_MAGIC 0x50575354
+#define PWM_STATUS_PINS 2
+
+typedef struct {
+  // Configuration as the client set it
+  uint32_t freq;
+  uint32_t duty_cycle[PWM_STATUS_PINS];
+  uint32_t counter_mode;
+  uint32_t output_mode[PWM_STATUS_PINS];
+  uint32_t apwm_freq;
+  uint32_t apwm_duty_cycle;
+  uint32_t apwm_output_mode;
+  // The time-base and compare registers it was programmed into, these keep
+  // their last values while the ePWM clock is stopped
+  uint32_t tbprd;
+  uint32_t clkdiv;
+  uint32_t hspclkdiv;
+  uint32_t cmpa;
+  uint32_t cmpb;
+  // TZFLG, the trip zone flags
+  uint32_t trip_flags;
+  uint32_t clock_stopped;
+  // Number of times the page was updated
+  uint32_t updates;
+} pwm_status_t;
+
+typedef struct {
+  uint32_t magic;
+  volatile uint32_t sequence;
+  pwm_status_t status;
+} pwm_status_page_t;
+
+// Copies a consistent snapshot out of the page, returns false if the page was
+// never written by the service
+static inline bool pwm_status_read(const pwm_status_page_t *p_page, pwm_status_t *p_out) {
+  if (p_page->magic != PWM_STATUS_MAGIC)
+    return false;
+
+  uint32_t sequence;
+
+  do {
+    sequence = __atomic_load_n(&p_page->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1)
+      continue;
+    *p_out = p_page->status;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((sequence & 1) || sequence != __atomic_load_n(&p_page->sequence, __ATOMIC_RELAXED));
+
+  return true;
+}
+
+#endif
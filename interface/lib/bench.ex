@@ -0,0 +1,79 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.Bench do
+  @moduledoc """
+  Times the requests that have both a payload form and a fast form, to measure
+  on the board what the fast requests save. Run against a GPIO service built
+  for a board pin map and against the generic build, it also measures what the
+  board build saves.
+
+  Each function makes `n` calls of every form in turn and returns the mean time
+  of a call of each form in microseconds, as measured by the calling process.
+  The calls are made one after the other, so the times include the round trip
+  to the service and the time the caller waited to be scheduled.
+  """
+
+  alias KosAm335xStarterware.GPIO
+  alias KosAm335xStarterware.PWM
+
+  @default_calls 10_000
+
+  @typedoc "Mean time of a call of each form, in microseconds"
+  @type results :: %{atom() => float()}
+
+  @doc """
+  Times `GPIO.read/2`, `GPIO.read_fast/2`, `GPIO.write/3` and
+  `GPIO.write_fast/3` of `pin`, which should be an output since it is
+  written low.
+
+  `handle` should be set up without the pin cache, which would answer most
+  of the calls itself.
+  """
+  @spec gpio(GPIO.handle(), non_neg_integer(), pos_integer()) :: {:ok, results()} | {:error, any}
+  def gpio(handle, pin, n \\ @default_calls)
+
+  def gpio(%GPIO{cache: cache}, _pin, _n) when cache != nil, do: {:error, :cache_enabled}
+
+  def gpio(handle, pin, n) when is_integer(n) and n > 0 do
+    run([
+      read: fn -> GPIO.read(handle, pin) end,
+      read_fast: fn -> GPIO.read_fast(handle, pin) end,
+      write: fn -> GPIO.write(handle, pin, :low) end,
+      write_fast: fn -> GPIO.write_fast(handle, pin, :low) end
+    ], n)
+  end
+
+  @doc """
+  Times `PWM.set_pwm_duty_cycle/3` and `PWM.set_pwm_duty_cycle_fast/3` of
+  `pin`, setting it to `duty_cycle` on every call.
+  """
+  @spec pwm(PWM.handle(), PWM.pwm_pin(), non_neg_integer(), pos_integer()) :: {:ok, results()} | {:error, any}
+  def pwm(handle, pin, duty_cycle, n \\ @default_calls) when is_integer(n) and n > 0 do
+    run([
+      set_pwm_duty_cycle: fn -> PWM.set_pwm_duty_cycle(handle, pin, duty_cycle) end,
+      set_pwm_duty_cycle_fast: fn -> PWM.set_pwm_duty_cycle_fast(handle, pin, duty_cycle) end
+    ], n)
+  end
+
+  # Stops at the first call that fails and returns its error
+  defp run(forms, n) do
+    Enum.reduce_while(forms, {:ok, %{}}, fn {form, call}, {:ok, results} ->
+      case :timer.tc(fn -> repeat(call, n) end) do
+        {time, :ok} -> {:cont, {:ok, Map.put(results, form, time / n)}}
+        {_, error} -> {:halt, error}
+      end
+    end)
+  end
+
+  defp repeat(_call, 0), do: :ok
+
+  defp repeat(call, n) do
+    case call.() do
+      :ok -> repeat(call, n - 1)
+      {:ok, _} -> repeat(call, n - 1)
+      error -> error
+    end
+  end
+end
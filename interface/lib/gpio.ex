@@ -13,15 +13,60 @@ defmodule KosAm335xStarterware.GPIO do
   @typedoc "Input/output signal levels"
   @type level :: :low | :high
 
+  @typedoc "Edges of an input signal that the controller detects"
+  @type edge :: :none | :rising | :falling | :both
+
+  @typedoc """
+  Settings of a pin in `configure_pins/2`. `:direction` is required, the
+  others default to `:low`, `false` and `:none` respectively.
+  """
+  @type pin_config :: [direction: direction(), level: level(), debounce: boolean(), edge: edge()]
+
+  @typedoc """
+  Registers of a GPIO controller as returned by `dump/1`, bit `n` of each
+  register is pin `32 * controller + n`. `:output_enable` is active low.
+  """
+  @type controller_dump :: %{
+    state: :uninitialized | :initialized,
+    output_enable: non_neg_integer(),
+    data_out: non_neg_integer(),
+    data_in: non_neg_integer(),
+    debounce_enable: non_neg_integer(),
+    low_level_detect: non_neg_integer(),
+    high_level_detect: non_neg_integer(),
+    rising_detect: non_neg_integer(),
+    falling_detect: non_neg_integer()
+  }
+
+  @typedoc "Power modes of a GPIO controller"
+  @type power_mode :: :active | :low_power
+
+  @typedoc "Request statistics of the service thread serving a handle"
+  @type stats :: %{
+    requests: non_neg_integer(),
+    errors: non_neg_integer(),
+    one_way_errors: non_neg_integer()
+  }
+
+  @typedoc "Requests that the pin cache of a handle answered without the service"
+  @type cache_stats :: %{
+    writes_saved: non_neg_integer(),
+    configures_saved: non_neg_integer(),
+    reads_saved: non_neg_integer()
+  }
+
   @type handle :: %KosAm335xStarterware.GPIO{
-    gpio_ref: reference()
+    gpio_ref: reference(),
+    cache: :atomics.atomics_ref() | nil,
+    async: pid() | nil
   }
 
-  defstruct [:gpio_ref]
+  defstruct [:gpio_ref, cache: nil, async: nil]
 
   @gpio_prot "am335x_gpio_protocol"
 
   @max_pin 127
+  @max_controller 3
   @max_debounce_time 255
 
   @input_direction 0
@@ -38,19 +83,83 @@ defmodule KosAm335xStarterware.GPIO do
   @set_debounce_timing_label 3
   @read_label 4
   @write_label 5
+  @get_stats_label 6
+  @set_debounce_window_label 7
+  @set_power_mode_label 8
+  @set_pin_wakeup_label 9
+  @configure_transaction_label 10
+  @dump_label 11
+  @batch_label 12
+  @fast_read_label 13
+  @fast_write_label 14
+  # 15 is the one-way write, which C clients send to the one-way protocol with
+  # gpio_one_way_write() from c_src/gpio/gpio_one_way.h
+
+  # The fast requests of read_fast/2 and write_fast/3 pack their arguments into
+  # the message param, the pin in the low byte and the level above it, so they
+  # never touch the IPC buffer
+  @fast_value_shift 8
+
+  @max_batch_ops 64
+
+  @controller_states %{1 => :uninitialized, 2 => :initialized}
+
+  @power_modes %{active: 0, low_power: 1}
+
+  # The pin cache holds a word of state for each pin followed by the counters
+  @cache_direction_known 0x1
+  @cache_output 0x2
+  @cache_level_known 0x4
+  @cache_high 0x8
+  @cache_writes_saved @max_pin + 2
+  @cache_configures_saved @max_pin + 3
+  @cache_reads_saved @max_pin + 4
+
+  @transaction_output 0x100
+  @transaction_high 0x200
+  @transaction_debounce 0x400
+  @transaction_edges %{none: 0x0000, rising: 0x1000, falling: 0x2000, both: 0x3000}
 
   @doc """
   Performs initial setup to connect to the GPIO service.
 
   This returns a handle if setup was successful that needs to be passed to the
   other functions in this module.
+
+  `:gpio_protocol` may name the service's priority protocol instead, see the
+  `priority_protocol` option of the manifest. A handle set up this way is
+  served ahead of the default protocol but only supports `read/2`,
+  `write/3` and their `read_fast/2` and `write_fast/3` forms. A service with a priority protocol initialises all of its
+  controllers when it starts, instead of on the first request that touches
+  each of them.
+
+  `:gpio_protocol` may also name one of the per-controller protocols, see the
+  `controller_protocols` option of the manifest. A handle set up this way only
+  accepts pins on that controller.
+
+  `:cache` set to `true` gives the handle a write-through cache of the
+  directions and output levels it has set. `write/3` and `configure_pin/4`
+  then skip the service when they would not change anything, and `read/2` of
+  an output pin is answered from the cache. The cache is shared by every
+  process using the handle, but it assumes nothing else changes its pins. See
+  `get_cache_stats/1` for the requests it saved.
+
+  `:async` set to `true` starts a worker linked to the calling process for the
+  asynchronous operations of the handle, see `write_async/3`.
   """
   @spec setup(Keyword.t()) :: {:ok, KosAm335xStarterware.GPIO.handle()} | {:error, any}
   def setup(opts \\ []) do
     prot = Keyword.get(opts, :gpio_protocol, @gpio_prot)
 
-    case KosMsg.open(prot) do
-      {:ok, gpio_ref} -> {:ok, %KosAm335xStarterware.GPIO{gpio_ref: gpio_ref}}
+    cache = if Keyword.get(opts, :cache, false) do
+      :atomics.new(@cache_reads_saved, signed: false)
+    end
+
+    with {:ok, gpio_ref} <- KosMsg.open(prot),
+         handle = %KosAm335xStarterware.GPIO{gpio_ref: gpio_ref, cache: cache},
+         {:ok, handle} <- start_async(handle, Keyword.get(opts, :async, false)) do
+      {:ok, handle}
+    else
       {:error, _} -> {:error, :failed_to_setup_gpio}
     end
   end
@@ -61,12 +170,17 @@ defmodule KosAm335xStarterware.GPIO do
   `handle` should be the output given by `setup()/1`. `pin` should be a value
   between 0 and 127, inclusive. `direction` can be of either `:input` or
   `:output`.
+
+  `level` may be given as `:low` or `:high` for an output to start at that
+  level. It is set before the output is enabled, so the pin never drives the
+  level it was left at. It is ignored for inputs.
   """
-  @spec configure_pin(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), direction()) :: :ok | any()
-  def configure_pin(handle, pin, direction) do
+  @spec configure_pin(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), direction(), level() | nil) :: :ok | any()
+  def configure_pin(handle, pin, direction, level \\ nil) do
     cond do
       pin > @max_pin -> {:error, :invalid_pin}
       direction not in [:input, :output] -> {:error, :invalid_direction}
+      level not in [nil, :low, :high] -> {:error, :invalid_level}
       true ->
         direction_value = if direction == :input do
           @input_direction
@@ -74,14 +188,95 @@ defmodule KosAm335xStarterware.GPIO do
           @output_direction
         end
 
-        data = [{:uint32_t, pin}, {:uint32_t, direction_value}]
-        case call_gpio_server(handle.gpio_ref, data, @configure_pin_label) do
-          {:ok, _} -> :ok
+        level_data = case level do
+          nil -> []
+          :low -> [{:uint32_t, @low_level}]
+          :high -> [{:uint32_t, @high_level}]
+        end
+
+        state = cached_state(handle, pin)
+
+        if handle.cache != nil and cached_direction(state) == direction and
+             (level == nil or direction == :input or cached_level(state) == level) do
+          :atomics.add(handle.cache, @cache_configures_saved, 1)
+          :ok
+        else
+          data = [{:uint32_t, pin}, {:uint32_t, direction_value}] ++ level_data
+          case call_gpio_server(handle.gpio_ref, data, @configure_pin_label) do
+            {:ok, _} ->
+              update_cached_state(handle, pin, fn state ->
+                state = put_cached_direction(state, direction)
+                if level && direction == :output, do: put_cached_level(state, level), else: state
+              end)
+              :ok
+            error -> error
+          end
+        end
+    end
+  end
+
+  @doc """
+  Configures many pins in a single request.
+
+  `handle` should be the output given by `setup()/1`. `pins` should be a list
+  of `{pin, config}` tuples, where `pin` is a value between 0 and 127,
+  inclusive, and `config` is a `t:pin_config/0`.
+
+  For each pin this sets its direction, the level it outputs, whether it is
+  debounced and which of its edges are detected. The service writes each
+  register of a controller once for the whole list, and outputs are driven to
+  their level before they are turned on. Nothing is changed if any of the
+  pins is invalid.
+
+  Pins keep the debounce windows set with `set_debounce_window/3` that the
+  controller applies, and pins that wake their controller or update the
+  status page keep detecting both edges, whatever their config says.
+  """
+  @spec configure_pins(KosAm335xStarterware.GPIO.handle(), [{non_neg_integer(), pin_config()}]) :: :ok | any()
+  def configure_pins(handle, pins) do
+    entries = Enum.map(pins, fn {pin, config} -> transaction_entry(pin, config) end)
+
+    cond do
+      entries == [] -> {:error, :no_pins}
+      length(entries) > @max_pin + 1 -> {:error, :too_many_pins}
+      error = Enum.find(entries, &match?({:error, _}, &1)) -> error
+      true ->
+        data = Enum.map(entries, &{:uint32_t, &1})
+        case call_gpio_server(handle.gpio_ref, data, @configure_transaction_label) do
+          {:ok, _} ->
+            Enum.each(pins, fn {pin, config} ->
+              update_cached_state(handle, pin, fn state ->
+                state
+                |> put_cached_direction(Keyword.get(config, :direction))
+                |> put_cached_level(Keyword.get(config, :level, :low))
+              end)
+            end)
+            :ok
           error -> error
         end
     end
   end
 
+  defp transaction_entry(pin, config) do
+    direction = Keyword.get(config, :direction)
+    level = Keyword.get(config, :level, :low)
+    debounce = Keyword.get(config, :debounce, false)
+    edge = Keyword.get(config, :edge, :none)
+
+    cond do
+      pin > @max_pin -> {:error, :invalid_pin}
+      direction not in [:input, :output] -> {:error, :invalid_direction}
+      level not in [:low, :high] -> {:error, :invalid_level}
+      not Map.has_key?(@transaction_edges, edge) -> {:error, :invalid_edge}
+      true ->
+        pin
+        |> Bitwise.bor(if direction == :output, do: @transaction_output, else: 0)
+        |> Bitwise.bor(if level == :high, do: @transaction_high, else: 0)
+        |> Bitwise.bor(if debounce, do: @transaction_debounce, else: 0)
+        |> Bitwise.bor(Map.fetch!(@transaction_edges, edge))
+    end
+  end
+
   @doc """
   Reads the input signal of a `pin`.
 
@@ -89,14 +284,52 @@ defmodule KosAm335xStarterware.GPIO do
   between 0 and 127, inclusive.
   """
   @spec read(KosAm335xStarterware.GPIO.handle(), non_neg_integer()) :: {:ok, level()} | any()
-  def read(handle, pin) do
+  def read(handle, pin), do: read_pin(handle, pin, false)
+
+  @doc """
+  Same as `read/2`, but sent as a fast request that carries the pin in the
+  message registers instead of the IPC buffer.
+  """
+  @spec read_fast(KosAm335xStarterware.GPIO.handle(), non_neg_integer()) :: {:ok, level()} | any()
+  def read_fast(handle, pin), do: read_pin(handle, pin, true)
+
+  @doc """
+  Writes a signal of `level` out to the `pin`.
+
+  `handle` should be the output given by `setup()/1`. `pin` should be a value
+  between 0 and 127, inclusive. `level` should be either `:low` or `:high` for
+  a low output signal and high output signal respectively.
+  """
+  @spec write(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), level()) :: :ok | any()
+  def write(handle, pin, level), do: write_pin(handle, pin, level, false)
+
+  @doc """
+  Same as `write/3`, but sent as a fast request that carries the pin and level
+  in the message registers instead of the IPC buffer.
+  """
+  @spec write_fast(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), level()) :: :ok | any()
+  def write_fast(handle, pin, level), do: write_pin(handle, pin, level, true)
+
+  defp read_pin(handle, pin, fast) do
+    state = if pin <= @max_pin, do: cached_state(handle, pin), else: 0
+
     cond do
       pin > @max_pin -> {:error, :invalid_pin}
+      handle.cache != nil and cached_direction(state) == :output and cached_level(state) != nil ->
+        :atomics.add(handle.cache, @cache_reads_saved, 1)
+        {:ok, cached_level(state)}
       true ->
-        data = [{:uint32_t, pin}]
-        case call_gpio_server(handle.gpio_ref, data, @read_label) do
-          {:ok, result} ->
-            if :binary.decode_unsigned(result) == 0 do
+        result = if fast do
+          call_gpio_server_fast(handle.gpio_ref, pin, @fast_read_label)
+        else
+          case call_gpio_server(handle.gpio_ref, [{:uint32_t, pin}], @read_label) do
+            {:ok, result} -> {:ok, :binary.decode_unsigned(result)}
+            error -> error
+          end
+        end
+        case result do
+          {:ok, level} ->
+            if level == 0 do
               {:ok, :low}
             else
               {:ok, :high}
@@ -106,37 +339,79 @@ defmodule KosAm335xStarterware.GPIO do
     end
   end
 
-  @doc """
-  Writes a signal of `level` out to the `pin`.
+  defp write_pin(handle, pin, level, fast) do
+    state = if pin <= @max_pin, do: cached_state(handle, pin), else: 0
 
-  `handle` should be the output given by `setup()/1`. `pin` should be a value
-  between 0 and 127, inclusive. `level` should be either `:low` or `:high` for
-  a low output signal and high output signal respectively.
-  """
-  @spec write(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), level()) :: :ok | any()
-  def write(handle, pin, level) do
     cond do
       pin > @max_pin -> {:error, :invalid_pin}
       level not in [:low, :high] -> {:error, :invalid_direction}
+      handle.cache != nil and cached_level(state) == level ->
+        :atomics.add(handle.cache, @cache_writes_saved, 1)
+        :ok
       true ->
-        data = if level == :low do
-          [{:uint32_t, pin}, {:uint32_t, @low_level}]
+        value = if level == :low, do: @low_level, else: @high_level
+        result = if fast do
+          param = Bitwise.bor(pin, Bitwise.bsl(value, @fast_value_shift))
+          call_gpio_server_fast(handle.gpio_ref, param, @fast_write_label)
         else
-          [{:uint32_t, pin}, {:uint32_t, @high_level}]
+          call_gpio_server(handle.gpio_ref, [{:uint32_t, pin}, {:uint32_t, value}], @write_label)
         end
-        case call_gpio_server(handle.gpio_ref, data, @write_label) do
-          {:ok, _} -> :ok
+        case result do
+          {:ok, _} ->
+            update_cached_state(handle, pin, &put_cached_level(&1, level))
+            :ok
           error -> error
         end
     end
   end
 
+  @doc """
+  Writes a signal of `level` out to the `pin` without waiting for the service.
+
+  `handle` should be the output given by `setup()/1` with `async: true`. This
+  returns a reference straight away, and the calling process is later sent
+  `{:gpio_done, ref, result}` with the result `write/3` would have returned.
+
+  Writes are sent to the service in the order they were made. Those that queue
+  up while the service is busy are sent together in a single batch request.
+
+  The reference also monitors the worker. If the worker has already exited
+  this returns `{:error, :noproc}`, and if it exits before the write is done
+  the calling process is sent `{:DOWN, ref, :process, worker, reason}` instead
+  of `{:gpio_done, ref, result}`.
+  """
+  @spec write_async(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), level()) :: reference() | {:error, any}
+  def write_async(%KosAm335xStarterware.GPIO{async: nil}, _pin, _level), do: {:error, :async_disabled}
+
+  def write_async(handle, pin, level) do
+    cond do
+      pin > @max_pin -> {:error, :invalid_pin}
+      level not in [:low, :high] -> {:error, :invalid_level}
+      true ->
+        # The worker replies to the alias of the monitor, which drops the
+        # monitor along with the reply
+        ref = :erlang.monitor(:process, handle.async, alias: :reply_demonitor)
+
+        if Process.alive?(handle.async) do
+          KosAm335xStarterware.GPIO.Async.submit(handle.async, ref, ref, {:write, pin, level})
+          ref
+        else
+          Process.demonitor(ref, [:flush])
+          {:error, :noproc}
+        end
+    end
+  end
+
   @doc """
   Sets the debouncing functionality of a `pin`.
 
   `handle` should be the output given by `setup()/1`. `pin` should be a value
   between 0 and 127, inclusive. `debounce` should be `true` to turn debouncing
   on, `false` otherwise.
+
+  Pins with a window set with `set_debounce_window/3` are debounced by the
+  service, which refuses this request for them until their window is set
+  back to 0.
   """
   @spec set_debounce(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), boolean()) :: :ok | any()
   def set_debounce(handle, pin, debounce) do
@@ -167,6 +442,10 @@ defmodule KosAm335xStarterware.GPIO do
   Each increment of `timing` adds a 31 microsecond long clock pulse for the
   debouncing. There is always a base of 31 microsecond for the debouncing even
   if `timing` is set to 0.
+
+  Windows set with `set_debounce_window/3` on the same controller take over
+  the timing the next time any of them changes, and while the controller
+  debounces them itself the service refuses this request.
   """
   @spec set_debounce_timing(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), non_neg_integer()) :: :ok | any()
   def set_debounce_timing(handle, pin, time) do
@@ -182,6 +461,303 @@ defmodule KosAm335xStarterware.GPIO do
     end
   end
 
+  @doc """
+  Sets the debounce window of a single `pin` in microseconds.
+
+  `handle` should be the output given by `setup()/1`. `pin` should be a value
+  between 0 and 127, inclusive. A `window_us` of 0 turns debouncing off for
+  the pin.
+
+  If all the windows on a controller are equal and no longer than 7936
+  microseconds, the controller debounces the pins itself. Otherwise the
+  service samples the pins every millisecond, rounding the windows up to
+  whole milliseconds, and reads of the pins report the last level that was
+  held for a whole window. This needs the debounce timer that the service is
+  only given when it is included with `software_debounce: true`, without it
+  the service returns an error and keeps the previous window.
+  """
+  @spec set_debounce_window(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), non_neg_integer()) :: :ok | any()
+  def set_debounce_window(handle, pin, window_us) do
+    cond do
+      pin > @max_pin -> {:error, :invalid_pin}
+      true ->
+        data = [{:uint32_t, pin}, {:uint32_t, window_us}]
+        case call_gpio_server(handle.gpio_ref, data, @set_debounce_window_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Sets the power mode of a GPIO `controller`.
+
+  `handle` should be the output given by `setup()/1`. `controller` should be a
+  value between 0 and 3, inclusive, pins `32 * controller` to
+  `32 * controller + 31` belong to it. `mode` can be either `:active` or
+  `:low_power`.
+
+  In `:low_power` the controller gates its clocks whenever it is not being
+  accessed and lets the power manager idle it, waking it up again when one of
+  the pins set with `set_pin_wakeup/3` changes level. `:active` keeps the
+  controller running at all times, which is the initial mode.
+  """
+  @spec set_power_mode(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), power_mode()) :: :ok | any()
+  def set_power_mode(handle, controller, mode) do
+    cond do
+      controller > @max_controller -> {:error, :invalid_controller}
+      not Map.has_key?(@power_modes, mode) -> {:error, :invalid_power_mode}
+      true ->
+        data = [{:uint32_t, controller}, {:uint32_t, Map.fetch!(@power_modes, mode)}]
+        case call_gpio_server(handle.gpio_ref, data, @set_power_mode_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Sets whether a change of level on `pin` wakes its controller up from
+  `:low_power`.
+
+  `handle` should be the output given by `setup()/1`. `pin` should be a value
+  between 0 and 127, inclusive. `wakeup` should be `true` to wake on both
+  edges of the pin or `false` to stop.
+  """
+  @spec set_pin_wakeup(KosAm335xStarterware.GPIO.handle(), non_neg_integer(), boolean()) :: :ok | any()
+  def set_pin_wakeup(handle, pin, wakeup) do
+    cond do
+      pin > @max_pin -> {:error, :invalid_pin}
+      true ->
+        data = if wakeup do
+          [{:uint32_t, pin}, {:uint32_t, 1}]
+        else
+          [{:uint32_t, pin}, {:uint32_t, 0}]
+        end
+        case call_gpio_server(handle.gpio_ref, data, @set_pin_wakeup_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Reads the request statistics of the service thread serving `handle`.
+
+  `handle` should be the output given by `setup()/1`. Each protocol of the
+  service is served by its own thread, which counts the requests it has
+  received and how many of those failed.
+
+  `one_way_errors` is the number of writes sent to the service's one-way
+  protocol that it failed to perform, see the `one_way_protocol` option of the
+  manifest. Nothing is replied to those writes, so the client that registered
+  with the one-way protocol reads their failures here instead. It is 0 for
+  any other client.
+  """
+  @spec get_stats(KosAm335xStarterware.GPIO.handle()) :: {:ok, stats()} | any()
+  def get_stats(handle) do
+    case call_gpio_server(handle.gpio_ref, [], @get_stats_label) do
+      {:ok, <<requests::little-32, errors::little-32, one_way_errors::little-32>>} ->
+        {:ok, %{requests: requests, errors: errors, one_way_errors: one_way_errors}}
+      {:ok, _} -> {:error, :failed_to_perform_gpio_operation}
+      error -> error
+    end
+  end
+
+  @doc """
+  Reads back the directions, levels, debounce and interrupt detection of every
+  pin in a single request.
+
+  `handle` should be the output given by `setup()/1`. This returns a list with
+  an entry for each of the four controllers, in order. A controller that was
+  not given to the service is `:unavailable`, and one that no request has
+  touched yet is reported as it was left before the service started.
+  """
+  @spec dump(KosAm335xStarterware.GPIO.handle()) :: {:ok, [controller_dump() | :unavailable]} | any()
+  def dump(handle) do
+    case call_gpio_server(handle.gpio_ref, [], @dump_label) do
+      {:ok, payload} when byte_size(payload) == 4 * 9 * (@max_controller + 1) ->
+        {:ok, for(<<words::binary-size(36) <- payload>>, do: decode_controller_dump(words))}
+      {:ok, _} -> {:error, :failed_to_perform_gpio_operation}
+      error -> error
+    end
+  end
+
+  defp decode_controller_dump(<<state::little-32, oe::little-32, data_out::little-32,
+                                data_in::little-32, debounce::little-32, low::little-32,
+                                high::little-32, rising::little-32, falling::little-32>>) do
+    case Map.fetch(@controller_states, state) do
+      {:ok, state} ->
+        %{
+          state: state,
+          output_enable: oe,
+          data_out: data_out,
+          data_in: data_in,
+          debounce_enable: debounce,
+          low_level_detect: low,
+          high_level_detect: high,
+          rising_detect: rising,
+          falling_detect: falling
+        }
+      :error -> :unavailable
+    end
+  end
+
+  @doc """
+  Sends all the operations of `batch` to the GPIO service in a single request.
+
+  `handle` should be the output given by `setup()/1`. `batch` should be built
+  with `KosAm335xStarterware.GPIO.Batch`, and may hold up to 64 operations.
+
+  The operations run in order and this returns a result for each of them, the
+  level for reads and `:ok` for the others. If an operation fails the ones
+  after it are not run, and this returns `{:error, status, completed_results}`
+  with the status the service replied with for the failed operation and the
+  results of the ones before it, so the failed one is at index
+  `length(completed_results)`.
+  """
+  @spec batch(KosAm335xStarterware.GPIO.handle(), KosAm335xStarterware.GPIO.Batch.t()) ::
+          {:ok, [:ok | level()]} | {:error, non_neg_integer(), [:ok | level()]} | {:error, any}
+  def batch(handle, batch) do
+    ops = KosAm335xStarterware.GPIO.Batch.ops(batch)
+    entries = Enum.map(ops, &batch_entry/1)
+
+    cond do
+      ops == [] -> {:error, :empty_batch}
+      length(ops) > @max_batch_ops -> {:error, :batch_too_large}
+      error = Enum.find(entries, &match?({:error, _}, &1)) -> error
+      true ->
+        data = Enum.flat_map(entries, fn words -> Enum.map(words, &{:uint32_t, &1}) end)
+        # The batch may stop part way, so forget what it might have changed
+        Enum.each(ops, fn
+          {:configure_pin, pin, _} -> put_cached_state(handle, pin, 0)
+          {:write, pin, _} -> put_cached_state(handle, pin, 0)
+          _ -> :ok
+        end)
+
+        case call_gpio_server(handle.gpio_ref, data, @batch_label) do
+          {:ok, <<succeeded::little-32, results::binary>>} ->
+            decode_batch_results(ops, succeeded, results)
+          {:ok, _} -> {:error, :failed_to_perform_gpio_operation}
+          error -> error
+        end
+    end
+  end
+
+  defp batch_entry(op) do
+    case op do
+      {_, pin, _} when pin > @max_pin -> {:error, :invalid_pin}
+      {:read, pin} when pin > @max_pin -> {:error, :invalid_pin}
+      {:configure_pin, pin, :input} -> [@configure_pin_label, pin, @input_direction]
+      {:configure_pin, pin, :output} -> [@configure_pin_label, pin, @output_direction]
+      {:configure_pin, _, _} -> {:error, :invalid_direction}
+      {:set_debounce, pin, true} -> [@set_debounce_label, pin, @debounce_on]
+      {:set_debounce, pin, false} -> [@set_debounce_label, pin, @debounce_off]
+      {:set_debounce, _, _} -> {:error, :invalid_debounce}
+      {:read, pin} -> [@read_label, pin, 0]
+      {:write, pin, :low} -> [@write_label, pin, @low_level]
+      {:write, pin, :high} -> [@write_label, pin, @high_level]
+      {:write, _, _} -> {:error, :invalid_level}
+    end
+  end
+
+  defp decode_batch_results(ops, succeeded, results) do
+    decoded =
+      for {op, <<result::little-32>>} <- Enum.zip(Enum.take(ops, succeeded), for(<<w::binary-size(4) <- results>>, do: w)) do
+        case op do
+          {:read, _} when result == 0 -> :low
+          {:read, _} -> :high
+          _ -> :ok
+        end
+      end
+
+    # The reply ends with the status of the operation that failed, if any did
+    completed_size = succeeded * 4
+
+    case results do
+      _ when succeeded == length(ops) -> {:ok, decoded}
+      <<_::binary-size(completed_size), status::little-32>> -> {:error, status, decoded}
+      _ -> {:error, :failed_to_perform_gpio_operation}
+    end
+  end
+
+  @doc """
+  Reads the number of requests that the pin cache of `handle` answered without
+  calling the service.
+
+  `handle` should be the output given by `setup()/1` with `cache: true`.
+  """
+  @spec get_cache_stats(KosAm335xStarterware.GPIO.handle()) :: {:ok, cache_stats()} | {:error, :cache_disabled}
+  def get_cache_stats(%KosAm335xStarterware.GPIO{cache: nil}), do: {:error, :cache_disabled}
+
+  def get_cache_stats(handle) do
+    {:ok, %{
+      writes_saved: :atomics.get(handle.cache, @cache_writes_saved),
+      configures_saved: :atomics.get(handle.cache, @cache_configures_saved),
+      reads_saved: :atomics.get(handle.cache, @cache_reads_saved)
+    }}
+  end
+
+  # Used by KosAm335xStarterware.IO.batch/2 for the pins it writes
+  @doc false
+  def forget_cached_pin(handle, pin), do: put_cached_state(handle, pin, 0)
+
+  defp cached_state(%KosAm335xStarterware.GPIO{cache: nil}, _pin), do: 0
+  defp cached_state(handle, pin), do: :atomics.get(handle.cache, pin + 1)
+
+  defp put_cached_state(%KosAm335xStarterware.GPIO{cache: nil}, _pin, _state), do: :ok
+  defp put_cached_state(handle, pin, state), do: :atomics.put(handle.cache, pin + 1, state)
+
+  # Other processes using the handle may update the same word, so the change is
+  # made to whatever state is there when it is stored rather than to the state
+  # read before the request
+  defp update_cached_state(%KosAm335xStarterware.GPIO{cache: nil}, _pin, _fun), do: :ok
+
+  defp update_cached_state(handle, pin, fun) do
+    state = :atomics.get(handle.cache, pin + 1)
+
+    case :atomics.compare_exchange(handle.cache, pin + 1, state, fun.(state)) do
+      :ok -> :ok
+      _ -> update_cached_state(handle, pin, fun)
+    end
+  end
+
+  defp cached_direction(state) do
+    cond do
+      Bitwise.band(state, @cache_direction_known) == 0 -> nil
+      Bitwise.band(state, @cache_output) != 0 -> :output
+      true -> :input
+    end
+  end
+
+  defp cached_level(state) do
+    cond do
+      Bitwise.band(state, @cache_level_known) == 0 -> nil
+      Bitwise.band(state, @cache_high) != 0 -> :high
+      true -> :low
+    end
+  end
+
+  defp put_cached_direction(state, direction) do
+    state = Bitwise.bor(Bitwise.band(state, Bitwise.bnot(@cache_output)), @cache_direction_known)
+    if direction == :output, do: Bitwise.bor(state, @cache_output), else: state
+  end
+
+  defp put_cached_level(state, level) do
+    state = Bitwise.bor(Bitwise.band(state, Bitwise.bnot(@cache_high)), @cache_level_known)
+    if level == :high, do: Bitwise.bor(state, @cache_high), else: state
+  end
+
+  defp start_async(handle, false), do: {:ok, handle}
+
+  defp start_async(handle, true) do
+    case KosAm335xStarterware.GPIO.Async.start_link(handle) do
+      {:ok, worker} -> {:ok, %{handle | async: worker}}
+      :ignore -> {:error, :ignore}
+      error -> error
+    end
+  end
+
   defp call_gpio_server(gpio_ref, data, request) do
     payload = KosMsg.encode(data)
     status_ok = KosMsg.status_ok()
@@ -194,4 +770,17 @@ defmodule KosAm335xStarterware.GPIO do
         {:error, :failed_to_perform_gpio_operation}
     end
   end
+
+  # Register-only variant of call_gpio_server, returns the reply param
+  defp call_gpio_server_fast(gpio_ref, param, request) do
+    status_ok = KosMsg.status_ok()
+
+    case KosMsg.call_msg(gpio_ref, request, param, <<>>) do
+      {:error, _} ->
+        {:error, :failed_to_invoke_gpio_operation}
+      {:ok, {^status_ok, reply_param, _}} -> {:ok, reply_param}
+      {:ok, {_, _, _}} ->
+        {:error, :failed_to_perform_gpio_operation}
+    end
+  end
 end
@@ -0,0 +1,87 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.GPIO.Async do
+  @moduledoc """
+  Worker behind the asynchronous operations of a GPIO handle set up with
+  `async: true`, see `KosAm335xStarterware.GPIO.write_async/3`.
+
+  Operations are queued as they are submitted. Once the worker's mailbox is
+  empty, or a full batch has queued up, the pending operations go to the
+  service in order as a single batch request, and each submitter is sent
+  `{:gpio_done, ref, result}` for each of its operations.
+  """
+
+  use GenServer
+
+  alias KosAm335xStarterware.GPIO
+  alias KosAm335xStarterware.GPIO.Batch
+
+  @max_batch_ops 64
+
+  @doc false
+  @spec start_link(GPIO.handle()) :: GenServer.on_start()
+  def start_link(handle), do: GenServer.start_link(__MODULE__, handle)
+
+  # `to` is where the result is sent, the pid of the submitter or an alias
+  @doc false
+  @spec submit(pid(), pid() | reference(), reference(), Batch.op()) :: :ok
+  def submit(worker, to, ref, op), do: GenServer.cast(worker, {:submit, to, ref, op})
+
+  @impl true
+  def init(handle), do: {:ok, %{handle: handle, pending: [], count: 0}}
+
+  # Pending operations are kept in reverse order, a timeout of 0 only fires
+  # once there is nothing else in the mailbox
+  @impl true
+  def handle_cast({:submit, from, ref, op}, state) do
+    state = %{state | pending: [{from, ref, op} | state.pending], count: state.count + 1}
+
+    if state.count >= @max_batch_ops do
+      {:noreply, flush(state), 0}
+    else
+      {:noreply, state, 0}
+    end
+  end
+
+  @impl true
+  def handle_info(:timeout, state), do: {:noreply, flush(state)}
+
+  defp flush(%{pending: []} = state), do: state
+
+  defp flush(state) do
+    run(state.handle, Enum.reverse(state.pending))
+    %{state | pending: [], count: 0}
+  end
+
+  defp run(_handle, []), do: :ok
+
+  # A batch stops at the first operation that fails, the ones after it are
+  # sent again in a batch of their own
+  defp run(handle, entries) do
+    batch = Enum.reduce(entries, Batch.new(), fn {_, _, {:write, pin, level}}, batch ->
+      Batch.write(batch, pin, level)
+    end)
+
+    case GPIO.batch(handle, batch) do
+      {:ok, results} ->
+        complete(entries, results)
+      {:error, _status, results} ->
+        {done, [failed | rest]} = Enum.split(entries, length(results))
+        complete(done, results)
+        done(failed, {:error, :failed_to_perform_gpio_operation})
+        run(handle, rest)
+      error ->
+        Enum.each(entries, &done(&1, error))
+    end
+  end
+
+  defp complete(entries, results) do
+    entries
+    |> Enum.zip(results)
+    |> Enum.each(fn {entry, result} -> done(entry, result) end)
+  end
+
+  defp done({to, ref, _op}, result), do: send(to, {:gpio_done, ref, result})
+end
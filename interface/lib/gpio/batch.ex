@@ -0,0 +1,69 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.GPIO.Batch do
+  @moduledoc """
+  Accumulates GPIO operations to send to the GPIO service in a single request
+  with `KosAm335xStarterware.GPIO.batch/2`.
+
+      batch =
+        KosAm335xStarterware.GPIO.Batch.new()
+        |> KosAm335xStarterware.GPIO.Batch.write(53, :high)
+        |> KosAm335xStarterware.GPIO.Batch.read(60)
+
+      {:ok, [:ok, level]} = KosAm335xStarterware.GPIO.batch(handle, batch)
+  """
+
+  @typedoc "An operation of a batch, as taken by the function of the same name"
+  @type op ::
+    {:configure_pin, non_neg_integer(), KosAm335xStarterware.GPIO.direction()}
+    | {:set_debounce, non_neg_integer(), boolean()}
+    | {:read, non_neg_integer()}
+    | {:write, non_neg_integer(), KosAm335xStarterware.GPIO.level()}
+
+  @type t :: %KosAm335xStarterware.GPIO.Batch{
+    ops: [op()]
+  }
+
+  # Operations are kept in reverse order
+  defstruct ops: []
+
+  @doc """
+  Returns an empty batch.
+  """
+  @spec new() :: t()
+  def new(), do: %KosAm335xStarterware.GPIO.Batch{}
+
+  @doc """
+  Adds a `KosAm335xStarterware.GPIO.configure_pin/3` to `batch`.
+  """
+  @spec configure_pin(t(), non_neg_integer(), KosAm335xStarterware.GPIO.direction()) :: t()
+  def configure_pin(batch, pin, direction), do: add(batch, {:configure_pin, pin, direction})
+
+  @doc """
+  Adds a `KosAm335xStarterware.GPIO.set_debounce/3` to `batch`.
+  """
+  @spec set_debounce(t(), non_neg_integer(), boolean()) :: t()
+  def set_debounce(batch, pin, debounce), do: add(batch, {:set_debounce, pin, debounce})
+
+  @doc """
+  Adds a `KosAm335xStarterware.GPIO.read/2` to `batch`.
+  """
+  @spec read(t(), non_neg_integer()) :: t()
+  def read(batch, pin), do: add(batch, {:read, pin})
+
+  @doc """
+  Adds a `KosAm335xStarterware.GPIO.write/3` to `batch`.
+  """
+  @spec write(t(), non_neg_integer(), KosAm335xStarterware.GPIO.level()) :: t()
+  def write(batch, pin, level), do: add(batch, {:write, pin, level})
+
+  @doc """
+  Returns the operations of `batch` in the order they were added.
+  """
+  @spec ops(t()) :: [op()]
+  def ops(batch), do: Enum.reverse(batch.ops)
+
+  defp add(batch, op), do: %{batch | ops: [op | batch.ops]}
+end
@@ -0,0 +1,125 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.IO do
+  @moduledoc """
+  Requests that span the GPIO and PWM services of an app added with
+  `KosAm335xStarterware.Manifest.include_io/2`.
+  """
+
+  alias KosAm335xStarterware.GPIO
+
+  @typedoc "An operation of `batch/2`"
+  @type op ::
+    {:gpio_read, non_neg_integer()}
+    | {:gpio_write, non_neg_integer(), GPIO.level()}
+    | {:pwm_duty_cycle, :pwm_a | :pwm_b | :apwm, non_neg_integer()}
+
+  @batch_label 0x100
+  @batch_gpio 0
+  @batch_pwm 1
+  @max_batch_ops 64
+
+  # The register-only requests of each service, their params are packed the
+  # same way as in KosAm335xStarterware.GPIO and KosAm335xStarterware.PWM
+  @gpio_fast_read_label 13
+  @gpio_fast_write_label 14
+  @pwm_fast_set_duty_cycle_label 17
+  @fast_value_shift 8
+
+  @max_pin 127
+  @pwm_pins %{pwm_a: 0, pwm_b: 1, apwm: 2}
+  @max_duty_cycle 100
+
+  @doc """
+  Performs `ops` on the GPIO and PWM services in a single request, in order,
+  stopping at the first that fails.
+
+  `handle` should be the output given by `KosAm335xStarterware.GPIO.setup/1`
+  for the GPIO protocol of an I/O app, whose endpoint also serves the PWM
+  protocol. Returns the result of each operation, the level for a
+  `:gpio_read` and `:ok` for the others, or, like
+  `KosAm335xStarterware.GPIO.batch/2`, `{:error, status, completed_results}`
+  with the status the failed operation was refused with and the results of the
+  operations before it.
+  """
+  @spec batch(GPIO.handle(), [op()]) ::
+          {:ok, [GPIO.level() | :ok]} | {:error, non_neg_integer(), [GPIO.level() | :ok]} | {:error, any}
+  def batch(handle, ops) do
+    entries = Enum.map(ops, &batch_entry/1)
+
+    cond do
+      ops == [] -> {:error, :empty_batch}
+      length(ops) > @max_batch_ops -> {:error, :batch_too_large}
+      error = Enum.find(entries, &match?({:error, _}, &1)) -> error
+      true ->
+        data = Enum.flat_map(entries, fn words -> Enum.map(words, &{:uint32_t, &1}) end)
+        # The batch may stop part way, so forget the pins it might have written
+        Enum.each(ops, fn
+          {:gpio_write, pin, _} -> GPIO.forget_cached_pin(handle, pin)
+          _ -> :ok
+        end)
+
+        case call_io_server(handle.gpio_ref, data) do
+          {:ok, <<succeeded::little-32, results::binary>>} ->
+            decode_batch_results(ops, succeeded, results)
+          {:ok, _} -> {:error, :failed_to_perform_io_operation}
+          error -> error
+        end
+    end
+  end
+
+  defp batch_entry(op) do
+    case op do
+      {:gpio_read, pin} when pin > @max_pin -> {:error, :invalid_pin}
+      {:gpio_write, pin, _} when pin > @max_pin -> {:error, :invalid_pin}
+      {:gpio_read, pin} -> [@batch_gpio, @gpio_fast_read_label, pin]
+      {:gpio_write, pin, :low} -> [@batch_gpio, @gpio_fast_write_label, pin]
+      {:gpio_write, pin, :high} ->
+        [@batch_gpio, @gpio_fast_write_label, Bitwise.bor(pin, Bitwise.bsl(1, @fast_value_shift))]
+      {:gpio_write, _, _} -> {:error, :invalid_level}
+      {:pwm_duty_cycle, _, duty_cycle} when duty_cycle > @max_duty_cycle -> {:error, :duty_cycle_is_too_high}
+      {:pwm_duty_cycle, pin, duty_cycle} ->
+        case Map.fetch(@pwm_pins, pin) do
+          {:ok, pwm_pin} ->
+            [@batch_pwm, @pwm_fast_set_duty_cycle_label, Bitwise.bor(pwm_pin, Bitwise.bsl(duty_cycle, @fast_value_shift))]
+          :error -> {:error, :invalid_pin}
+        end
+      _ -> {:error, :invalid_operation}
+    end
+  end
+
+  defp decode_batch_results(ops, succeeded, results) do
+    decoded =
+      for {op, <<result::little-32>>} <- Enum.zip(Enum.take(ops, succeeded), for(<<w::binary-size(4) <- results>>, do: w)) do
+        case op do
+          {:gpio_read, _} when result == 0 -> :low
+          {:gpio_read, _} -> :high
+          _ -> :ok
+        end
+      end
+
+    # The reply ends with the status of the operation that failed, if any did
+    completed_size = succeeded * 4
+
+    case results do
+      _ when succeeded == length(ops) -> {:ok, decoded}
+      <<_::binary-size(completed_size), status::little-32>> -> {:error, status, decoded}
+      _ -> {:error, :failed_to_perform_io_operation}
+    end
+  end
+
+  defp call_io_server(gpio_ref, data) do
+    payload = KosMsg.encode(data)
+    status_ok = KosMsg.status_ok()
+
+    case KosMsg.call_msg(gpio_ref, @batch_label, 0, payload) do
+      {:error, _} ->
+        {:error, :failed_to_invoke_io_operation}
+      {:ok, {^status_ok, _, result}} -> {:ok, result}
+      {:ok, {_, _, _}} ->
+        {:error, :failed_to_perform_io_operation}
+    end
+  end
+end
@@ -9,10 +9,85 @@ defmodule KosAm335xStarterware.PWM do
   Currently, the PWM is running without a prescaler on the input clock (100
   MHz). This has some effect on accuracy on some frequencies of the PWM signal
   and also imposes a minimum of 2 kHz of the output signal.
+
+  Besides the `:pwm_a` and `:pwm_b` pins of the ePWM, the eCAP of the PWM
+  subsystem can drive a third pin, `:apwm`, with its own frequency set by
+  `set_apwm_frequency/2`. The eCAP can't capture while it drives `:apwm`.
   """
 
   @typedoc "Controllable pins in the PWM controller on the AM335X"
-  @type pwm_pin :: :pwm_a | :pwm_b
+  @type pwm_pin :: :pwm_a | :pwm_b | :apwm
+
+  @typedoc "Counting modes of the PWM time-base counter"
+  @type counter_mode :: :up | :up_down
+
+  @typedoc "Output modes of a PWM pin"
+  @type output_mode :: :normal | :inverted | :force_low | :force_high
+
+  @typedoc "Snapshot of the PWM time-base counter and its active registers"
+  @type counter_status :: %{
+    counter: non_neg_integer(),
+    direction: :up | :down,
+    counter_max_reached: boolean(),
+    sync_in: boolean(),
+    compare_a: non_neg_integer(),
+    compare_b: non_neg_integer(),
+    period: non_neg_integer(),
+    period_events: non_neg_integer()
+  }
+
+  @typedoc "Position of the quadrature encoder"
+  @type encoder_position :: %{
+    position: non_neg_integer(),
+    direction: :forward | :reverse
+  }
+
+  @typedoc "Velocity of the quadrature encoder over the last unit period"
+  @type encoder_velocity :: %{
+    counts_per_second: integer(),
+    unit_events: non_neg_integer()
+  }
+
+  @typedoc "Index events of the quadrature encoder"
+  @type encoder_index :: %{
+    index_events: non_neg_integer(),
+    index_position: non_neg_integer()
+  }
+
+  @typedoc "Edge of the capture input that triggers a capture event"
+  @type capture_edge :: :rising | :falling
+
+  @typedoc """
+  Captured timestamp, with the capture event (0 to 3) that took it and the
+  timestamp in 10 ns ticks
+  """
+  @type capture :: {0..3, non_neg_integer()}
+
+  @typedoc "Batch of captures collected from the eCAP"
+  @type captures :: %{
+    captures: [capture()],
+    overruns: non_neg_integer()
+  }
+
+  @typedoc """
+  State of a submodule clock of the PWM subsystem. Restart latency is counted
+  in reads of the clock status register until the restart was acknowledged.
+  """
+  @type submodule_clock :: %{
+    running: boolean(),
+    restarts: non_neg_integer(),
+    last_restart_polls: non_neg_integer(),
+    max_restart_polls: non_neg_integer()
+  }
+
+  @typedoc "State of the clocks of the PWM subsystem"
+  @type clock_status :: %{
+    clock_status_register: non_neg_integer(),
+    ack_timeouts: non_neg_integer(),
+    epwm: submodule_clock(),
+    ecap: submodule_clock(),
+    eqep: submodule_clock()
+  }
 
   @type handle :: %KosAm335xStarterware.PWM{
     pwm_ref: reference(),
@@ -24,14 +99,52 @@ defmodule KosAm335xStarterware.PWM do
 
   @pwm_a 0
   @pwm_b 1
+  @apwm 2
+
+  @pins %{pwm_a: @pwm_a, pwm_b: @pwm_b, apwm: @apwm}
 
   @max_frequency 100000000
   @min_frequency 2000
+  @max_apwm_frequency 50000000
   @max_duty_cycle 100
   @max_counter_value 65535
 
+  @counter_mode_up 0
+  @counter_mode_up_down 1
+
+  @output_modes %{normal: 0, inverted: 1, force_low: 2, force_high: 3}
+
   @set_pwm_frequency_label 1
   @set_pwm_duty_cycle_label 2
+  @set_pwm_counter_mode_label 3
+  @set_pwm_output_mode_label 4
+  @get_pwm_counter_label 5
+  @set_pwm_period_events_label 6
+  @set_pwm_clock_label 7
+  @configure_qep_label 8
+  @get_qep_position_label 9
+  @get_qep_velocity_label 10
+  @get_qep_index_label 11
+  @configure_ecap_capture_label 12
+  @get_ecap_captures_label 13
+  @set_apwm_frequency_label 14
+  @set_pwm_idle_stop_label 15
+  @get_pwm_clock_status_label 16
+  @fast_set_pwm_duty_cycle_label 17
+
+  # The fast duty cycle request of set_pwm_duty_cycle_fast/3 packs the pin into
+  # the low byte of the message param and the duty cycle above it, so it never
+  # touches the IPC buffer
+  @fast_value_shift 8
+
+  @max_unit_period_us 42949672
+  @max_encoder_position 0xFFFFFFFF
+
+  @capture_events 4
+
+  @tbsts_ctrdir 0x1
+  @tbsts_synci 0x2
+  @tbsts_ctrmax 0x4
 
   @doc """
   Performs initial setup to connect to the PWM service.
@@ -81,21 +194,428 @@ defmodule KosAm335xStarterware.PWM do
   @spec set_pwm_duty_cycle(KosAm335xStarterware.PWM.handle, pwm_pin(), non_neg_integer()) :: :ok | any()
   def set_pwm_duty_cycle(handle, pin, duty_cycle) do
     cond do
-      pin not in [:pwm_a, :pwm_b] -> {:error, :invalid_pin}
+      not Map.has_key?(@pins, pin) -> {:error, :invalid_pin}
       duty_cycle > @max_duty_cycle -> {:error, :duty_cycle_is_too_high}
       true ->
-        data = if pin == :pwm_a do
-          [{:uint32_t, @pwm_a}, {:uint32_t, duty_cycle}]
+        data = [{:uint32_t, Map.fetch!(@pins, pin)}, {:uint32_t, duty_cycle}]
+        case call_pwm_server(handle.pwm_ref, data, @set_pwm_duty_cycle_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Same as `set_pwm_duty_cycle/3`, but sent as a fast request that carries the
+  pin and duty cycle in the message registers instead of the IPC buffer.
+  """
+  @spec set_pwm_duty_cycle_fast(KosAm335xStarterware.PWM.handle, pwm_pin(), non_neg_integer()) :: :ok | any()
+  def set_pwm_duty_cycle_fast(handle, pin, duty_cycle) do
+    cond do
+      not Map.has_key?(@pins, pin) -> {:error, :invalid_pin}
+      duty_cycle > @max_duty_cycle -> {:error, :duty_cycle_is_too_high}
+      true ->
+        param = Bitwise.bor(Map.fetch!(@pins, pin), Bitwise.bsl(duty_cycle, @fast_value_shift))
+        case call_pwm_server_fast(handle.pwm_ref, param, @fast_set_pwm_duty_cycle_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Sets the counting mode of the entire controller.
+
+  `handle` should be the output given by `setup()/1`. `mode` can be either
+  `:up` for edge-aligned PWM signals (the default) or `:up_down` for
+  center-aligned PWM signals.
+
+  The frequency set by `set_pwm_frequency/2` and the duty cycles of the pins
+  are kept when changing modes. Note that in `:up_down` mode the counter period
+  is halved, which halves the resolution of the duty cycle.
+  """
+  @spec set_pwm_counter_mode(KosAm335xStarterware.PWM.handle(), counter_mode()) :: :ok | any()
+  def set_pwm_counter_mode(handle, mode) do
+    cond do
+      mode not in [:up, :up_down] -> {:error, :invalid_counter_mode}
+      true ->
+        data = if mode == :up do
+          [{:uint32_t, @counter_mode_up}]
         else
-          [{:uint32_t, @pwm_b}, {:uint32_t, duty_cycle}]
+          [{:uint32_t, @counter_mode_up_down}]
         end
-        case call_pwm_server(handle.pwm_ref, data, @set_pwm_duty_cycle_label) do
+        case call_pwm_server(handle.pwm_ref, data, @set_pwm_counter_mode_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Sets the output mode of a particular `pin` on the controller.
+
+  `handle` should be the output given by `setup()/1`. `mode` can be one of:
+
+  - `:normal` - the pin is high for the duty cycle and low otherwise (the
+    default)
+  - `:inverted` - the pin is low for the duty cycle and high otherwise, for
+    active-low drivers
+  - `:force_low` - the pin is parked low regardless of the duty cycle
+  - `:force_high` - the pin is parked high regardless of the duty cycle
+
+  The duty cycle of the pin is kept while it is parked and takes effect again
+  once the pin is put back into `:normal` or `:inverted` mode.
+  """
+  @spec set_pwm_output_mode(KosAm335xStarterware.PWM.handle(), pwm_pin(), output_mode()) :: :ok | any()
+  def set_pwm_output_mode(handle, pin, mode) do
+    cond do
+      not Map.has_key?(@pins, pin) -> {:error, :invalid_pin}
+      not Map.has_key?(@output_modes, mode) -> {:error, :invalid_output_mode}
+      true ->
+        data = [{:uint32_t, Map.fetch!(@pins, pin)}, {:uint32_t, Map.fetch!(@output_modes, mode)}]
+        case call_pwm_server(handle.pwm_ref, data, @set_pwm_output_mode_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Reads the time-base counter of the controller along with the active compare
+  and period registers.
+
+  `handle` should be the output given by `setup()/1`.
+
+  `:counter` is the current value of the counter, which runs from 0 to
+  `:period`. `:compare_a`, `:compare_b` and `:period` are the active register
+  values, these only pick up a new duty cycle or frequency at the next
+  counter-zero event. `:period_events` counts the counter-zero events since
+  `set_pwm_period_events/2` enabled them and is 0 otherwise.
+  """
+  @spec get_pwm_counter(KosAm335xStarterware.PWM.handle()) :: {:ok, counter_status()} | any()
+  def get_pwm_counter(handle) do
+    case call_pwm_server(handle.pwm_ref, [], @get_pwm_counter_label) do
+      {:ok, <<counter::little-32, status::little-32, cmpa::little-32, cmpb::little-32,
+              period::little-32, period_events::little-32>>} ->
+        {:ok, %{
+          counter: counter,
+          direction: (if Bitwise.band(status, @tbsts_ctrdir) != 0, do: :up, else: :down),
+          counter_max_reached: Bitwise.band(status, @tbsts_ctrmax) != 0,
+          sync_in: Bitwise.band(status, @tbsts_synci) != 0,
+          compare_a: cmpa,
+          compare_b: cmpb,
+          period: period,
+          period_events: period_events
+        }}
+      {:ok, _} -> {:error, :failed_to_perform_pwm_operation}
+      error -> error
+    end
+  end
+
+  @doc """
+  Enables or disables counting of PWM periods on the controller.
+
+  `handle` should be the output given by `setup()/1`. `enable` should be
+  `true` to start counting, this resets the count to 0, or `false` to stop.
+
+  The count is maintained by the controller's event trigger interrupt and is
+  read back via `get_pwm_counter/1`. This returns an error if the PWM service
+  was not given the interrupt of the controller.
+  """
+  @spec set_pwm_period_events(KosAm335xStarterware.PWM.handle(), boolean()) :: :ok | any()
+  def set_pwm_period_events(handle, enable) do
+    data = if enable do
+      [{:uint32_t, 1}]
+    else
+      [{:uint32_t, 0}]
+    end
+    case call_pwm_server(handle.pwm_ref, data, @set_pwm_period_events_label) do
+      {:ok, _} -> :ok
+      error -> error
+    end
+  end
+
+  @doc """
+  Starts or stops the clock of the PWM controller.
+
+  `handle` should be the output given by `setup()/1`. `enable` should be
+  `false` to stop the clock so the controller stops drawing power, or `true`
+  to start it again.
+
+  The outputs hold whatever level they were at when the clock stops, set
+  their duty cycle to 0 or force them low first to park them. Every other
+  PWM request returns an error while the clock is stopped, the encoder keeps
+  running.
+  """
+  @spec set_pwm_clock(KosAm335xStarterware.PWM.handle(), boolean()) :: :ok | any()
+  def set_pwm_clock(handle, enable) do
+    data = if enable do
+      [{:uint32_t, 1}]
+    else
+      [{:uint32_t, 0}]
+    end
+    case call_pwm_server(handle.pwm_ref, data, @set_pwm_clock_label) do
+      {:ok, _} -> :ok
+      error -> error
+    end
+  end
+
+  @doc """
+  Starts the quadrature encoder (eQEP) of the PWM subsystem.
+
+  `handle` should be the output given by `setup()/1`. `unit_period_us` is the
+  period in microseconds over which the velocity is measured, from 1 to
+  42949672. `max_position` is the value at which the position wraps around
+  to 0, e.g. the counts per revolution minus one, and defaults to the full
+  32-bit range.
+
+  The encoder counts every edge of both inputs, i.e. four counts per line of
+  the encoder. Configuring the encoder again resets its position and event
+  counts to 0.
+  """
+  @spec configure_qep(KosAm335xStarterware.PWM.handle(), pos_integer(), pos_integer()) :: :ok | any()
+  def configure_qep(handle, unit_period_us, max_position \\ @max_encoder_position) do
+    cond do
+      unit_period_us < 1 or unit_period_us > @max_unit_period_us -> {:error, :invalid_unit_period}
+      max_position < 1 or max_position > @max_encoder_position -> {:error, :invalid_max_position}
+      true ->
+        data = [{:uint32_t, unit_period_us}, {:uint32_t, max_position}]
+        case call_pwm_server(handle.pwm_ref, data, @configure_qep_label) do
           {:ok, _} -> :ok
           error -> error
         end
     end
   end
 
+  @doc """
+  Reads the position of the quadrature encoder.
+
+  `handle` should be the output given by `setup()/1`. `:direction` is the
+  direction of the last movement of the encoder.
+  """
+  @spec get_qep_position(KosAm335xStarterware.PWM.handle()) :: {:ok, encoder_position()} | any()
+  def get_qep_position(handle) do
+    case call_pwm_server(handle.pwm_ref, [], @get_qep_position_label) do
+      {:ok, <<position::little-32, direction::little-32>>} ->
+        {:ok, %{
+          position: position,
+          direction: (if direction != 0, do: :forward, else: :reverse)
+        }}
+      {:ok, _} -> {:error, :failed_to_perform_pwm_operation}
+      error -> error
+    end
+  end
+
+  @doc """
+  Reads the velocity of the quadrature encoder.
+
+  `handle` should be the output given by `setup()/1`.
+
+  `:counts_per_second` is measured from the positions latched by the hardware
+  at the end of the last two unit periods, it is negative when the encoder
+  moves in reverse. `:unit_events` counts the unit periods since the encoder
+  was configured, so a caller can tell whether a new measurement was taken.
+  This returns an error if the PWM service was not given the interrupt of the
+  encoder.
+  """
+  @spec get_qep_velocity(KosAm335xStarterware.PWM.handle()) :: {:ok, encoder_velocity()} | any()
+  def get_qep_velocity(handle) do
+    case call_pwm_server(handle.pwm_ref, [], @get_qep_velocity_label) do
+      {:ok, <<velocity::little-signed-32, unit_events::little-32>>} ->
+        {:ok, %{counts_per_second: velocity, unit_events: unit_events}}
+      {:ok, _} -> {:error, :failed_to_perform_pwm_operation}
+      error -> error
+    end
+  end
+
+  @doc """
+  Reads the index events of the quadrature encoder.
+
+  `handle` should be the output given by `setup()/1`.
+
+  `:index_events` counts the rising edges of the index input since the
+  encoder was configured and `:index_position` is the position latched by the
+  hardware at the last one. This returns an error if the PWM service was not
+  given the interrupt of the encoder.
+  """
+  @spec get_qep_index(KosAm335xStarterware.PWM.handle()) :: {:ok, encoder_index()} | any()
+  def get_qep_index(handle) do
+    case call_pwm_server(handle.pwm_ref, [], @get_qep_index_label) do
+      {:ok, <<index_events::little-32, index_position::little-32>>} ->
+        {:ok, %{index_events: index_events, index_position: index_position}}
+      {:ok, _} -> {:error, :failed_to_perform_pwm_operation}
+      error -> error
+    end
+  end
+
+  @doc """
+  Sets the frequency of the `:apwm` pin, which is independent of the
+  frequency of the ePWM pins.
+
+  `handle` should be the output given by `setup()/1`. `frequency` should be a
+  value from 1 to 50000000 (50 MHz), or 0 to stop driving the pin. The duty
+  cycle and output mode of `:apwm` are set with `set_pwm_duty_cycle/3` and
+  `set_pwm_output_mode/3` like the other pins.
+
+  Starting the `:apwm` pin stops any capture started with
+  `configure_ecap_capture/3`, as both use the eCAP.
+  """
+  @spec set_apwm_frequency(KosAm335xStarterware.PWM.handle(), non_neg_integer()) :: :ok | any()
+  def set_apwm_frequency(handle, frequency) do
+    cond do
+      frequency > @max_apwm_frequency -> {:error, :frequency_is_too_high}
+      true ->
+        data = [{:uint32_t, frequency}]
+        case call_pwm_server(handle.pwm_ref, data, @set_apwm_frequency_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Starts capturing timestamps of edges on the eCAP input of the PWM
+  subsystem.
+
+  `handle` should be the output given by `setup()/1`. `edges` is the edge
+  that triggers each of the four capture events, which repeat in order, e.g.
+  `[:rising, :falling, :rising, :falling]` to measure both the high and low
+  time of a pulse train.
+
+  Timestamps are taken by the hardware at 10 ns resolution. With `delta:
+  true` each timestamp is the time since the previous capture event,
+  otherwise it is the value of a free-running 32-bit counter.
+
+  Capturing again drops the captures that were not collected yet, and
+  capturing stops the `:apwm` pin. This returns an error if the PWM service
+  was not given the interrupt of the eCAP.
+  """
+  @spec configure_ecap_capture(KosAm335xStarterware.PWM.handle(), [capture_edge()], Keyword.t()) :: :ok | any()
+  def configure_ecap_capture(handle, edges, opts \\ []) do
+    cond do
+      length(edges) != @capture_events -> {:error, :invalid_capture_edges}
+      not Enum.all?(edges, &(&1 in [:rising, :falling])) -> {:error, :invalid_capture_edges}
+      true ->
+        falling_edges =
+          edges
+          |> Enum.with_index()
+          |> Enum.reduce(0, fn
+            {:falling, event}, acc -> Bitwise.bor(acc, Bitwise.bsl(1, event))
+            {:rising, _}, acc -> acc
+          end)
+        delta = if Keyword.get(opts, :delta, false), do: 1, else: 0
+        data = [{:uint32_t, 1}, {:uint32_t, falling_edges}, {:uint32_t, delta}]
+        case call_pwm_server(handle.pwm_ref, data, @configure_ecap_capture_label) do
+          {:ok, _} -> :ok
+          error -> error
+        end
+    end
+  end
+
+  @doc """
+  Stops capturing on the eCAP input, dropping the captures that were not
+  collected yet.
+
+  `handle` should be the output given by `setup()/1`.
+  """
+  @spec stop_ecap_capture(KosAm335xStarterware.PWM.handle()) :: :ok | any()
+  def stop_ecap_capture(handle) do
+    data = [{:uint32_t, 0}, {:uint32_t, 0}, {:uint32_t, 0}]
+    case call_pwm_server(handle.pwm_ref, data, @configure_ecap_capture_label) do
+      {:ok, _} -> :ok
+      error -> error
+    end
+  end
+
+  @doc """
+  Collects the oldest captures from the eCAP, up to 32 at a time.
+
+  `handle` should be the output given by `setup()/1`.
+
+  The captures are in the order they were taken. `:overruns` counts the
+  captures that were lost since capturing started because they were not
+  collected in time, call this again while it returns a full batch to catch
+  up.
+  """
+  @spec get_ecap_captures(KosAm335xStarterware.PWM.handle()) :: {:ok, captures()} | any()
+  def get_ecap_captures(handle) do
+    case call_pwm_server(handle.pwm_ref, [], @get_ecap_captures_label) do
+      {:ok, <<count::little-32, overruns::little-32, rest::binary>>}
+          when byte_size(rest) == count * 8 ->
+        captures = for <<event::little-32, timestamp::little-32 <- rest>>, do: {event, timestamp}
+        {:ok, %{captures: captures, overruns: overruns}}
+      {:ok, _} -> {:error, :failed_to_perform_pwm_operation}
+      error -> error
+    end
+  end
+
+  @doc """
+  Enables or disables stopping the clocks of idle parts of the PWM subsystem.
+
+  `handle` should be the output given by `setup()/1`. With `enable` set to
+  `true`, the service stops a clock after each request that leaves its part
+  of the subsystem with nothing to do:
+
+  - the ePWM, when both pins are held at a fixed level (a duty cycle of 0 or
+    100, or forced low or high) and period events are disabled
+  - the eCAP, when it is neither capturing nor driving `:apwm`
+  - the eQEP, when the encoder is not configured
+
+  A stopped clock is started again when a request needs it, which makes that
+  request a little slower. The restart latency is reported by
+  `get_pwm_clock_status/1`. Unlike `set_pwm_clock/2`, requests are never
+  refused.
+  """
+  @spec set_pwm_idle_stop(KosAm335xStarterware.PWM.handle(), boolean()) :: :ok | any()
+  def set_pwm_idle_stop(handle, enable) do
+    data = if enable do
+      [{:uint32_t, 1}]
+    else
+      [{:uint32_t, 0}]
+    end
+    case call_pwm_server(handle.pwm_ref, data, @set_pwm_idle_stop_label) do
+      {:ok, _} -> :ok
+      error -> error
+    end
+  end
+
+  @doc """
+  Reads the state of the clocks of the PWM subsystem.
+
+  `handle` should be the output given by `setup()/1`.
+
+  Every clock change waits for the subsystem to acknowledge it. For each
+  submodule, `:restarts` counts the times its clock was started again after
+  being stopped. `:last_restart_polls` and `:max_restart_polls` give the
+  restart latency in reads of the clock status register.
+  `:ack_timeouts` counts the changes that were never acknowledged.
+  """
+  @spec get_pwm_clock_status(KosAm335xStarterware.PWM.handle()) :: {:ok, clock_status()} | any()
+  def get_pwm_clock_status(handle) do
+    case call_pwm_server(handle.pwm_ref, [], @get_pwm_clock_status_label) do
+      {:ok, <<status::little-32, ack_timeouts::little-32, epwm::binary-size(16),
+              ecap::binary-size(16), eqep::binary-size(16)>>} ->
+        {:ok, %{
+          clock_status_register: status,
+          ack_timeouts: ack_timeouts,
+          epwm: decode_submodule_clock(epwm),
+          ecap: decode_submodule_clock(ecap),
+          eqep: decode_submodule_clock(eqep)
+        }}
+      {:ok, _} -> {:error, :failed_to_perform_pwm_operation}
+      error -> error
+    end
+  end
+
+  defp decode_submodule_clock(<<running::little-32, restarts::little-32, last::little-32, max::little-32>>) do
+    %{
+      running: running != 0,
+      restarts: restarts,
+      last_restart_polls: last,
+      max_restart_polls: max
+    }
+  end
+
   defp call_pwm_server(pwm_ref, data, request) do
     payload = KosMsg.encode(data)
     status_ok = KosMsg.status_ok()
@@ -106,4 +626,15 @@ defmodule KosAm335xStarterware.PWM do
       {:ok, {_, _, _}} -> {:error, :failed_to_perform_pwm_operation}
     end
   end
+
+  # Register-only variant of call_pwm_server, returns the reply param
+  defp call_pwm_server_fast(pwm_ref, param, request) do
+    status_ok = KosMsg.status_ok()
+
+    case KosMsg.call_msg(pwm_ref, request, param, <<>>) do
+      {:error, _} -> {:error, :failed_to_perform_pwm_operation}
+      {:ok, {^status_ok, reply_param, _}} -> {:ok, reply_param}
+      {:ok, {_, _, _}} -> {:error, :failed_to_perform_pwm_operation}
+    end
+  end
 end
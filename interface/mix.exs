@@ -12,6 +12,7 @@ defmodule KosAm335xStarterware.MixProject do
       elixir: "~> 1.11",
       start_permanent: Mix.env() == :prod,
       build_embedded: true,
+      elixirc_paths: elixirc_paths(Mix.env()),
       deps: deps()
     ]
   end
@@ -24,11 +25,15 @@ defmodule KosAm335xStarterware.MixProject do
     ]
   end
 
+  # The tests run on the host against the stand-in KosMsg in test/support
+  defp elixirc_paths(:test), do: ["lib", "test/support"]
+  defp elixirc_paths(_), do: ["lib"]
+
   # Run "mix help deps" to learn about dependencies.
   defp deps do
     kos_builtins = System.get_env("KOS_BUILTINS_PATH", "KOS_BUILTINS_PATH-NOTFOUND")
     [
-      {:kos_msg, path: Path.join(kos_builtins, "/kos_msg_ex")}
+      {:kos_msg, path: Path.join(kos_builtins, "/kos_msg_ex"), only: [:dev, :prod]}
     ]
   end
 end
@@ -0,0 +1,76 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.BenchTest do
+  use ExUnit.Case
+
+  alias KosAm335xStarterware.Bench
+  alias KosAm335xStarterware.GPIO
+  alias KosAm335xStarterware.PWM
+
+  @status_ok 0
+  @status_refused 2
+
+  @read_label 4
+  @write_label 5
+  @fast_read_label 13
+  @fast_write_label 14
+
+  @set_pwm_duty_cycle_label 2
+  @fast_set_pwm_duty_cycle_label 17
+
+  setup do
+    KosMsg.reset()
+  end
+
+  describe "gpio/3" do
+    test "makes n calls of each form and returns the time of a call" do
+      {:ok, handle} = GPIO.setup()
+      KosMsg.respond(fn
+        @read_label, _, _ -> {:ok, {@status_ok, 0, words([0])}}
+        _, _, _ -> {:ok, {@status_ok, 0, <<>>}}
+      end)
+
+      assert {:ok, results} = Bench.gpio(handle, 53, 3)
+      assert results |> Map.keys() |> Enum.sort() == [:read, :read_fast, :write, :write_fast]
+      assert Enum.all?(Map.values(results), &(is_float(&1) and &1 >= 0))
+
+      assert Enum.map(KosMsg.calls(), &elem(&1, 0)) ==
+        List.duplicate(@read_label, 3) ++ List.duplicate(@fast_read_label, 3) ++
+          List.duplicate(@write_label, 3) ++ List.duplicate(@fast_write_label, 3)
+    end
+
+    test "stops at the first call that fails" do
+      {:ok, handle} = GPIO.setup()
+      KosMsg.respond(fn _, _, _ -> {:ok, {@status_refused, 0, <<>>}} end)
+
+      assert Bench.gpio(handle, 53, 3) == {:error, :failed_to_perform_gpio_operation}
+      assert length(KosMsg.calls()) == 1
+    end
+
+    test "refuses a handle with the pin cache" do
+      {:ok, handle} = GPIO.setup(cache: true)
+
+      assert Bench.gpio(handle, 53, 3) == {:error, :cache_enabled}
+      assert KosMsg.calls() == []
+    end
+  end
+
+  describe "pwm/4" do
+    test "makes n calls of each form and returns the time of a call" do
+      {:ok, handle} = PWM.setup()
+
+      assert {:ok, %{set_pwm_duty_cycle: _, set_pwm_duty_cycle_fast: _}} = Bench.pwm(handle, :pwm_a, 50, 2)
+
+      assert KosMsg.calls() == [
+        {@set_pwm_duty_cycle_label, 0, words([0, 50])},
+        {@set_pwm_duty_cycle_label, 0, words([0, 50])},
+        {@fast_set_pwm_duty_cycle_label, 0x3200, <<>>},
+        {@fast_set_pwm_duty_cycle_label, 0x3200, <<>>}
+      ]
+    end
+  end
+
+  defp words(words), do: for(word <- words, into: <<>>, do: <<word::little-32>>)
+end
@@ -0,0 +1,309 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.GPIOTest do
+  use ExUnit.Case
+
+  alias KosAm335xStarterware.GPIO
+  alias KosAm335xStarterware.GPIO.Batch
+
+  @status_ok 0
+  @status_refused 2
+
+  @configure_pin_label 1
+  @read_label 4
+  @write_label 5
+  @get_stats_label 6
+  @batch_label 12
+  @fast_read_label 13
+  @fast_write_label 14
+
+  setup do
+    KosMsg.reset()
+    {:ok, handle} = GPIO.setup()
+    %{handle: handle}
+  end
+
+  describe "batch/2" do
+    test "sends every operation in one request", %{handle: handle} do
+      KosMsg.respond(fn @batch_label, 0, _ -> {:ok, {@status_ok, 0, words([3, 0, 1, 0])}} end)
+
+      batch =
+        Batch.new()
+        |> Batch.configure_pin(53, :output)
+        |> Batch.read(60)
+        |> Batch.write(53, :high)
+
+      assert GPIO.batch(handle, batch) == {:ok, [:ok, :high, :ok]}
+      assert KosMsg.calls() == [{@batch_label, 0, words([@configure_pin_label, 53, 1, @read_label, 60, 0, @write_label, 53, 1])}]
+    end
+
+    test "returns the status and the results before the operation that failed", %{handle: handle} do
+      KosMsg.respond(fn @batch_label, 0, _ -> {:ok, {@status_ok, 0, words([1, 0, @status_refused])}} end)
+
+      batch =
+        Batch.new()
+        |> Batch.write(53, :high)
+        |> Batch.write(54, :high)
+        |> Batch.read(60)
+
+      assert GPIO.batch(handle, batch) == {:error, @status_refused, [:ok]}
+    end
+
+    test "refuses a batch the service would not accept without sending it", %{handle: handle} do
+      assert GPIO.batch(handle, Batch.new()) == {:error, :empty_batch}
+      assert GPIO.batch(handle, Batch.new() |> Batch.read(128)) == {:error, :invalid_pin}
+      assert GPIO.batch(handle, Batch.new() |> Batch.write(53, :on)) == {:error, :invalid_level}
+
+      too_large = Enum.reduce(0..64, Batch.new(), &Batch.read(&2, &1))
+      assert GPIO.batch(handle, too_large) == {:error, :batch_too_large}
+
+      assert KosMsg.calls() == []
+    end
+
+    test "fails when the service refuses the whole batch", %{handle: handle} do
+      KosMsg.respond(fn _, _, _ -> {:ok, {@status_refused, 0, <<>>}} end)
+
+      assert GPIO.batch(handle, Batch.new() |> Batch.read(60)) == {:error, :failed_to_perform_gpio_operation}
+    end
+  end
+
+  describe "get_stats/1" do
+    test "returns the counts of the thread serving the handle and the one-way errors", %{handle: handle} do
+      KosMsg.respond(fn @get_stats_label, 0, <<>> -> {:ok, {@status_ok, 0, words([12, 2, 1])}} end)
+
+      assert GPIO.get_stats(handle) == {:ok, %{requests: 12, errors: 2, one_way_errors: 1}}
+    end
+
+    test "fails on a reply of the wrong size", %{handle: handle} do
+      KosMsg.respond(fn @get_stats_label, 0, <<>> -> {:ok, {@status_ok, 0, words([12, 2])}} end)
+
+      assert GPIO.get_stats(handle) == {:error, :failed_to_perform_gpio_operation}
+    end
+  end
+
+  describe "pin cache" do
+    setup do
+      {:ok, handle} = GPIO.setup(cache: true)
+      %{handle: handle}
+    end
+
+    test "skips writes that would not change the pin", %{handle: handle} do
+      assert GPIO.write(handle, 53, :high) == :ok
+      assert GPIO.write(handle, 53, :high) == :ok
+      assert GPIO.write(handle, 53, :low) == :ok
+
+      assert length(KosMsg.calls()) == 2
+      assert GPIO.get_cache_stats(handle) == {:ok, %{writes_saved: 1, configures_saved: 0, reads_saved: 0}}
+    end
+
+    test "skips configuring a pin the same way again", %{handle: handle} do
+      assert GPIO.configure_pin(handle, 53, :output, :high) == :ok
+      assert GPIO.configure_pin(handle, 53, :output) == :ok
+      assert GPIO.configure_pin(handle, 53, :output, :high) == :ok
+      assert GPIO.configure_pin(handle, 53, :output, :low) == :ok
+
+      assert length(KosMsg.calls()) == 2
+      assert {:ok, %{configures_saved: 2}} = GPIO.get_cache_stats(handle)
+    end
+
+    test "answers reads of the outputs it has set", %{handle: handle} do
+      assert GPIO.configure_pin(handle, 53, :output, :high) == :ok
+      assert GPIO.read(handle, 53) == {:ok, :high}
+      assert GPIO.read_fast(handle, 53) == {:ok, :high}
+
+      assert [{@configure_pin_label, _, _}] = KosMsg.calls()
+      assert {:ok, %{reads_saved: 2}} = GPIO.get_cache_stats(handle)
+    end
+
+    test "keeps a change made by another process while a request is in flight", %{handle: handle} do
+      test = self()
+
+      # Hold the write in the service until the pin has been configured
+      KosMsg.respond(fn
+        @write_label, _, _ ->
+          send(test, {:writing, self()})
+          receive do
+            :continue -> :ok
+          end
+          {:ok, {@status_ok, 0, <<>>}}
+        _, _, _ ->
+          {:ok, {@status_ok, 0, <<>>}}
+      end)
+
+      writer = Task.async(fn -> GPIO.write(handle, 53, :high) end)
+      assert_receive {:writing, writer_pid}
+      assert GPIO.configure_pin(handle, 53, :output) == :ok
+      send(writer_pid, :continue)
+      assert Task.await(writer) == :ok
+
+      # Both the direction and the level are known, so the read is not sent
+      assert GPIO.read(handle, 53) == {:ok, :high}
+      assert {:ok, %{reads_saved: 1}} = GPIO.get_cache_stats(handle)
+    end
+
+    test "forgets the pins a batch writes", %{handle: handle} do
+      KosMsg.respond(fn _, _, _ -> {:ok, {@status_ok, 0, words([1, 0])}} end)
+
+      assert GPIO.write(handle, 53, :high) == :ok
+      assert GPIO.batch(handle, Batch.new() |> Batch.write(53, :high)) == {:ok, [:ok]}
+      assert GPIO.write(handle, 53, :high) == :ok
+
+      assert length(KosMsg.calls()) == 3
+    end
+
+    test "is off unless asked for" do
+      {:ok, handle} = GPIO.setup()
+
+      assert GPIO.write(handle, 53, :high) == :ok
+      assert GPIO.write(handle, 53, :high) == :ok
+
+      assert length(KosMsg.calls()) == 2
+      assert GPIO.get_cache_stats(handle) == {:error, :cache_disabled}
+    end
+  end
+
+  describe "fast requests" do
+    test "read/2 and write/3 keep their payload labels", %{handle: handle} do
+      KosMsg.respond(fn
+        @read_label, 0, _ -> {:ok, {@status_ok, 0, words([1])}}
+        @write_label, 0, _ -> {:ok, {@status_ok, 0, <<>>}}
+      end)
+
+      assert GPIO.read(handle, 60) == {:ok, :high}
+      assert GPIO.write(handle, 53, :high) == :ok
+
+      assert KosMsg.calls() == [{@read_label, 0, words([60])}, {@write_label, 0, words([53, 1])}]
+    end
+
+    test "read_fast/2 carries the pin in the param", %{handle: handle} do
+      KosMsg.respond(fn @fast_read_label, 60, <<>> -> {:ok, {@status_ok, 1, <<>>}} end)
+      assert GPIO.read_fast(handle, 60) == {:ok, :high}
+
+      KosMsg.respond(fn @fast_read_label, 61, <<>> -> {:ok, {@status_ok, 0, <<>>}} end)
+      assert GPIO.read_fast(handle, 61) == {:ok, :low}
+    end
+
+    test "write_fast/3 carries the pin and level in the param", %{handle: handle} do
+      assert GPIO.write_fast(handle, 53, :high) == :ok
+      assert GPIO.write_fast(handle, 127, :low) == :ok
+
+      assert KosMsg.calls() == [{@fast_write_label, 0x135, <<>>}, {@fast_write_label, 127, <<>>}]
+    end
+
+    test "refuse pins that would not fit in the low byte of the param", %{handle: handle} do
+      assert GPIO.read_fast(handle, 128) == {:error, :invalid_pin}
+      assert GPIO.write_fast(handle, 256, :low) == {:error, :invalid_pin}
+
+      assert KosMsg.calls() == []
+    end
+
+    test "fail when the service refuses them", %{handle: handle} do
+      KosMsg.respond(fn _, _, _ -> {:ok, {@status_refused, 0, <<>>}} end)
+
+      assert GPIO.read_fast(handle, 60) == {:error, :failed_to_perform_gpio_operation}
+      assert GPIO.write_fast(handle, 53, :high) == {:error, :failed_to_perform_gpio_operation}
+    end
+  end
+
+  describe "write_async/3" do
+    setup do
+      {:ok, handle} = GPIO.setup(async: true)
+      %{handle: handle}
+    end
+
+    test "sends the result to the caller", %{handle: handle} do
+      KosMsg.respond(fn @batch_label, 0, payload -> batch_ok(payload) end)
+
+      ref = GPIO.write_async(handle, 53, :high)
+      assert_receive {:gpio_done, ^ref, :ok}
+
+      assert KosMsg.calls() == [{@batch_label, 0, words([@write_label, 53, 1])}]
+    end
+
+    test "sends the writes queued while the service is busy in one batch", %{handle: handle} do
+      test = self()
+
+      KosMsg.respond(fn @batch_label, 0, payload ->
+        send(test, {:batch, self(), payload})
+        receive do
+          :continue -> batch_ok(payload)
+        end
+      end)
+
+      first = GPIO.write_async(handle, 53, :high)
+      assert_receive {:batch, worker, _}
+      second = GPIO.write_async(handle, 54, :high)
+      third = GPIO.write_async(handle, 55, :low)
+      send(worker, :continue)
+
+      assert_receive {:batch, ^worker, payload}
+      assert payload == words([@write_label, 54, 1, @write_label, 55, 0])
+      send(worker, :continue)
+
+      assert_receive {:gpio_done, ^first, :ok}
+      assert_receive {:gpio_done, ^second, :ok}
+      assert_receive {:gpio_done, ^third, :ok}
+    end
+
+    test "sends the writes after one that failed again", %{handle: handle} do
+      test = self()
+
+      KosMsg.respond(fn @batch_label, 0, payload ->
+        send(test, {:batch, self(), payload})
+        receive do
+          {:reply, reply} -> reply
+        end
+      end)
+
+      first = GPIO.write_async(handle, 53, :high)
+      assert_receive {:batch, worker, _}
+      second = GPIO.write_async(handle, 54, :high)
+      third = GPIO.write_async(handle, 55, :low)
+      send(worker, {:reply, {:ok, {@status_ok, 0, words([1, 0])}}})
+      assert_receive {:gpio_done, ^first, :ok}
+
+      # The second write is refused, so the third is sent on its own
+      assert_receive {:batch, ^worker, _}
+      send(worker, {:reply, {:ok, {@status_ok, 0, words([0, @status_refused])}}})
+      assert_receive {:gpio_done, ^second, {:error, :failed_to_perform_gpio_operation}}
+
+      assert_receive {:batch, ^worker, payload}
+      assert payload == words([@write_label, 55, 0])
+      send(worker, {:reply, {:ok, {@status_ok, 0, words([1, 0])}}})
+      assert_receive {:gpio_done, ^third, :ok}
+    end
+
+    test "returns {:error, :noproc} once the worker has exited", %{handle: handle} do
+      :ok = GenServer.stop(handle.async)
+
+      assert GPIO.write_async(handle, 53, :high) == {:error, :noproc}
+      assert KosMsg.calls() == []
+    end
+
+    test "sends :DOWN if the worker exits before the write is done", %{handle: handle} do
+      Process.flag(:trap_exit, true)
+      KosMsg.respond(fn _, _, _ -> exit(:service_gone) end)
+
+      ExUnit.CaptureLog.capture_log(fn ->
+        ref = GPIO.write_async(handle, 53, :high)
+        assert_receive {:DOWN, ^ref, :process, _, :service_gone}
+        refute_received {:gpio_done, ^ref, _}
+      end)
+    end
+
+    test "is off unless asked for" do
+      {:ok, handle} = GPIO.setup()
+
+      assert GPIO.write_async(handle, 53, :high) == {:error, :async_disabled}
+    end
+  end
+
+  defp batch_ok(payload) do
+    ops = div(byte_size(payload), 12)
+    {:ok, {@status_ok, 0, words([ops | List.duplicate(0, ops)])}}
+  end
+
+  defp words(words), do: for(word <- words, into: <<>>, do: <<word::little-32>>)
+end
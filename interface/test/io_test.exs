@@ -0,0 +1,76 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.IOTest do
+  use ExUnit.Case
+
+  alias KosAm335xStarterware.GPIO
+  alias KosAm335xStarterware.IO
+
+  @status_ok 0
+  @status_refused 2
+
+  @batch_label 0x100
+  @batch_gpio 0
+  @batch_pwm 1
+
+  @gpio_fast_read_label 13
+  @gpio_fast_write_label 14
+  @pwm_fast_set_duty_cycle_label 17
+
+  setup do
+    KosMsg.reset()
+    {:ok, handle} = GPIO.setup()
+    %{handle: handle}
+  end
+
+  describe "batch/2" do
+    test "sends the operations of both services in one request", %{handle: handle} do
+      KosMsg.respond(fn @batch_label, 0, _ -> {:ok, {@status_ok, 0, words([3, 0, 1, 0])}} end)
+
+      ops = [{:gpio_write, 53, :high}, {:gpio_read, 60}, {:pwm_duty_cycle, :pwm_b, 40}]
+      assert IO.batch(handle, ops) == {:ok, [:ok, :high, :ok]}
+
+      assert KosMsg.calls() == [
+        {@batch_label, 0, words([
+          @batch_gpio, @gpio_fast_write_label, 0x135,
+          @batch_gpio, @gpio_fast_read_label, 60,
+          @batch_pwm, @pwm_fast_set_duty_cycle_label, 0x2801
+        ])}
+      ]
+    end
+
+    test "returns the status and the results before the operation that failed", %{handle: handle} do
+      KosMsg.respond(fn @batch_label, 0, _ -> {:ok, {@status_ok, 0, words([1, 1, @status_refused])}} end)
+
+      ops = [{:gpio_read, 60}, {:pwm_duty_cycle, :apwm, 50}, {:gpio_write, 53, :low}]
+      assert IO.batch(handle, ops) == {:error, @status_refused, [:high]}
+    end
+
+    test "refuses a batch the services would not accept without sending it", %{handle: handle} do
+      assert IO.batch(handle, []) == {:error, :empty_batch}
+      assert IO.batch(handle, [{:gpio_read, 128}]) == {:error, :invalid_pin}
+      assert IO.batch(handle, [{:gpio_write, 53, :on}]) == {:error, :invalid_level}
+      assert IO.batch(handle, [{:pwm_duty_cycle, :pwm_c, 40}]) == {:error, :invalid_pin}
+      assert IO.batch(handle, [{:pwm_duty_cycle, :pwm_a, 101}]) == {:error, :duty_cycle_is_too_high}
+      assert IO.batch(handle, [{:gpio_toggle, 53}]) == {:error, :invalid_operation}
+      assert IO.batch(handle, List.duplicate({:gpio_read, 60}, 65)) == {:error, :batch_too_large}
+
+      assert KosMsg.calls() == []
+    end
+
+    test "forgets the cached pins it writes" do
+      {:ok, handle} = GPIO.setup(cache: true)
+      KosMsg.respond(fn _, _, _ -> {:ok, {@status_ok, 0, words([1, 0])}} end)
+
+      assert GPIO.write(handle, 53, :high) == :ok
+      assert IO.batch(handle, [{:gpio_write, 53, :high}]) == {:ok, [:ok]}
+      assert GPIO.write(handle, 53, :high) == :ok
+
+      assert length(KosMsg.calls()) == 3
+    end
+  end
+
+  defp words(words), do: for(word <- words, into: <<>>, do: <<word::little-32>>)
+end
@@ -0,0 +1,55 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosAm335xStarterware.PWMTest do
+  use ExUnit.Case
+
+  alias KosAm335xStarterware.PWM
+
+  @status_refused 2
+
+  @set_pwm_duty_cycle_label 2
+  @fast_set_pwm_duty_cycle_label 17
+
+  setup do
+    KosMsg.reset()
+    {:ok, handle} = PWM.setup()
+    %{handle: handle}
+  end
+
+  describe "fast requests" do
+    test "set_pwm_duty_cycle/3 keeps its payload label", %{handle: handle} do
+      assert PWM.set_pwm_duty_cycle(handle, :pwm_b, 40) == :ok
+
+      assert KosMsg.calls() == [{@set_pwm_duty_cycle_label, 0, words([1, 40])}]
+    end
+
+    test "set_pwm_duty_cycle_fast/3 carries the pin and duty cycle in the param", %{handle: handle} do
+      assert PWM.set_pwm_duty_cycle_fast(handle, :pwm_a, 100) == :ok
+      assert PWM.set_pwm_duty_cycle_fast(handle, :pwm_b, 40) == :ok
+      assert PWM.set_pwm_duty_cycle_fast(handle, :apwm, 0) == :ok
+
+      assert KosMsg.calls() == [
+        {@fast_set_pwm_duty_cycle_label, 0x6400, <<>>},
+        {@fast_set_pwm_duty_cycle_label, 0x2801, <<>>},
+        {@fast_set_pwm_duty_cycle_label, 0x0002, <<>>}
+      ]
+    end
+
+    test "set_pwm_duty_cycle_fast/3 refuses what the service would", %{handle: handle} do
+      assert PWM.set_pwm_duty_cycle_fast(handle, :pwm_c, 40) == {:error, :invalid_pin}
+      assert PWM.set_pwm_duty_cycle_fast(handle, :pwm_a, 101) == {:error, :duty_cycle_is_too_high}
+
+      assert KosMsg.calls() == []
+    end
+
+    test "set_pwm_duty_cycle_fast/3 fails when the service refuses it", %{handle: handle} do
+      KosMsg.respond(fn _, _, _ -> {:ok, {@status_refused, 0, <<>>}} end)
+
+      assert PWM.set_pwm_duty_cycle_fast(handle, :pwm_a, 40) == {:error, :failed_to_perform_pwm_operation}
+    end
+  end
+
+  defp words(words), do: for(word <- words, into: <<>>, do: <<word::little-32>>)
+end
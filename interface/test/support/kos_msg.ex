@@ -0,0 +1,45 @@
+# Copyright (c) 2023, Kry10 Limited. All rights reserved.
+#
+# SPDX-License-Identifier: LicenseRef-Kry10
+
+defmodule KosMsg do
+  @moduledoc false
+
+  # Stands in for the KosMsg of the KOS builtins so the interface can be tested
+  # on a host. Every call is recorded and answered by the function given to
+  # respond/1, which runs in the process that made the call.
+
+  use Agent
+
+  @status_ok 0
+
+  def start_link(_opts), do: Agent.start_link(&initial_state/0, name: __MODULE__)
+
+  @doc false
+  def reset(), do: Agent.update(__MODULE__, fn _ -> initial_state() end)
+
+  # `responder` is given the label, param and payload of each call and returns
+  # what call_msg/4 returns
+  @doc false
+  def respond(responder), do: Agent.update(__MODULE__, &%{&1 | responder: responder})
+
+  # The calls made since the last reset/0, in order, as {label, param, payload}
+  @doc false
+  def calls(), do: Agent.get(__MODULE__, &Enum.reverse(&1.calls))
+
+  def open(_protocol), do: {:ok, make_ref()}
+
+  def status_ok(), do: @status_ok
+
+  def encode(data), do: for({:uint32_t, word} <- data, into: <<>>, do: <<word::little-32>>)
+
+  def call_msg(_ref, label, param, payload) do
+    responder = Agent.get_and_update(__MODULE__, fn state ->
+      {state.responder, %{state | calls: [{label, param, payload} | state.calls]}}
+    end)
+
+    responder.(label, param, payload)
+  end
+
+  defp initial_state(), do: %{responder: fn _, _, _ -> {:ok, {@status_ok, 0, <<>>}} end, calls: []}
+end
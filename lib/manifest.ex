@@ -8,19 +8,44 @@ defmodule KosAm335xStarterware.Manifest do
   @gpio_protocol "am335x_gpio_protocol"
   @pwm_protocol "am335x_pwm_protocol"
 
+  @gpio_resources [
+    %{ address: 0x44e07000, size: 0x1000 },
+    %{ address: 0x4804c000, size: 0x1000 },
+    %{ address: 0x481ac000, size: 0x1000 },
+    %{ address: 0x481ae000, size: 0x1000 }
+  ]
+
+  @gpio_irqs [96, 98, 32, 62]
+
   @gpio_clock_setups [
+    %KosClock.Setup{offset: 0x408, value_to_set: 0x40002, expected_result: 0x40002},
     %KosClock.Setup{offset: 0xac, value_to_set: 0x40002, expected_result: 0x40002},
     %KosClock.Setup{offset: 0xb0, value_to_set: 0x40002, expected_result: 0x40002},
-    %KosClock.Setup{offset: 0xb4, value_to_set: 0x40002, expected_result: 0x40002},
-    %KosClock.Setup{offset: 0x408, value_to_set: 0x40002, expected_result: 0x40002}
+    %KosClock.Setup{offset: 0xb4, value_to_set: 0x40002, expected_result: 0x40002}
   ]
 
+  # DMTIMER6, its 1 ms tick paces the sampling of software debounced pins. Only
+  # services included with software_debounce: true are given it
+  @gpio_debounce_timer_resource %{ address: 0x48048000, size: 0x1000 }
+  @gpio_debounce_timer_irq 94
+  @gpio_debounce_timer_clock_setup %KosClock.Setup{offset: 0xf0, value_to_set: 2, expected_result: 2}
+
+  @gpio_ids [0,1,2,3]
+
   @pwm_resources [
     [%{ address: 0x48300000, size: 0x1000 }],
     [%{ address: 0x48302000, size: 0x1000 }],
     [%{ address: 0x48304000, size: 0x1000 }],
   ]
 
+  @pwm_irqs [86, 87, 39]
+
+  @pwm_qep_irqs [79, 88, 89]
+
+  @pwm_ecap_irqs [31, 47, 61]
+
+  @pwm_tz_irqs [58, 59, 60]
+
   @pwm_clock_setups [
     [%KosClock.Setup{offset: 0xd4, value_to_set: 2, expected_result: 2}],
     [%KosClock.Setup{offset: 0xcc, value_to_set: 2, expected_result: 2}],
@@ -33,15 +58,17 @@ defmodule KosAm335xStarterware.Manifest do
   def include_gpio(context, opts \\ []) do
     protocol = Keyword.get(opts, :protocol, @gpio_protocol)
     msg_server = Keyword.get(opts, :msg_server, Context.default_msg_server())
-
-    gpio = gpio_definition(protocol)
     {:ok, context} =
       :kos_am335x_starterware
       |> Application.app_dir()
       |> Path.join("cmake/kos_am335x_gpio")
       |> then(&Context.put_binary(context, "kos_am335x_gpio", &1))
 
-    add_and_publish(context, gpio, protocol, @gpio_clock_setups, msg_server)
+    with {:ok, gpio, extra_protocols, clock_setups} <- gpio_app(protocol, opts),
+         {:ok, context, app, protocol} <- add_and_publish(context, gpio, protocol, clock_setups, msg_server),
+         {:ok, context} <- publish_optional(context, app, extra_protocols, msg_server) do
+      {:ok, context, app, protocol}
+    end
   end
 
   @spec include_pwm(Context.t(), Keyword.t()) :: {:ok, Context.t(), App.t(), String.t()} | {:error, any}
@@ -49,6 +76,8 @@ defmodule KosAm335xStarterware.Manifest do
     protocol = Keyword.get(opts, :protocol, @pwm_protocol)
     msg_server = Keyword.get(opts, :msg_server, Context.default_msg_server())
     pwm_id = Keyword.get(opts, :am335x_pwm_id, 0)
+    checkpoint_frame = Keyword.get(opts, :checkpoint_frame)
+    status_frame = Keyword.get(opts, :status_frame)
     {:ok, context} =
       :kos_am335x_starterware
       |> Application.app_dir()
@@ -58,7 +87,7 @@ defmodule KosAm335xStarterware.Manifest do
     if pwm_id not in @pwm_ids do
       {:error, :invalid_pwm_id}
     else
-      pwm = pwm_definition(protocol, pwm_id)
+      pwm = pwm_definition(protocol, pwm_id, checkpoint_frame, status_frame)
 
       clock_setup = pwm_clock_setup(pwm_id)
 
@@ -66,6 +95,68 @@ defmodule KosAm335xStarterware.Manifest do
     end
   end
 
+  @doc """
+  Runs the GPIO service and the PWM service of one PWMSS in a single app. Both
+  protocols are served on the one endpoint and told apart by their badges, so
+  a client that uses GPIO and PWM talks to one process and can send requests
+  for both in one `KosAm335xStarterware.IO.batch/2`.
+
+  Takes the options of `include_gpio/2`, with `:gpio_protocol` in place of
+  `:protocol`, and `:pwm_protocol`, `:am335x_pwm_id`, `:pwm_checkpoint_frame`
+  and `:pwm_status_frame` for the PWM service. The GPIO priority, controller
+  and one-way protocols keep their own endpoints in the app. Returns both
+  protocol names.
+  """
+  @spec include_io(Context.t(), Keyword.t()) ::
+          {:ok, Context.t(), App.t(), {String.t(), String.t()}} | {:error, any}
+  def include_io(context, opts \\ []) do
+    gpio_protocol = Keyword.get(opts, :gpio_protocol, @gpio_protocol)
+    pwm_protocol = Keyword.get(opts, :pwm_protocol, @pwm_protocol)
+    msg_server = Keyword.get(opts, :msg_server, Context.default_msg_server())
+    pwm_id = Keyword.get(opts, :am335x_pwm_id, 0)
+    pwm_checkpoint_frame = Keyword.get(opts, :pwm_checkpoint_frame)
+    pwm_status_frame = Keyword.get(opts, :pwm_status_frame)
+    {:ok, context} =
+      :kos_am335x_starterware
+      |> Application.app_dir()
+      |> Path.join("cmake/kos_am335x_io")
+      |> then(&Context.put_binary(context, "kos_am335x_io", &1))
+
+    with {:ok, gpio, extra_protocols, gpio_clock_setups} <- gpio_app(gpio_protocol, opts) do
+      if pwm_id not in @pwm_ids do
+        {:error, :invalid_pwm_id}
+      else
+        pwm = pwm_definition(pwm_protocol, pwm_id, pwm_checkpoint_frame, pwm_status_frame)
+        io = io_definition(gpio, pwm)
+
+        clock_setups = gpio_clock_setups ++ pwm_clock_setup(pwm_id)
+
+        with {:ok, context, app, _} <- add_and_publish(context, io, gpio_protocol, clock_setups, msg_server),
+             {:ok, context} <- publish_optional(context, app, [pwm_protocol | extra_protocols], msg_server) do
+          {:ok, context, app, {gpio_protocol, pwm_protocol}}
+        end
+      end
+    end
+  end
+
+  @doc """
+  The device frame of the GPIO status page at `address`, for the resources of
+  the client apps that read the pins directly from it. The clients given the
+  frame are the ones whose definitions include it, the page is laid out as in
+  `c_src/gpio/gpio_status.h`. Clients map it with `gpio_status_map()` from
+  that header, which only gives them read access.
+  """
+  @spec gpio_status_resource(non_neg_integer()) :: map()
+  def gpio_status_resource(address), do: %{ address: address, size: 0x1000 }
+
+  @doc """
+  The device frame of a PWM status page at `address`, for the resources of the
+  client apps that read the configuration directly from it. The page is laid
+  out as in `c_src/pwm/pwm_status.h`.
+  """
+  @spec pwm_status_resource(non_neg_integer()) :: map()
+  def pwm_status_resource(address), do: %{ address: address, size: 0x1000 }
+
   defp add_and_publish(context, app, protocol, clock_setups, msg_server) do
     with {:ok, context, app} <- Context.put_app(context, app),
          {:ok, context} <- Context.register_clock_setup(context, app, clock_setups),
@@ -76,7 +167,106 @@ defmodule KosAm335xStarterware.Manifest do
     end
   end
 
-  defp gpio_definition(protocol) do
+  defp publish_optional(context, app, protocols, msg_server) do
+    protocols
+    |> Enum.reject(&is_nil/1)
+    |> Enum.reduce_while({:ok, context}, fn protocol, {:ok, context} ->
+      case Context.publish_protocol(context, app, protocol, msg_server) do
+        {:ok, context} -> {:cont, {:ok, context}}
+        error -> {:halt, error}
+      end
+    end)
+  end
+
+  # The GPIO app for the options of include_gpio/2, along with the optional
+  # protocols it publishes and the clocks it needs. The controllers, and those
+  # of the controller protocols, must be ones that the service is given.
+  defp gpio_app(protocol, opts) do
+    priority_protocol = Keyword.get(opts, :priority_protocol)
+    one_way_protocol = Keyword.get(opts, :one_way_protocol)
+    controller_protocols = Keyword.get(opts, :controller_protocols, [])
+    controllers = Keyword.get(opts, :controllers, @gpio_ids)
+    checkpoint_frame = Keyword.get(opts, :checkpoint_frame)
+    status_frame = Keyword.get(opts, :status_frame)
+    status_inputs = Keyword.get(opts, :status_inputs, [])
+    software_debounce = Keyword.get(opts, :software_debounce, false)
+
+    cond do
+      Enum.any?(controllers, &(&1 not in @gpio_ids)) ->
+        {:error, :invalid_controller}
+      Enum.any?(controller_protocols, fn {controller, _} -> controller not in controllers end) ->
+        {:error, :invalid_controller}
+      status_inputs != [] and status_frame == nil ->
+        {:error, :status_inputs_without_status_frame}
+      true ->
+        options =
+          gpio_options(priority_protocol, one_way_protocol, controller_protocols) ++
+            checkpoint_options(checkpoint_frame) ++
+            status_options(status_frame, status_inputs)
+        gpio = gpio_definition(protocol, options, controllers, checkpoint_frame, status_frame, software_debounce)
+
+        extra_protocols = [priority_protocol, one_way_protocol | Enum.map(controller_protocols, fn {_, p} -> p end)]
+
+        clock_setups =
+          Enum.map(controllers, &Enum.at(@gpio_clock_setups, &1)) ++
+            if(software_debounce, do: [@gpio_debounce_timer_clock_setup], else: [])
+
+        {:ok, gpio, extra_protocols, clock_setups}
+    end
+  end
+
+  # Options are passed to the GPIO service as "key=value" arguments after the
+  # protocol name
+  defp gpio_options(priority_protocol, one_way_protocol, controller_protocols) do
+    priority_options = if priority_protocol do
+      ["priority_protocol=#{priority_protocol}"]
+    else
+      []
+    end
+
+    one_way_options = if one_way_protocol do
+      ["one_way_protocol=#{one_way_protocol}"]
+    else
+      []
+    end
+
+    controller_options =
+      Enum.map(controller_protocols, fn {controller, protocol} ->
+        "gpio#{controller}_protocol=#{protocol}"
+      end)
+
+    priority_options ++ one_way_options ++ controller_options
+  end
+
+  # The checkpoint frame is a page of memory that outlives the services, such
+  # as a page of on-chip RAM, that they keep their state in across restarts
+  defp checkpoint_options(nil), do: []
+  defp checkpoint_options(address), do: ["checkpoint_frame=0x#{Integer.to_string(address, 16)}"]
+
+  defp checkpoint_resources(nil), do: []
+  defp checkpoint_resources(address), do: [%{ address: address, size: 0x1000 }]
+
+  # The status page is another such page, which the service keeps up to date
+  # with the pins so that clients given the page don't need to send requests
+  defp status_options(nil, _), do: []
+  defp status_options(address, []), do: ["status_frame=0x#{Integer.to_string(address, 16)}"]
+  defp status_options(address, inputs) do
+    status_options(address, []) ++ ["status_inputs=#{Enum.join(inputs, ",")}"]
+  end
+
+  # Only the controllers that are used are given to the service, it finds out
+  # which ones it has, and whether it has the debounce timer, from its device
+  # frames
+  defp gpio_definition(protocol, options, controllers, checkpoint_frame, status_frame, software_debounce) do
+    {timer_frames, timer_irqs} =
+      if software_debounce do
+        {[@gpio_debounce_timer_resource], [@gpio_debounce_timer_irq]}
+      else
+        {[], []}
+      end
+    device_frames = Enum.map(controllers, &Enum.at(@gpio_resources, &1)) ++ timer_frames
+    irqs = Enum.map(controllers, &Enum.at(@gpio_irqs, &1)) ++ timer_irqs
+
     %{
       name: "am335x_gpio",
       binary: "kos_am335x_gpio",
@@ -85,20 +275,21 @@ defmodule KosAm335xStarterware.Manifest do
       ut_4k_pages: 32,
       max_priority: 150,
       priority: 145,
-      arguments: [protocol],
+      arguments: [protocol | options],
       resources: %{
-        device_frames: [
-          %{ address: 0x44e07000, size: 0x1000 },
-          %{ address: 0x4804c000, size: 0x1000 },
-          %{ address: 0x481ac000, size: 0x1000 },
-          %{ address: 0x481ae000, size: 0x1000 }
-        ],
+        device_frames:
+          device_frames ++ checkpoint_resources(checkpoint_frame) ++ checkpoint_resources(status_frame),
+        irqs: irqs
       }
     }
   end
 
-  defp pwm_definition(protocol, pwm_id) do
+  defp pwm_definition(protocol, pwm_id, checkpoint_frame, status_frame) do
     pwm_resource = Enum.at(@pwm_resources, pwm_id)
+    pwm_irq = Enum.at(@pwm_irqs, pwm_id)
+    qep_irq = Enum.at(@pwm_qep_irqs, pwm_id)
+    ecap_irq = Enum.at(@pwm_ecap_irqs, pwm_id)
+    tz_irq = Enum.at(@pwm_tz_irqs, pwm_id)
     %{
       name: "am335x_pwm",
       binary: "kos_am335x_pwm",
@@ -107,13 +298,33 @@ defmodule KosAm335xStarterware.Manifest do
       ut_4k_pages: 32,
       max_priority: 150,
       priority: 145,
-      arguments: [protocol],
+      arguments: [protocol | checkpoint_options(checkpoint_frame) ++ status_options(status_frame, [])],
       resources: %{
-        device_frames: pwm_resource
+        device_frames: pwm_resource ++ checkpoint_resources(checkpoint_frame) ++ checkpoint_resources(status_frame),
+        irqs: [pwm_irq, qep_irq, ecap_irq, tz_irq]
       }
     }
   end
 
+  # The combined app gets the resources of both, its arguments are the two
+  # protocol names followed by the GPIO options and the PWM options, which are
+  # prefixed with "pwm_" to tell them apart
+  defp io_definition(gpio, pwm) do
+    [gpio_protocol | gpio_options] = gpio.arguments
+    [pwm_protocol | pwm_options] = pwm.arguments
+
+    %{
+      gpio
+      | name: "am335x_io",
+        binary: "kos_am335x_io",
+        arguments: [gpio_protocol, pwm_protocol | gpio_options ++ Enum.map(pwm_options, &("pwm_" <> &1))],
+        resources: %{
+          device_frames: gpio.resources.device_frames ++ pwm.resources.device_frames,
+          irqs: gpio.resources.irqs ++ pwm.resources.irqs
+        }
+    }
+  end
+
   defp pwm_clock_setup(pwm_id) do
     Enum.at(@pwm_clock_setups, pwm_id)
   end